@@ -227,12 +227,32 @@ static inline void internal_end(void)
 /* Align */
 #define FAST_BUFFER_ALIGN 16 /* SSE2 requirement */
 
-uint8* fast_buffer; /* raw pointer */
-uint8* fast_buffer_aligned; /* aligned pointer */
-uint8* fast_buffer_ptr; /* top of the stack */
+/*
+ * With USE_BLIT_THREAD every thread has its own buffers stack, and
+ * different threads can use different pipelines at the same time.
+ * The thread calling video_blit_init() allocates it there, any other
+ * thread at the first use, and frees it with video_blit_thread_done().
+ * A pipeline must be created and destroyed by the same thread.
+ */
+#ifdef USE_BLIT_THREAD
+#define FAST_BUFFER_THREAD __thread
+#else
+#define FAST_BUFFER_THREAD
+#endif
+
+static FAST_BUFFER_THREAD uint8* fast_buffer; /* raw pointer */
+static FAST_BUFFER_THREAD uint8* fast_buffer_aligned; /* aligned pointer */
+static FAST_BUFFER_THREAD uint8* fast_buffer_ptr; /* top of the stack */
+
+static void video_buffer_init(void);
 
 static void* video_buffer_mark(void)
 {
+#ifdef USE_BLIT_THREAD
+	if (!fast_buffer)
+		video_buffer_init();
+#endif
+
 	return fast_buffer_ptr;
 }
 
@@ -263,6 +283,9 @@ static void video_buffer_init(void)
 static void video_buffer_done(void)
 {
 	free(fast_buffer);
+	fast_buffer = 0;
+	fast_buffer_aligned = 0;
+	fast_buffer_ptr = 0;
 }
 
 /***************************************************************************/
@@ -285,6 +308,11 @@ void video_blit_done(void)
 	video_buffer_done();
 }
 
+void video_blit_thread_done(void)
+{
+	video_buffer_done();
+}
+
 /***************************************************************************/
 /* stage helper */
 
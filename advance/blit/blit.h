@@ -377,6 +377,13 @@ adv_error video_blit_init(void);
  */
 void video_blit_done(void);
 
+/**
+ * Free the blit buffers of the calling thread.
+ * With USE_BLIT_THREAD any thread, except the one calling video_blit_init(),
+ * using the blit functions must call it before exiting.
+ */
+void video_blit_thread_done(void);
+
 /***************************************************************************/
 /* pipeline blit */
 
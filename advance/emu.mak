@@ -46,7 +46,9 @@ ADVANCEOBJS += \
 ifeq ($(CONF_LIB_PTHREAD),yes)
 CFLAGS += -D_REENTRANT
 ADVANCECFLAGS += -DUSE_SMP
+MAMECFLAGS += -DUSE_SMP
 ADVANCELIBS += -lpthread
+EMUCHDMANLDFLAGS += -lpthread
 ADVANCEOBJS += $(OBJ)/advance/osd/thdouble.o
 else
 ADVANCEOBJS += $(OBJ)/advance/osd/thmono.o
@@ -278,8 +280,10 @@ ADVANCEOBJS += \
 ifeq ($(CONF_LIB_PTHREAD),yes)
 CFLAGS += -D_REENTRANT
 ADVANCECFLAGS += -DUSE_SMP
+MAMECFLAGS += -DUSE_SMP
 # pthread-win32 library without exceptions management
 ADVANCELIBS += -lpthread
+EMUCHDMANLDFLAGS += -lpthread
 ADVANCEOBJS += $(OBJ)/advance/osd/thdouble.o
 else
 ADVANCEOBJS += $(OBJ)/advance/osd/thmono.o
@@ -518,6 +522,7 @@ EMUCHDMANOBJS += \
 	$(OBJ)/chd.o \
 	$(OBJ)/cdrom.o \
 	$(OBJ)/chdcd.o \
+	$(OBJ)/fastcrc.o \
 	$(OBJ)/sha1.o \
 	$(OBJ)/md5.o \
 	$(OBJ)/version.o
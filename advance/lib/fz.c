@@ -33,6 +33,10 @@
 #include "fz.h"
 #include "endianrw.h"
 
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 /* Zip format */
 #define ZIP_LO_filename_length 0x1A
 #define ZIP_LO_extra_field_length 0x1C
@@ -386,6 +390,26 @@ static void compressed_init(adv_fz* f)
 	assert(err == Z_OK);
 }
 
+/**
+ * Restart the decompression from the begin, reusing the inflate state
+ * and the input buffer.
+ */
+static void compressed_reset(adv_fz* f)
+{
+	int err;
+
+	f->z.next_in = 0;
+	f->z.avail_in = 0;
+	f->z.next_out = 0;
+	f->z.avail_out = 0;
+
+	f->remaining = f->real_size;
+
+	err = inflateReset(&f->z);
+
+	assert(err == Z_OK);
+}
+
 static void compressed_done(adv_fz* f)
 {
 	inflateEnd(&f->z);
@@ -495,6 +519,76 @@ adv_error fzclose(adv_fz* f)
 	return 0;
 }
 
+/**
+ * Map in memory a read only view of a part of the file.
+ * Only real files, or parts of a real file, are supported.
+ * The view remains valid also after closing the file, and it must be released with fzunmap().
+ * Files writable by other users are not mapped, as truncating them while
+ * mapped raises SIGBUS. The owner of the file must replace it with a new
+ * one, and not rewrite it in place, while it's mapped.
+ * \param f File to map.
+ * \param offset Position of the data, like the one returned by fztell().
+ * \param size Size of the data.
+ * \return The pointer at the data, or 0 if the file cannot be mapped.
+ */
+const unsigned char* fzmap(adv_fz* f, off_t offset, unsigned size)
+{
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+	off_t real_offset;
+	off_t page_offset;
+	void* base;
+	struct stat st;
+
+	if (size == 0)
+		return 0;
+
+	if (f->type == fz_file) {
+		if (offset + size > fzsize(f))
+			return 0;
+		real_offset = offset;
+	} else if (f->type == fz_file_part) {
+		if (offset + size > f->virtual_size)
+			return 0;
+		real_offset = f->real_offset + offset;
+	} else {
+		return 0;
+	}
+
+	/* others can truncate the file, read it in memory */
+	if (fstat(fileno(f->f), &st) != 0 || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+		return 0;
+
+	/* the mapping must start at a page boundary */
+	page_offset = real_offset % sysconf(_SC_PAGESIZE);
+
+	base = mmap(0, size + page_offset, PROT_READ, MAP_PRIVATE, fileno(f->f), real_offset - page_offset);
+	if (base == MAP_FAILED)
+		return 0;
+
+#ifdef MADV_SEQUENTIAL
+	madvise(base, size + page_offset, MADV_SEQUENTIAL);
+#endif
+
+	return (unsigned char*)base + page_offset;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Release a view returned by fzmap().
+ * \param data Pointer returned by fzmap().
+ * \param size Size of the data.
+ */
+void fzunmap(const unsigned char* data, unsigned size)
+{
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+	off_t page_offset = (size_t)data % sysconf(_SC_PAGESIZE);
+
+	munmap((void*)(data - page_offset), size + page_offset);
+#endif
+}
+
 /**
  * Read a char from the file.
  * The semantic is like the C fgetc() function.
@@ -660,12 +754,11 @@ adv_error fzseek(adv_fz* f, off_t offset, int mode)
 			off_t offset;
 
 			if (pos < f->virtual_pos) {
-				/* if backward reopen the file */
+				/* if backward restart from the begin of the file */
 				int err;
-				compressed_done(f);
 				err = fseeko(f->f, f->real_offset, SEEK_SET);
 				f->virtual_pos = 0;
-				compressed_init(f);
+				compressed_reset(f);
 				if (err != 0)
 					return -1;
 			}
@@ -675,10 +768,10 @@ adv_error fzseek(adv_fz* f, off_t offset, int mode)
 
 			/* read all the data */
 			while (offset > 0) {
-				unsigned char buffer[256];
+				unsigned char buffer[4096];
 				off_t run = offset;
-				if (run > 256)
-					run = 256;
+				if (run > sizeof(buffer))
+					run = sizeof(buffer);
 				if (fzread(buffer, run, 1, f) != 1)
 					return -1;
 				offset -= run;
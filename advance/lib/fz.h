@@ -100,6 +100,8 @@ adv_error fzeof(adv_fz* f);
 adv_error le_uint8_fzread(adv_fz* f, unsigned* v);
 adv_error le_uint16_fzread(adv_fz* f, unsigned* v);
 adv_error le_uint32_fzread(adv_fz* f, unsigned* v);
+const unsigned char* fzmap(adv_fz* f, off_t offset, unsigned size);
+void fzunmap(const unsigned char* data, unsigned size);
 
 /*@}*/
 
@@ -33,6 +33,7 @@ MENUOBJS += \
 	$(MENUOBJ)/menu/text.o \
 	$(MENUOBJ)/menu/event.o \
 	$(MENUOBJ)/menu/color.o \
+	$(MENUOBJ)/menu/watch.o \
 	$(MENUOBJ)/lib/portable.o \
 	$(MENUOBJ)/lib/snstring.o \
 	$(MENUOBJ)/lib/log.o \
@@ -134,6 +135,10 @@ MENUOBJS += \
 	$(MENUOBJ)/linux/file.o \
 	$(MENUOBJ)/linux/target.o \
 	$(MENUOBJ)/linux/os.o
+ifeq ($(CONF_LIB_PTHREAD),yes)
+MENUCFLAGS += -D_REENTRANT -DUSE_SMP -DUSE_BLIT_THREAD
+MENULIBS += -lpthread
+endif
 ifeq ($(CONF_LIB_SVGALIB),yes)
 MENUCFLAGS += \
 	-DUSE_VIDEO_SVGALIB \
@@ -246,6 +246,69 @@ void emulator::scan_dirlist(const game_set& gar, const string& dirlist, bool qui
 	}
 }
 
+// Scan again the rom directories after a change of the rom files.
+// Only the games with a changed presence are updated in the game set.
+void emulator::rescan(game_set& gar)
+{
+	pgame_container game_bag;
+
+	for (game_set::const_iterator i = gar.begin(); i != gar.end(); ++i) {
+		if (i->emulator_get() == this && !i->software_get())
+			game_bag.insert(game_bag.end(), &*i);
+	}
+
+	vector<bool> present_bag;
+	present_bag.reserve(game_bag.size());
+	for (pgame_container::const_iterator i = game_bag.begin(); i != game_bag.end(); ++i) {
+		present_bag.push_back((*i)->present_get());
+		(*i)->rom_zip_set_erase();
+	}
+
+	scan_dirlist(gar, config_rom_path_get(), true);
+
+	pgame_container changed;
+	vector<bool>::const_iterator j = present_bag.begin();
+	for (pgame_container::const_iterator i = game_bag.begin(); i != game_bag.end(); ++i, ++j) {
+		if ((*i)->present_get() != *j)
+			changed.insert(changed.end(), *i);
+	}
+
+	log_std(("%s: rescan, %d games changed\n", user_name_get().c_str(), (unsigned)changed.size()));
+
+	gar.cache_present(changed);
+}
+
+// Update the games of the changed rom files, without reading the directories.
+// The paths are in the form used by scan_dir().
+void emulator::rescan_file(game_set& gar, const path_container& file_bag)
+{
+	pgame_container changed;
+
+	for (path_container::const_iterator i = file_bag.begin(); i != file_bag.end(); ++i) {
+		if (file_ext(*i) != ".zip")
+			continue;
+
+		game_set::const_iterator j = gar.find(game(user_name_get() + "/" + file_basename(file_file(*i))));
+		if (j == gar.end())
+			continue;
+
+		bool present = j->present_get();
+
+		j->rom_zip_set_remove(*i);
+		if (access(cpath_export(*i), F_OK) == 0) {
+			has_atleastarom = true;
+			j->rom_zip_set_insert(*i);
+		}
+
+		if (j->present_get() != present)
+			changed.insert(changed.end(), &*j);
+	}
+
+	log_std(("%s: rescan of %d files, %d games changed\n", user_name_get().c_str(), (unsigned)file_bag.size(), (unsigned)changed.size()));
+
+	gar.cache_present(changed);
+}
+
 void emulator::load_dir(game_set& gar, const string& dir, const string& filterlist, bool quiet)
 {
 	DIR* d = opendir(cpath_export(dir));
@@ -469,6 +532,17 @@ unsigned emulator::preview_set(game_set& gar) const
 	return preview;
 }
 
+// Assign again all the previews after a change of the preview directories.
+void emulator::preview_update(game_set& gar) const
+{
+	for (game_set::const_iterator i = gar.begin(); i != gar.end(); ++i) {
+		if (i->emulator_get() == this)
+			i->preview_clear();
+	}
+
+	preview_set(gar);
+}
+
 void emulator::update(const game& g) const
 {
 	// update always the preview
@@ -714,6 +788,11 @@ bool mame_info::update_xml()
 bool mame_info::load_game_xml(game_set& gar)
 {
 	string xml_file = path_abs(path_import(file_config_file_home((user_name_get() + ".xml").c_str())), dir_cwd());
+	string cache_file = path_abs(path_import(file_config_file_home((user_name_get() + ".xmc").c_str())), dir_cwd());
+
+	// use the binary copy of the information if it's still valid
+	if (load_xml_cache(cache_file, xml_file, gar))
+		return true;
 
 	ifstream f(cpath_export(xml_file), ios::in | ios::binary);
 	if (!f) {
@@ -728,6 +807,9 @@ bool mame_info::load_game_xml(game_set& gar)
 	}
 	f.close();
 
+	// it's only a speedup, errors are ignored
+	save_xml_cache(cache_file, xml_file, gar);
+
 	return true;
 }
 
@@ -2819,6 +2901,16 @@ bool generic::load_info(game_set& gar)
 	return true;
 }
 
+void generic::rescan(game_set& gar)
+{
+	// the games are the rom files, a change requires a new load
+}
+
+void generic::rescan_file(game_set& gar, const path_container& file_bag)
+{
+	// the games are the rom files, a change requires a new load
+}
+
 bool generic::load_game(game_set& gar, bool quiet)
 {
 	load_dirlist(gar, list_abs(list_import(user_rom_path), exe_dir_get()), list_import(user_rom_filter), quiet);
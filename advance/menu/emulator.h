@@ -164,6 +164,7 @@ public:
 	std::string config_title_path_get() const { return config_title_path; }
 
 	unsigned preview_set(game_set& gar) const;
+	void preview_update(game_set& gar) const;
 
 	virtual bool run(const game& g, const game* bios, unsigned orientation, bool set_difficulty, difficulty_t difficulty, bool set_attenuation, int attenuation, bool ignore_error) const;
 	virtual bool load_cfg(const game_set& gar, bool quiet) = 0;
@@ -171,6 +172,8 @@ public:
 	virtual bool load_game(game_set& gar, bool quiet) = 0;
 	virtual bool load_software(game_set& gar, bool quiet) = 0;
 	virtual void update(const game& g) const;
+	virtual void rescan(game_set& gar);
+	virtual void rescan_file(game_set& gar, const path_container& file_bag);
 
 	virtual bool is_present() const;
 	virtual bool is_runnable() const;
@@ -190,6 +193,8 @@ protected:
 	tristate_t exclude_vertical_orig;
 
 	bool load_xml(std::istream& is, game_set& gar);
+	bool load_xml_cache(const std::string& cache_file, const std::string& xml_file, game_set& gar);
+	bool save_xml_cache(const std::string& cache_file, const std::string& xml_file, const game_set& gar);
 	bool load_game_xml(game_set& gar);
 	bool update_xml();
 	bool is_update_xml();
@@ -395,6 +400,8 @@ public:
 	virtual bool load_data(const game_set& gar);
 	virtual bool load_game(game_set& gar, bool quiet);
 	virtual bool load_software(game_set& gar, bool quiet);
+	virtual void rescan(game_set& gar);
+	virtual void rescan_file(game_set& gar, const path_container& file_bag);
 
 	virtual std::string type_get() const;
 
@@ -29,6 +29,8 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <map>
 
 using namespace std;
 
@@ -593,3 +595,305 @@ bool mame_info::load_xml(istream& is, game_set& gar)
 	return true;
 }
 
+
+/****************************************************************************/
+/* Cache */
+
+/*
+ * Binary cache of the games read from the information file.
+ *
+ * All the numbers are 32 bits little endian. The file is:
+ *   header, game records, device records, extension records, string table
+ * All the strings are stored once in the string table, terminated by 0,
+ * and are referenced by their offset in the table. The game names are
+ * stored without the emulator name.
+ */
+
+#define CACHE_MAGIC "AdvGame\x1a"
+#define CACHE_VERSION 1
+#define CACHE_HEADER_SIZE 44 /**< Magic, version, 4 file stamps and 4 counts. */
+#define CACHE_GAME_FIELDS 15
+#define CACHE_DEVICE_FIELDS 3
+#define CACHE_EXT_FIELDS 1
+
+/**
+ * Flags set from the information file.
+ */
+#define CACHE_GAME_FLAGS (emulator::flag_derived_vector | emulator::flag_derived_vertical | emulator::flag_derived_resource)
+
+class cache_string_table {
+	map<string, unsigned> offset_map;
+	string data;
+public:
+	unsigned insert(const string& s)
+	{
+		map<string, unsigned>::const_iterator i = offset_map.find(s);
+		if (i != offset_map.end())
+			return i->second;
+		unsigned offset = data.length();
+		data.append(s.c_str(), s.length() + 1);
+		offset_map[s] = offset;
+		return offset;
+	}
+
+	const string& data_get() const { return data; }
+};
+
+static bool cache_stamp(const string& file, unsigned& size, unsigned& mtime)
+{
+	struct stat st;
+
+	if (stat(cpath_export(file), &st) != 0)
+		return false;
+
+	size = st.st_size;
+	mtime = st.st_mtime;
+
+	return true;
+}
+
+static void cache_put(vector<unsigned char>& buf, unsigned v)
+{
+	unsigned char p[4];
+	le_uint32_write(p, v);
+	buf.insert(buf.end(), p, p + 4);
+}
+
+static string cache_name_strip(const string& name, const string& prefix)
+{
+	if (name.compare(0, prefix.length(), prefix) == 0)
+		return name.substr(prefix.length());
+	return name;
+}
+
+bool mame_info::save_xml_cache(const string& cache_file, const string& xml_file, const game_set& gar)
+{
+	unsigned exe_size, exe_mtime, xml_size, xml_mtime;
+
+	if (!cache_stamp(config_exe_path_get(), exe_size, exe_mtime) || !cache_stamp(xml_file, xml_size, xml_mtime))
+		return false;
+
+	string prefix = user_name_get() + "/";
+	cache_string_table strings;
+	vector<unsigned char> game_buf;
+	vector<unsigned char> device_buf;
+	vector<unsigned char> ext_buf;
+	unsigned game_count = 0;
+	unsigned device_count = 0;
+	unsigned ext_count = 0;
+
+	for (game_set::const_iterator i = gar.begin(); i != gar.end(); ++i) {
+		if (i->emulator_get() != this)
+			continue;
+
+		unsigned flags = 0;
+		if (i->flag_get(emulator::flag_derived_vector))
+			flags |= emulator::flag_derived_vector;
+		if (i->flag_get(emulator::flag_derived_vertical))
+			flags |= emulator::flag_derived_vertical;
+		if (i->flag_get(emulator::flag_derived_resource))
+			flags |= emulator::flag_derived_resource;
+
+		cache_put(game_buf, strings.insert(cache_name_strip(i->name_get(), prefix)));
+		cache_put(game_buf, strings.insert(i->description_get()));
+		cache_put(game_buf, strings.insert(i->manufacturer_get()));
+		cache_put(game_buf, strings.insert(i->year_get()));
+		cache_put(game_buf, strings.insert(cache_name_strip(i->cloneof_get(), prefix)));
+		cache_put(game_buf, strings.insert(cache_name_strip(i->romof_get(), prefix)));
+		cache_put(game_buf, i->play_get());
+		cache_put(game_buf, flags);
+		cache_put(game_buf, i->size_get());
+		cache_put(game_buf, i->sizex_get());
+		cache_put(game_buf, i->sizey_get());
+		cache_put(game_buf, i->aspectx_get());
+		cache_put(game_buf, i->aspecty_get());
+		cache_put(game_buf, device_count);
+		cache_put(game_buf, i->machinedevice_bag_get().size());
+		++game_count;
+
+		for (machinedevice_container::const_iterator j = i->machinedevice_bag_get().begin(); j != i->machinedevice_bag_get().end(); ++j) {
+			cache_put(device_buf, strings.insert(j->name));
+			cache_put(device_buf, ext_count);
+			cache_put(device_buf, j->ext_bag.size());
+			++device_count;
+
+			for (machinedevice_ext_container::const_iterator k = j->ext_bag.begin(); k != j->ext_bag.end(); ++k) {
+				cache_put(ext_buf, strings.insert(*k));
+				++ext_count;
+			}
+		}
+	}
+
+	vector<unsigned char> buf(CACHE_MAGIC, CACHE_MAGIC + 8);
+	cache_put(buf, CACHE_VERSION);
+	cache_put(buf, exe_size);
+	cache_put(buf, exe_mtime);
+	cache_put(buf, xml_size);
+	cache_put(buf, xml_mtime);
+	cache_put(buf, game_count);
+	cache_put(buf, device_count);
+	cache_put(buf, ext_count);
+	cache_put(buf, strings.data_get().length());
+
+	FILE* f = fopen(cpath_export(cache_file), "wb");
+	if (!f) {
+		log_std(("menu: error creating the cache '%s'\n", cpath_export(cache_file)));
+		return false;
+	}
+
+	bool ok = fwrite(&buf[0], buf.size(), 1, f) == 1;
+	if (ok && game_buf.size())
+		ok = fwrite(&game_buf[0], game_buf.size(), 1, f) == 1;
+	if (ok && device_buf.size())
+		ok = fwrite(&device_buf[0], device_buf.size(), 1, f) == 1;
+	if (ok && ext_buf.size())
+		ok = fwrite(&ext_buf[0], ext_buf.size(), 1, f) == 1;
+	if (ok && strings.data_get().length())
+		ok = fwrite(strings.data_get().data(), strings.data_get().length(), 1, f) == 1;
+	if (fclose(f) != 0)
+		ok = false;
+
+	if (!ok) {
+		log_std(("menu: error writing the cache '%s'\n", cpath_export(cache_file)));
+		remove(cpath_export(cache_file));
+		return false;
+	}
+
+	log_std(("menu: saved %d games in the cache '%s'\n", game_count, cpath_export(cache_file)));
+
+	return true;
+}
+
+bool mame_info::load_xml_cache(const string& cache_file, const string& xml_file, game_set& gar)
+{
+	unsigned exe_size, exe_mtime, xml_size, xml_mtime;
+
+	if (!cache_stamp(config_exe_path_get(), exe_size, exe_mtime) || !cache_stamp(xml_file, xml_size, xml_mtime))
+		return false;
+
+	// read the whole file at once
+	FILE* f = fopen(cpath_export(cache_file), "rb");
+	if (!f)
+		return false;
+
+	vector<unsigned char> buf;
+	bool ok = fseek(f, 0, SEEK_END) == 0;
+	long file_size = ok ? ftell(f) : -1;
+	if (file_size >= CACHE_HEADER_SIZE && fseek(f, 0, SEEK_SET) == 0) {
+		buf.resize(file_size);
+		ok = fread(&buf[0], file_size, 1, f) == 1;
+	} else {
+		ok = false;
+	}
+	fclose(f);
+
+	if (!ok)
+		return false;
+
+	const unsigned char* p = &buf[0];
+
+	// check that the information file is the same
+	if (memcmp(p, CACHE_MAGIC, 8) != 0
+		|| le_uint32_read(p + 8) != CACHE_VERSION
+		|| le_uint32_read(p + 12) != exe_size
+		|| le_uint32_read(p + 16) != exe_mtime
+		|| le_uint32_read(p + 20) != xml_size
+		|| le_uint32_read(p + 24) != xml_mtime) {
+		log_std(("menu: outdated cache '%s'\n", cpath_export(cache_file)));
+		return false;
+	}
+
+	unsigned game_count = le_uint32_read(p + 28);
+	unsigned device_count = le_uint32_read(p + 32);
+	unsigned ext_count = le_uint32_read(p + 36);
+	unsigned string_size = le_uint32_read(p + 40);
+
+	// check the size of every section, taking care of overflows
+	double expected_size = CACHE_HEADER_SIZE
+		+ 4.0 * CACHE_GAME_FIELDS * game_count
+		+ 4.0 * CACHE_DEVICE_FIELDS * device_count
+		+ 4.0 * CACHE_EXT_FIELDS * ext_count
+		+ string_size;
+	if (expected_size != file_size || string_size == 0)
+		return false;
+
+	const unsigned char* game_ptr = p + CACHE_HEADER_SIZE;
+	const unsigned char* device_ptr = game_ptr + 4 * CACHE_GAME_FIELDS * game_count;
+	const unsigned char* ext_ptr = device_ptr + 4 * CACHE_DEVICE_FIELDS * device_count;
+	const char* string_ptr = (const char*)(ext_ptr + 4 * CACHE_EXT_FIELDS * ext_count);
+
+	if (string_ptr[string_size - 1] != 0)
+		return false;
+
+	// check all the references before changing the game set
+	for (unsigned i = 0; i < game_count; ++i) {
+		const unsigned char* g = game_ptr + 4 * CACHE_GAME_FIELDS * i;
+		for (unsigned j = 0; j < 6; ++j)
+			if (le_uint32_read(g + 4 * j) >= string_size)
+				return false;
+		if (le_uint32_read(g + 24) > play_preliminary)
+			return false;
+		if (le_uint32_read(g + 52) > device_count || le_uint32_read(g + 56) > device_count - le_uint32_read(g + 52))
+			return false;
+	}
+	for (unsigned i = 0; i < device_count; ++i) {
+		const unsigned char* d = device_ptr + 4 * CACHE_DEVICE_FIELDS * i;
+		if (le_uint32_read(d) >= string_size)
+			return false;
+		if (le_uint32_read(d + 4) > ext_count || le_uint32_read(d + 8) > ext_count - le_uint32_read(d + 4))
+			return false;
+	}
+	for (unsigned i = 0; i < ext_count; ++i) {
+		if (le_uint32_read(ext_ptr + 4 * i) >= string_size)
+			return false;
+	}
+
+	string prefix = user_name_get() + "/";
+
+	for (unsigned i = 0; i < game_count; ++i) {
+		const unsigned char* g = game_ptr + 4 * CACHE_GAME_FIELDS * i;
+		const char* cloneof = string_ptr + le_uint32_read(g + 16);
+		const char* romof = string_ptr + le_uint32_read(g + 20);
+		game h;
+
+		h.emulator_set(this);
+		h.name_set(prefix + (string_ptr + le_uint32_read(g)));
+		h.auto_description_set(string_ptr + le_uint32_read(g + 4));
+		h.manufacturer_stripped_set(string_ptr + le_uint32_read(g + 8));
+		h.year_set(string_ptr + le_uint32_read(g + 12));
+		if (*cloneof)
+			h.cloneof_set(prefix + cloneof);
+		if (*romof)
+			h.romof_set(prefix + romof);
+		h.play_set((play_t)le_uint32_read(g + 24));
+		h.flag_set(true, le_uint32_read(g + 28) & CACHE_GAME_FLAGS);
+		h.size_set(le_uint32_read(g + 32));
+		h.sizex_set(le_uint32_read(g + 36));
+		h.sizey_set(le_uint32_read(g + 40));
+		h.aspectx_set(le_uint32_read(g + 44));
+		h.aspecty_set(le_uint32_read(g + 48));
+
+		unsigned device_first = le_uint32_read(g + 52);
+		unsigned device_mac = le_uint32_read(g + 56);
+		for (unsigned j = device_first; j < device_first + device_mac; ++j) {
+			const unsigned char* d = device_ptr + 4 * CACHE_DEVICE_FIELDS * j;
+			machinedevice m;
+
+			m.name = string_ptr + le_uint32_read(d);
+
+			unsigned ext_first = le_uint32_read(d + 4);
+			unsigned ext_mac = le_uint32_read(d + 8);
+			for (unsigned k = ext_first; k < ext_first + ext_mac; ++k)
+				m.ext_bag.insert(m.ext_bag.end(), string(string_ptr + le_uint32_read(ext_ptr + 4 * k)));
+
+			h.machinedevice_bag_get().insert(h.machinedevice_bag_get().end(), m);
+		}
+
+		// the games are saved in order, so they always go at the end
+		gar.insert(gar.end(), h);
+	}
+
+	log_std(("menu: loaded %d games from the cache '%s'\n", game_count, cpath_export(cache_file)));
+
+	return true;
+}
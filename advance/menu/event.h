@@ -66,6 +66,7 @@
 #define EVENT_VOLUME (39 << 16)
 #define EVENT_DIFFICULTY (40 << 16)
 #define EVENT_UNASSIGNED (41 << 16)
+#define EVENT_RESCAN (42 << 16)
 
 bool event_in(const std::string& s);
 void event_out(adv_conf* config_context, const char* tag);
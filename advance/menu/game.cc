@@ -29,9 +29,300 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
 
 using namespace std;
 
+// ------------------------------------------------------------------------
+// preview index
+
+// Content of all the preview directories read, by directory name
+static map<string, preview_index> preview_index_map;
+
+// If the content of some directory was read again
+static bool preview_index_changed;
+
+static bool preview_stamp(const string& file, unsigned& size, unsigned& mtime)
+{
+	struct stat st;
+
+	if (stat(cpath_export(slash_remove(file)), &st) != 0)
+		return false;
+
+	size = st.st_size;
+	mtime = st.st_mtime;
+
+	return true;
+}
+
+// Check if the directory and its zips are unchanged since the scan.
+// A change in the same second of the scan may be undetected, so in this
+// case the content is never trusted.
+bool preview_index::is_valid() const
+{
+	unsigned size;
+	unsigned now;
+
+	if (!preview_stamp(dir, size, now))
+		return false;
+	if (now != mtime || mtime >= scan)
+		return false;
+
+	for (vector<preview_zip>::const_iterator i = zip_bag.begin(); i != zip_bag.end(); ++i) {
+		unsigned zip_size;
+		unsigned zip_mtime;
+		if (!preview_stamp(slash_add(dir) + i->file, zip_size, zip_mtime))
+			return false;
+		if (zip_size != i->size || zip_mtime != i->mtime || zip_mtime >= scan)
+			return false;
+	}
+
+	return true;
+}
+
+resource preview_index::res_get(const preview_entry& entry) const
+{
+	if (entry.zip == PREVIEW_ZIP_NONE)
+		return resource(slash_add(dir) + entry.file);
+
+	string zipfile = slash_add(slash_add(dir) + zip_bag[entry.zip].file) + entry.file;
+	if (entry.method == 0x0)
+		return resource(zipfile, entry.offset, entry.size_uncompressed, true);
+	else
+		return resource(zipfile, entry.offset, entry.size_compressed, entry.size_uncompressed, true);
+}
+
+void preview_index::insert(const preview_entry& entry)
+{
+	name_map[entry.name].push_back(entry_bag.size());
+	entry_bag.push_back(entry);
+}
+
+void preview_index::insert(const string& file, unsigned zip, unsigned method, off_t offset, unsigned size_compressed, unsigned size_uncompressed)
+{
+	preview_entry entry;
+
+	entry.file = file;
+	entry.name = file_basename(file);
+	entry.ext = file_ext(file);
+	entry.zip = zip;
+	entry.method = method;
+	entry.offset = offset;
+	entry.size_compressed = size_compressed;
+	entry.size_uncompressed = size_uncompressed;
+
+	if (entry.ext.length())
+		insert(entry);
+}
+
+void preview_index::read_zip(const string& file)
+{
+	string zip = slash_add(dir) + file;
+
+	preview_zip z;
+	z.file = file;
+	if (!preview_stamp(zip, z.size, z.mtime))
+		return;
+
+	adv_zip* d = zip_open(cpath_export(slash_remove(zip)));
+	if (!d) {
+		log_std(("menu:game: failed opening %s\n", cpath_export(zip)));
+		return;
+	}
+
+	unsigned index = zip_bag.size();
+	zip_bag.push_back(z);
+
+	adv_zipent* dd;
+	while ((dd = zip_read(d)) != 0) {
+		if (dd->compression_method == 0x0 || dd->compression_method == 0x8)
+			insert(file_file(dd->name), index, dd->compression_method, dd->offset_lcl_hdr_frm_frst_disk, dd->compressed_size, dd->uncompressed_size);
+	}
+
+	zip_close(d);
+}
+
+// Read the content of the directory and of its zips
+bool preview_index::read(const string& Adir)
+{
+	unsigned size;
+
+	dir = Adir;
+	zip_bag.clear();
+	entry_bag.clear();
+	name_map.clear();
+
+	scan = time(0);
+	if (!preview_stamp(dir, size, mtime)) {
+		log_std(("menu:game: failed opening %s\n", cpath_export(dir)));
+		return false;
+	}
+
+	DIR* d = opendir(cpath_export(slash_remove(dir)));
+	if (!d) {
+		log_std(("menu:game: failed opening %s\n", cpath_export(dir)));
+		return false;
+	}
+
+	struct dirent* dd;
+	while ((dd = readdir(d)) != 0) {
+		string file = file_import(dd->d_name);
+		if (file == "." || file == "..")
+			continue;
+		if (file_ext(file) == ".zip")
+			read_zip(file);
+		else
+			insert(file, PREVIEW_ZIP_NONE, 0, 0, 0, 0);
+	}
+
+	closedir(d);
+
+	log_std(("menu:game: read %d previews in %s\n", (unsigned)entry_bag.size(), cpath_export(dir)));
+
+	return true;
+}
+
+// Get the content of a directory, reading it only if changed
+const preview_index* preview_index_get(const string& dir)
+{
+	map<string, preview_index>::iterator i = preview_index_map.find(dir);
+	if (i != preview_index_map.end() && i->second.is_valid())
+		return &i->second;
+
+	preview_index_changed = true;
+
+	preview_index& index = preview_index_map[dir];
+	if (!index.read(dir)) {
+		preview_index_map.erase(dir);
+		return 0;
+	}
+
+	return &index;
+}
+
+// Forget the content of a directory, it's read again at the next use
+void preview_index_erase(const string& dir)
+{
+	if (preview_index_map.erase(dir) != 0)
+		preview_index_changed = true;
+}
+
+/*
+ * Text file with the content of the preview directories. Every line has
+ * the fields separated by tabs:
+ *   D mtime scan dir - A directory, followed by its zips and entries.
+ *   Z size mtime zip - A zip in the directory.
+ *   E zip method offset size_compressed size_uncompressed file - An entry.
+ * The zip of a plain file entry is PREVIEW_ZIP_NONE.
+ */
+#define PREVIEW_INDEX_HEADER "advmenu preview index 1"
+
+void preview_index_load(const string& file)
+{
+	ifstream f(cpath_export(file), ios::in | ios::binary);
+	if (!f)
+		return;
+
+	string line;
+	if (!getline(f, line) || line != PREVIEW_INDEX_HEADER) {
+		log_std(("menu:game: ignoring the preview index '%s'\n", cpath_export(file)));
+		return;
+	}
+
+	preview_index* index = 0;
+	while (getline(f, line)) {
+		int ptr = 0;
+		string tag = token_get(line, ptr, '\t');
+		token_skip(line, ptr, '\t');
+
+		if (tag == "D") {
+			string mtime = token_get(line, ptr, '\t');
+			token_skip(line, ptr, '\t');
+			string scan = token_get(line, ptr, '\t');
+			token_skip(line, ptr, '\t');
+			string dir = line.substr(ptr);
+
+			index = &preview_index_map[dir];
+			index->dir = dir;
+			index->mtime = strtoul(mtime.c_str(), 0, 10);
+			index->scan = strtoul(scan.c_str(), 0, 10);
+		} else if (tag == "Z" && index) {
+			preview_zip z;
+			z.size = strtoul(token_get(line, ptr, '\t').c_str(), 0, 10);
+			token_skip(line, ptr, '\t');
+			z.mtime = strtoul(token_get(line, ptr, '\t').c_str(), 0, 10);
+			token_skip(line, ptr, '\t');
+			z.file = line.substr(ptr);
+			index->zip_bag.push_back(z);
+		} else if (tag == "E" && index) {
+			unsigned field[5];
+			for (unsigned i = 0; i < 5; ++i) {
+				field[i] = strtoul(token_get(line, ptr, '\t').c_str(), 0, 10);
+				token_skip(line, ptr, '\t');
+			}
+			if (field[0] != PREVIEW_ZIP_NONE && field[0] >= index->zip_bag.size())
+				continue;
+			index->insert(line.substr(ptr), field[0], field[1], field[2], field[3], field[4]);
+		}
+	}
+
+	preview_index_changed = false;
+
+	log_std(("menu:game: loaded %d preview dirs from '%s'\n", (unsigned)preview_index_map.size(), cpath_export(file)));
+}
+
+void preview_index_save(const string& file)
+{
+	if (!preview_index_changed)
+		return;
+
+	ofstream f(cpath_export(file), ios::out | ios::binary);
+	if (!f) {
+		log_std(("menu:game: error creating the preview index '%s'\n", cpath_export(file)));
+		return;
+	}
+
+	f << PREVIEW_INDEX_HEADER << "\n";
+
+	for (map<string, preview_index>::const_iterator i = preview_index_map.begin(); i != preview_index_map.end(); ++i) {
+		const preview_index& index = i->second;
+
+		f << "D\t" << index.mtime << "\t" << index.scan << "\t" << index.dir << "\n";
+		for (vector<preview_zip>::const_iterator j = index.zip_bag.begin(); j != index.zip_bag.end(); ++j)
+			f << "Z\t" << j->size << "\t" << j->mtime << "\t" << j->file << "\n";
+		for (vector<preview_entry>::const_iterator j = index.entry_bag.begin(); j != index.entry_bag.end(); ++j)
+			f << "E\t" << j->zip << "\t" << j->method << "\t" << (unsigned)j->offset << "\t" << j->size_compressed << "\t" << j->size_uncompressed << "\t" << j->file << "\n";
+	}
+
+	f.close();
+	if (!f) {
+		log_std(("menu:game: error writing the preview index '%s'\n", cpath_export(file)));
+		remove(cpath_export(file));
+		return;
+	}
+
+	preview_index_changed = false;
+}
+
+// ------------------------------------------------------------------------
+// sort key
+
+void sort_key::set(const string& s)
+{
+	key.resize(s.length());
+	for (unsigned i = 0; i < s.length(); ++i)
+		key[i] = (char)toupper(s[i]) ^ 0x80;
+
+	prefix = 0;
+	for (unsigned i = 0; i < sizeof(prefix); ++i) {
+		prefix <<= 8;
+		if (i < key.length())
+			prefix |= (unsigned char)key[i];
+	}
+}
+
 // ------------------------------------------------------------------------
 // game
 
@@ -49,6 +340,7 @@ game::game()
 	type = 0;
 	group = 0;
 	parent = 0;
+	romof_parent = 0;
 	emu = 0;
 	session = 0;
 }
@@ -67,6 +359,7 @@ game::game(const string& Aname) : name(Aname)
 	type = 0;
 	group = 0;
 	parent = 0;
+	romof_parent = 0;
 	emu = 0;
 	session = 0;
 }
@@ -75,8 +368,8 @@ game::game(const game& A) :
 	flag(A.flag),
 	play(A.play), play_best(A.play_best),
 	name(A.name), romof(A.romof), cloneof(A.cloneof),
-	description(A.description), info(A.info), year(A.year),
-	manufacturer(A.manufacturer), software_path(A.software_path),
+	description(A.description), description_key(A.description_key), info(A.info), year(A.year),
+	manufacturer(A.manufacturer), manufacturer_key(A.manufacturer_key), software_path(A.software_path),
 	sizex(A.sizex), sizey(A.sizey),
 	aspectx(A.aspectx), aspecty(A.aspecty),
 	group(A.group), type(A.type), time(A.time),
@@ -85,6 +378,8 @@ game::game(const game& A) :
 	rzs(A.rzs),
 	clone_bag(A.clone_bag),
 	parent(A.parent),
+	romof_bag(A.romof_bag),
+	romof_parent(A.romof_parent),
 	machinedevice_bag(A.machinedevice_bag),
 	snap_path(A.snap_path), clip_path(A.clip_path), flyer_path(A.flyer_path), cabinet_path(A.cabinet_path),
 	sound_path(A.sound_path), icon_path(A.icon_path), marquee_path(A.marquee_path),
@@ -105,6 +400,7 @@ void game::auto_description_set(const std::string& A) const
 {
 	if (!is_user_description_set()) {
 		description = A;
+		description_key.set(A);
 	}
 }
 
@@ -146,6 +442,20 @@ void game::manufacturer_set(const std::string& s)
 			++i;
 		}
 	}
+
+	manufacturer_key.set(manufacturer);
+}
+
+void game::preview_clear() const
+{
+	snap_path = resource();
+	clip_path = resource();
+	flyer_path = resource();
+	cabinet_path = resource();
+	sound_path = resource();
+	icon_path = resource();
+	marquee_path = resource();
+	title_path = resource();
 }
 
 void game::rom_zip_set_insert(const string& Afile) const
@@ -257,68 +567,25 @@ const game& game::root_get() const
 	return *root;
 }
 
-bool game::preview_zip_set(const string& zip, void (game::*preview_set)(const resource& s) const, const string& ext0, const string& ext1) const
-{
-	adv_zip* d = zip_open(cpath_export(slash_remove(zip)));
-	if (!d) {
-		log_std(("menu:game: failed opening %s\n", cpath_export(zip)));
-		return false;
-	}
-
-	string game_name = name_without_emulator_get();
-
-	adv_zipent* dd;
-	while ((dd = zip_read(d)) != 0) {
-		string file = file_file(dd->name);
-		string ext = file_ext(file);
-		string name = file_basename(file);
-		if (name == game_name && ext.length() && (ext == ext0 || ext == ext1)) {
-			string zipfile = slash_add(zip) + file;
-			off_t offset = dd->offset_lcl_hdr_frm_frst_disk;
-			if (dd->compression_method == 0x0) {
-				((*this).*preview_set)(resource(zipfile, offset, dd->uncompressed_size, true));
-				zip_close(d);
-				return true;
-			} else if (dd->compression_method == 0x8) {
-				((*this).*preview_set)(resource(zipfile, offset, dd->compressed_size, dd->uncompressed_size, true));
-				zip_close(d);
-				return true;
-			}
-		}
-	}
-
-	zip_close(d);
-	return false;
-}
-
 bool game::preview_dir_set(const string& dir, void (game::*preview_set)(const resource& s) const, const string& ext0, const string& ext1) const
 {
-	DIR* d = opendir(cpath_export(slash_remove(dir)));
-	if (!d) {
-		log_std(("menu:game: failed opening %s\n", cpath_export(dir)));
+	const preview_index* index = preview_index_get(dir);
+	if (!index)
 		return false;
-	}
 
-	string game_name = name_without_emulator_get();
+	map<string, vector<unsigned> >::const_iterator i = index->name_map.find(name_without_emulator_get());
+	if (i == index->name_map.end())
+		return false;
 
-	struct dirent* dd;
-	while ((dd = readdir(d)) != 0) {
-		string file = file_import(dd->d_name);
-		string ext = file_ext(file);
-		string name = file_basename(file);
-		if (name == game_name && ext.length() && (ext == ext0 || ext == ext1)) {
-			((*this).*preview_set)(slash_add(dir) + file);
-			closedir(d);
+	// the first in the directory order
+	for (vector<unsigned>::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
+		const preview_entry& entry = index->entry_bag[*j];
+		if (entry.ext == ext0 || entry.ext == ext1) {
+			((*this).*preview_set)(index->res_get(entry));
 			return true;
-		} else if (ext == ".zip") {
-			if (preview_zip_set(slash_add(dir) + file, preview_set, ext0, ext1)) {
-				closedir(d);
-				return true;
-			}
 		}
 	}
 
-	closedir(d);
 	return false;
 }
 
@@ -397,64 +664,79 @@ bool game::preview_find(resource& path, const resource& (game::*preview_get)() c
 // ------------------------------------------------------------------------
 // game_set
 
+// Check if the game is in a circular chain of references.
+// The chain is followed at most for limit games, because it may reach
+// a circular chain not containing the game.
+static bool is_circular(const game* g, const game* (game::*next_get)() const, unsigned limit)
+{
+	const game* j = (g->*next_get)();
+	while (j != 0 && limit > 0) {
+		if (j == g)
+			return true;
+		j = (j->*next_get)();
+		--limit;
+	}
+	return false;
+}
+
 void game_set::cache(merge_t merge)
 {
 	dupe_set dar;
 
+	cache_merge = merge;
+
+	// resolve the cloneof and romof names only once
 	for (iterator i = begin(); i != end(); ++i) {
-		// erase the clone list
 		i->clone_bag_erase();
+		i->romof_bag_erase();
+		i->parent_set(0);
+		i->romof_parent_set(0);
 
-		// test cloneof and compute the parent
 		if (i->cloneof_get().length() != 0) {
 			iterator j = find(game(i->cloneof_get()));
 			if (j == end()) {
 				target_err("Missing definition of cloneof '%s' for game '%s'.\n", i->cloneof_get().c_str(), i->name_get().c_str());
 				(const_cast<game*>((&*i)))->cloneof_set(string());
-				i->parent_set(0);
 			} else {
 				i->parent_set(&*j);
-
-				while (j != end()) {
-					if (&*j == &*i) {
-						target_err("Circular cloneof reference for game '%s'.\n", i->name_get().c_str());
-						(const_cast<game*>((&*i)))->cloneof_set(string());
-						i->parent_set(0);
-						break;
-					}
-					j = find(j->cloneof_get());
-				}
 			}
-		} else {
-			i->parent_set(0);
 		}
 
-		// test romof
 		if (i->romof_get().length() != 0) {
-			game_set::const_iterator j = find(i->romof_get());
+			iterator j = find(game(i->romof_get()));
 			if (j == end()) {
 				target_err("Missing definition of romof '%s' for game '%s'.\n", i->romof_get().c_str(), i->name_get().c_str());
 				(const_cast<game*>((&*i)))->romof_set(string());
 			} else {
-				while (j != end()) {
-					if (&*j == &*i) {
-						target_err("Circular romof reference for game '%s'.\n", i->name_get().c_str());
-						(const_cast<game*>((&*i)))->romof_set(string());
-						break;
-					}
-					j = find(j->romof_get());
-				}
+				i->romof_parent_set(&*j);
 			}
 		}
 	}
 
-	// compute the clone list for every game
+	// break the circular references
+	for (iterator i = begin(); i != end(); ++i) {
+		if (is_circular(&*i, &game::parent_get, size())) {
+			target_err("Circular cloneof reference for game '%s'.\n", i->name_get().c_str());
+			(const_cast<game*>((&*i)))->cloneof_set(string());
+			i->parent_set(0);
+		}
+		if (is_circular(&*i, &game::romof_parent_get, size())) {
+			target_err("Circular romof reference for game '%s'.\n", i->name_get().c_str());
+			(const_cast<game*>((&*i)))->romof_set(string());
+			i->romof_parent_set(0);
+		}
+	}
+
+	// compute the clone list and the romof list for every game
 	for (iterator i = begin(); i != end(); ++i) {
 		const game* j = i->parent_get();
 		while (j != 0) {
 			j->clone_bag_get().insert(j->clone_bag_get().end(), &*i);
 			j = j->parent_get();
 		}
+
+		if (i->romof_parent_get())
+			i->romof_parent_get()->romof_bag_get().insert(i->romof_parent_get()->romof_bag_get().end(), &*i);
 	}
 
 	// compute the derived play_best
@@ -464,7 +746,7 @@ void game_set::cache(merge_t merge)
 
 	// compute the derived tree_present
 	for (iterator i = begin(); i != end(); ++i) {
-		bool present = is_tree_rom_of_present(i->name_get(), merge);
+		bool present = is_tree_rom_of_present(*i, merge);
 		i->flag_set(present, game::flag_tree_present);
 	}
 
@@ -492,6 +774,57 @@ void game_set::cache(merge_t merge)
 	}
 }
 
+// Update the derived tree_present after a change of the rom files of some
+// games. Only the games using the rom files of the changed ones, following
+// the romof and cloneof lists computed by cache(), are checked.
+void game_set::cache_present(const pgame_container& changed)
+{
+	set<const game*> done;
+	pgame_container todo(changed);
+
+	while (!todo.empty()) {
+		const game* g = todo.front();
+		todo.pop_front();
+
+		if (!done.insert(g).second)
+			continue;
+
+		g->flag_set(is_tree_rom_of_present(*g, cache_merge), game::flag_tree_present);
+
+		todo.insert(todo.end(), g->romof_bag_get().begin(), g->romof_bag_get().end());
+		todo.insert(todo.end(), g->clone_bag_get().begin(), g->clone_bag_get().end());
+	}
+}
+
+// Like is_tree_rom_of_present(name, type), but following the romof and
+// cloneof references resolved by cache()
+bool game_set::is_tree_rom_of_present(const game& g, merge_t type) const
+{
+	switch (type) {
+	case merge_differential:
+		for (const game* i = &g; i != 0; i = i->romof_parent_get()) {
+			if (!i->present_get())
+				return false;
+			if (i->romof_parent_get() == 0)
+				return true;
+		}
+		return false;
+	case merge_any:
+		for (const game* i = &g; i != 0; i = i->romof_parent_get()) {
+			if (i->present_get())
+				return true;
+		}
+		return false;
+	case merge_no:
+		return g.present_get();
+	case merge_parent:
+		return g.root_get().present_get();
+	case merge_disable:
+		return true;
+	}
+	return false;
+}
+
 bool game_set::is_tree_rom_of_present(const string& name, merge_t type) const
 {
 	switch (type) {
@@ -596,67 +929,23 @@ bool game_set::is_game_rom_of(const string& name_son, const string& name_parent)
 	return false;
 }
 
-bool game_set::preview_zip_set(const string& zip, const string& emulator_name, void (game::*preview_set)(const resource& s) const, const string& ext0, const string& ext1)
-{
-	bool almost_one = false;
-	adv_zip* d = zip_open(cpath_export(slash_remove(zip)));
-	if (!d) {
-		log_std(("menu:game: failed opening %s\n", cpath_export(zip)));
-		return almost_one;
-	}
-
-	adv_zipent* dd;
-	while ((dd = zip_read(d)) != 0) {
-		string file = file_file(dd->name);
-		string ext = file_ext(file);
-		if (ext.length() && (ext == ext0 || ext == ext1)) {
-			string name = emulator_name + "/" + file_basename(file);
-			const_iterator j = find(name);
-			if (j != end()) {
-				string zipfile = slash_add(zip) + file;
-				off_t offset = dd->offset_lcl_hdr_frm_frst_disk;
-				if (dd->compression_method == 0x0) {
-					((*j).*preview_set)(resource(zipfile, offset, dd->uncompressed_size, true));
-					almost_one = true;
-				} else if (dd->compression_method == 0x8) {
-					((*j).*preview_set)(resource(zipfile, offset, dd->compressed_size, dd->uncompressed_size, true));
-					almost_one = true;
-				}
-			}
-		}
-	}
-
-	zip_close(d);
-	return almost_one;
-}
-
 bool game_set::preview_dir_set(const string& dir, const string& emulator_name, void (game::*preview_set)(const resource& s) const, const string& ext0, const string& ext1)
 {
 	bool almost_one = false;
-	DIR* d = opendir(cpath_export(slash_remove(dir)));
-	if (!d) {
-		log_std(("menu:game: failed opening %s\n", cpath_export(dir)));
+	const preview_index* index = preview_index_get(dir);
+	if (!index)
 		return almost_one;
-	}
 
-	struct dirent* dd;
-	while ((dd = readdir(d)) != 0) {
-		string file = file_import(dd->d_name);
-		string ext = file_ext(file);
-		if (ext.length() && (ext == ext0 || ext == ext1)) {
-			string name = emulator_name + "/" + file_basename(file);
-			const_iterator j = find(name);
+	for (vector<preview_entry>::const_iterator i = index->entry_bag.begin(); i != index->entry_bag.end(); ++i) {
+		if (i->ext == ext0 || i->ext == ext1) {
+			const_iterator j = find(emulator_name + "/" + i->name);
 			if (j != end()) {
-				((*j).*preview_set)(slash_add(dir) + file);
+				((*j).*preview_set)(index->res_get(*i));
 				almost_one = true;
 			}
-		} else if (ext == ".zip") {
-			if (preview_zip_set(slash_add(dir) + file, emulator_name, preview_set, ext0, ext1))
-				almost_one = true;
 		}
 	}
 
-	closedir(d);
 	return almost_one;
 }
 
@@ -30,6 +30,7 @@ class category;
 #include <set>
 #include <list>
 #include <vector>
+#include <map>
 #include <string>
 
 #include <stdio.h>
@@ -63,6 +64,76 @@ struct machinedevice {
 
 typedef std::list<machinedevice> machinedevice_container;
 
+// ------------------------------------------------------------------------
+// Preview index
+
+#define PREVIEW_ZIP_NONE 0xFFFFFFFF ///< Entry not in a zip.
+
+struct preview_zip {
+	std::string file; ///< Name of the zip in the directory.
+	unsigned size; ///< Size of the zip when read.
+	unsigned mtime; ///< Modification time of the zip when read.
+};
+
+struct preview_entry {
+	std::string file; ///< Name of the file, in the directory or in the zip.
+	std::string name; ///< Name without the extension.
+	std::string ext; ///< Extension.
+	unsigned zip; ///< Index of the zip containing it, or PREVIEW_ZIP_NONE.
+	unsigned method; ///< Compression method in the zip.
+	off_t offset; ///< Offset in the zip.
+	unsigned size_compressed;
+	unsigned size_uncompressed;
+};
+
+// Content of a preview directory, including the content of its zips.
+// It's read once and used by all the games and all the preview types.
+class preview_index {
+	void read_zip(const std::string& file);
+	void insert(const preview_entry& entry);
+public:
+	std::string dir;
+	unsigned mtime; ///< Modification time of the directory when read.
+	unsigned scan; ///< Time of the read.
+	std::vector<preview_zip> zip_bag;
+	std::vector<preview_entry> entry_bag; ///< Entries in the directory order.
+	std::map<std::string, std::vector<unsigned> > name_map; ///< Entries by name, in the directory order.
+
+	bool read(const std::string& Adir);
+	bool is_valid() const;
+	void insert(const std::string& file, unsigned zip, unsigned method, off_t offset, unsigned size_compressed, unsigned size_uncompressed);
+	resource res_get(const preview_entry& entry) const;
+};
+
+const preview_index* preview_index_get(const std::string& dir);
+void preview_index_erase(const std::string& dir);
+void preview_index_load(const std::string& file);
+void preview_index_save(const std::string& file);
+
+// ------------------------------------------------------------------------
+// Sort key
+
+// Precomputed key of a string for a case insensitive compare with the same
+// order of case_less(). The characters are converted to upper case and
+// adjusted to compare as signed char with memcmp(). The first bytes are
+// also packed in an integer to resolve most of the compares with a single
+// test.
+class sort_key {
+	unsigned long long prefix; ///< First bytes of the key, big endian.
+	std::string key; ///< Whole key.
+public:
+	sort_key() : prefix(0) { }
+
+	void set(const std::string& s);
+
+	bool operator<(const sort_key& A) const
+	{
+		if (prefix != A.prefix)
+			return prefix < A.prefix;
+		return key < A.key;
+	}
+};
+
 // ------------------------------------------------------------------------
 // Game
 
@@ -102,9 +173,11 @@ class game {
 	std::string cloneof;
 	std::string sampleof;
 	mutable std::string description;
+	mutable sort_key description_key; ///< Key of the description for the sort.
 	mutable std::string info;
 	std::string year;
 	std::string manufacturer;
+	sort_key manufacturer_key; ///< Key of the manufacturer for the sort.
 	mutable std::string software_path;
 	unsigned sizex;
 	unsigned sizey;
@@ -123,6 +196,8 @@ class game {
 
 	mutable pgame_container clone_bag; // clones
 	mutable const game* parent; // parent
+	mutable pgame_container romof_bag; // games with this romof
+	mutable const game* romof_parent; // game of the romof
 
 	mutable machinedevice_container machinedevice_bag; //< Set of devices supported (MESS)
 
@@ -171,8 +246,9 @@ public:
 
 	void auto_description_set(const std::string& A) const;
 	bool is_user_description_set() const { return flag_get(flag_user_description_set); }
-	void user_description_set(const std::string& A) const { flag |= flag_user_description_set; description = A; }
+	void user_description_set(const std::string& A) const { flag |= flag_user_description_set; description = A; description_key.set(A); }
 	const std::string& description_get() const { return description; }
+	const sort_key& description_key_get() const { return description_key; }
 	std::string description_tree_get() const;
 
 	void auto_info_set(const std::string& A) const { info = A; }
@@ -195,7 +271,9 @@ public:
 	void year_set(const std::string& A) { year = A; }
 	const std::string& year_get() const { return year; }
 	void manufacturer_set(const std::string& A);
+	void manufacturer_stripped_set(const std::string& A) { manufacturer = A; manufacturer_key.set(A); }
 	const std::string& manufacturer_get() const { return manufacturer; }
+	const sort_key& manufacturer_key_get() const { return manufacturer_key; }
 	void software_path_set(const std::string& A) const { software_path = A; }
 	const std::string& software_path_get() const { return software_path; }
 	void software_set(bool A) { flag_set(A, flag_software); }
@@ -248,8 +326,8 @@ public:
 	void preview_title_set(const resource& A) const { title_path = A; }
 	void preview_title_set_ifmissing(const resource& A) const { if (!title_path.is_valid()) title_path = A; }
 	const resource& preview_title_get() const { return title_path; }
+	void preview_clear() const;
 
-	bool preview_zip_set(const std::string & zip, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1) const;
 	bool preview_dir_set(const std::string & dir, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1) const;
 	bool preview_list_set(const std::string & list, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1) const;
 	bool preview_software_list_set(const std::string & list, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1) const;
@@ -260,6 +338,8 @@ public:
 	unsigned clone_get() const { return clone_bag.size(); }
 
 	void rom_zip_set_insert(const std::string& Afile) const;
+	void rom_zip_set_remove(const std::string& Afile) const { rzs.remove(Afile); }
+	void rom_zip_set_erase() const { rzs.clear(); }
 	const path_container& rom_zip_set_get() const { return rzs; }
 
 	const category* group_derived_get() const;
@@ -269,6 +349,10 @@ public:
 	pgame_container& clone_bag_get() const { return clone_bag; }
 	void clone_bag_erase() const { clone_bag.clear(); }
 	const game* parent_get() const { return parent; }
+	void romof_parent_set(const game* A) const { romof_parent = A; }
+	const game* romof_parent_get() const { return romof_parent; }
+	pgame_container& romof_bag_get() const { return romof_bag; }
+	void romof_bag_erase() const { romof_bag.clear(); }
 	const game& bios_get() const;
 	const game& root_get() const;
 	const game& clone_best_get() const;
@@ -308,11 +392,17 @@ struct game_by_play_less : std::binary_function<game, game, bool> {
 typedef std::set<game, game_by_name_less> game_by_name_set;
 
 class game_set : public game_by_name_set {
+	merge_t cache_merge; ///< Merge mode used by cache().
+
+	bool is_tree_rom_of_present(const game& g, merge_t type) const;
 public:
 	typedef game_by_name_set::const_iterator const_iterator;
 	typedef game_by_name_set::iterator iterator;
 
+	game_set() : cache_merge(merge_no) { }
+
 	void cache(merge_t merge);
+	void cache_present(const pgame_container& changed);
 
 	bool is_tree_rom_of_present(const std::string& name, merge_t type) const;
 	bool is_game_tag(const std::string& name, const std::string& tag) const;
@@ -321,7 +411,6 @@ public:
 	bool is_game_rom_of(const std::string& name_son, const std::string& name_parent) const;
 	bool is_game_clone_of(const std::string& name_son, const std::string& name_parent) const;
 
-	bool preview_zip_set(const std::string & zip, const std::string & emulator_name, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1);
 	bool preview_dir_set(const std::string & dir, const std::string & emulator_name, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1);
 	bool preview_list_set(const std::string & list, const std::string & emulator_name, void (game::*preview_set)(const resource& s) const, const std::string & ext0, const std::string & ext1);
 
@@ -359,7 +448,7 @@ inline bool pgame_combine_less(const game* A, const game* B, bool (*FA)(const ga
 
 inline bool pgame_by_desc_less(const game* A, const game* B)
 {
-	return case_less(A->description_get(), B->description_get());
+	return A->description_key_get() < B->description_key_get();
 }
 
 /**
@@ -397,7 +486,7 @@ inline bool pgame_by_leveldesc_less(const game* A, const game* B)
 
 inline bool pgame_by_manufacturer_less(const game* A, const game* B)
 {
-	return case_less(A->manufacturer_get(), B->manufacturer_get());
+	return A->manufacturer_key_get() < B->manufacturer_key_get();
 }
 
 inline bool pgame_by_year_less(const game* A, const game* B)
@@ -22,10 +22,12 @@
 
 #include "mconfig.h"
 #include "text.h"
+#include "watch.h"
 
 #include "advance.h"
 
 #include <sstream>
+#include <algorithm>
 
 using namespace std;
 
@@ -324,6 +326,7 @@ void config_state::conf_register(adv_conf* config_context)
 	conf_bool_register_default(config_context, "display_restoreatexit", 1);
 	conf_int_register_enum_default(config_context, "display_resizeeffect", conf_enum(OPTION_RESIZEEFFECT), COMBINE_AUTO);
 	conf_bool_register_default(config_context, "misc_quiet", 0);
+	conf_bool_register_default(config_context, "misc_watch", 0);
 	conf_float_register_limit_default(config_context, "ui_translucency", 0, 1, 0.6);
 	conf_string_register_default(config_context, "ui_background", "none");
 	conf_string_register_default(config_context, "ui_help", "none");
@@ -937,6 +940,7 @@ bool config_state::load(adv_conf* config_context, bool opt_verbose)
 #endif
 
 	quiet = conf_bool_get_default(config_context, "misc_quiet");
+	watch = conf_bool_get_default(config_context, "misc_watch");
 	if (!config_split(conf_string_get_default(config_context, "ui_gamemsg"), ui_gamemsg))
 		return false;
 	ui_gamesaver = (saver_t)conf_int_get_default(config_context, "ui_game");
@@ -1098,12 +1102,21 @@ bool config_state::load(adv_conf* config_context, bool opt_verbose)
 		target_nfo("log: cache\n");
 	gar.cache(merge);
 
-	// set the previews
+	// set the previews, reading again only the changed directories
+	preview_index_file = path_abs(path_import(file_config_file_home("advmenu.pvi")), dir_cwd());
+	preview_index_load(preview_index_file);
 	for (pemulator_container::iterator i = emu_active.begin(); i != emu_active.end(); ++i) {
 		if (opt_verbose)
 			target_nfo("log: load preview for %s\n", (*i)->user_name_get().c_str());
 		(*i)->preview_set(gar);
 	}
+	preview_index_save(preview_index_file);
+
+	if (watch) {
+		if (opt_verbose)
+			target_nfo("log: watch\n");
+		watch_start();
+	}
 
 	if (opt_verbose)
 		target_nfo("log: load group and types\n");
@@ -1478,6 +1491,106 @@ void config_state::restore_save()
 	}
 }
 
+// ------------------------------------------------------------------------
+// Directory watch
+
+static void watch_split(path_container& bag, const string& list)
+{
+	int i = 0;
+	while (i < list.length()) {
+		string dir = token_get(list, i, ":");
+		if (dir.length())
+			bag.insert(bag.end(), dir);
+		token_skip(list, i, ":");
+	}
+}
+
+static void watch_preview_split(path_container& bag, const emulator* emu)
+{
+	watch_split(bag, emu->config_alts_path_get());
+	watch_split(bag, emu->config_icon_path_get());
+	watch_split(bag, emu->config_flyer_path_get());
+	watch_split(bag, emu->config_cabinet_path_get());
+	watch_split(bag, emu->config_marquee_path_get());
+	watch_split(bag, emu->config_title_path_get());
+}
+
+static bool watch_has(const path_container& bag, const string& dir)
+{
+	return find(bag.begin(), bag.end(), dir) != bag.end();
+}
+
+// Start watching the rom and preview directories of the active emulators.
+// The subdirectories, like the software ones, aren't watched.
+void config_state::watch_start()
+{
+	if (!watch_init()) {
+		if (!quiet)
+			target_err("Directory watch not available, ignoring the 'misc_watch' option.\n");
+		return;
+	}
+
+	path_container bag;
+	for (pemulator_container::const_iterator i = emu_active.begin(); i != emu_active.end(); ++i) {
+		watch_split(bag, (*i)->config_rom_path_get());
+		watch_preview_split(bag, *i);
+	}
+
+	bag.sort();
+	bag.unique();
+
+	for (path_container::const_iterator i = bag.begin(); i != bag.end(); ++i)
+		watch_insert(*i);
+}
+
+// Apply the changes notified in the watched directories.
+// Only the changed rom files are checked, and only the changed preview
+// directories are read again. If some notifications were lost, all the
+// directories of the active emulators are read again.
+void config_state::watch_update()
+{
+	watch_change_container bag;
+	bool overflow = watch_extract(bag);
+
+	if (overflow)
+		log_std(("menu:watch: update all\n"));
+	else
+		log_std(("menu:watch: update %d changes\n", (unsigned)bag.size()));
+
+	// read again the changed directories at the next use
+	for (watch_change_container::const_iterator j = bag.begin(); j != bag.end(); ++j)
+		preview_index_erase(j->dir);
+
+	for (pemulator_container::const_iterator i = emu_active.begin(); i != emu_active.end(); ++i) {
+		path_container rom_dir;
+		path_container preview_dir;
+		path_container rom_bag;
+		bool preview_changed = false;
+
+		watch_split(rom_dir, (*i)->config_rom_path_get());
+		watch_preview_split(preview_dir, *i);
+
+		for (watch_change_container::const_iterator j = bag.begin(); j != bag.end(); ++j) {
+			if (watch_has(rom_dir, j->dir))
+				rom_bag.insert(rom_bag.end(), j->dir + "/" + j->file);
+			if (watch_has(preview_dir, j->dir))
+				preview_changed = true;
+		}
+
+		if (overflow) {
+			(*i)->rescan(gar);
+			preview_changed = true;
+		} else if (rom_bag.size()) {
+			(*i)->rescan_file(gar, rom_bag);
+		}
+
+		if (preview_changed)
+			(*i)->preview_update(gar);
+	}
+
+	preview_index_save(preview_index_file);
+}
+
 // ------------------------------------------------------------------------
 // Configuration state
 
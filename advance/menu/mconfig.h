@@ -139,7 +139,8 @@ inline bool sort_by_emulator_func(const game* A, const game* B)
 
 typedef bool (*pgame_sort_func)(const game*, const game*);
 
-typedef std::set<const game*, pgame_sort_func> pgame_sort_set;
+// Games sorted with a pgame_sort_func
+typedef std::vector<const game*> pgame_sort_set;
 
 /// Type of mode.
 enum listmode_t {
@@ -414,6 +415,8 @@ public:
 	restore_t restore; ///< Configuration restore mode.
 
 	bool quiet; ///< Quiet mode.
+	bool watch; ///< Watch the rom and preview directories for changes.
+	std::string preview_index_file; ///< File of the preview index.
 
 	// internal state
 	unsigned mode_mask; ///< Mask of available modes.
@@ -465,6 +468,9 @@ public:
 	void restore_save();
 	void restore_save_default();
 
+	void watch_start();
+	void watch_update();
+
 	static void conf_register(adv_conf* config_context);
 	static void conf_default(adv_conf* config_context);
 };
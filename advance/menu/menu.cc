@@ -31,6 +31,11 @@
 #include <iomanip>
 #include <algorithm>
 
+#ifdef USE_SMP
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 // ------------------------------------------------------------------------
@@ -454,12 +459,36 @@ struct cell_t {
 	int y;
 	int dx;
 	int dy;
+
+	// content already drawn
+	bool drawn; ///< If the cell contains drawn_entry.
+	const menu_entry* drawn_entry; ///< Entry drawn, 0 for an empty cell.
+	bool drawn_selected; ///< If the entry was drawn selected.
+
+	cell_t() : drawn(false) { }
 };
 
+/**
+ * Draw the menu entries.
+ * The cells with the same entry and selection of the previous call are
+ * not drawn again, and then they are not copied again in the video memory.
+ * Anything that draws over the cells must reset their drawn flag.
+ */
 void draw_menu_window(const game_set& gar, const menu_array& gc, struct cell_t* cell, int coln, int rown, int start, int pos, bool use_ident, merge_t merge, bool center)
 {
 	for (int r = 0; r < rown; ++r) {
 		for (int c = 0; c < coln; ++c) {
+			const menu_entry* entry = start < gc.size() ? gc[start] : 0;
+			if (cell->drawn && cell->drawn_entry == entry && cell->drawn_selected == (start == pos)) {
+				++start;
+				++cell;
+				continue;
+			}
+
+			cell->drawn = true;
+			cell->drawn_entry = entry;
+			cell->drawn_selected = start == pos;
+
 			if (start < gc.size()) {
 				if (gc[start]->has_game()) {
 					const game& g = gc[start]->game_get();
@@ -659,6 +688,24 @@ void backdrop_index_set(unsigned pos, menu_array& gc, unsigned back_pos, listpre
 	backdrop_game_set(effective_game, back_pos, preview, current, highlight, clip, rs);
 }
 
+void backdrop_game_prefetch(const game* effective_game, unsigned back_pos, listpreview_t preview, config_state& rs)
+{
+	resource backdrop_res;
+
+	unsigned aspectx;
+	unsigned aspecty;
+	if (effective_game && (preview == preview_snap || preview == preview_title)) {
+		aspectx = effective_game->aspectx_get();
+		aspecty = effective_game->aspecty_get();
+	} else {
+		aspectx = 0;
+		aspecty = 0;
+	}
+
+	if (backdrop_find_preview_default(backdrop_res, aspectx, aspecty, preview, effective_game, rs))
+		int_backdrop_prefetch(back_pos, backdrop_res, aspectx, aspecty);
+}
+
 //--------------------------------------------------------------------------
 // Menu run
 
@@ -1503,6 +1550,8 @@ static int run_menu_user(config_state& rs, bool flipxy, menu_array& gc, sort_ite
 
 	log_std(("menu: user end\n"));
 
+	int pos_last = pos_base + pos_rel;
+
 	while (!done) {
 		const game* effective_game = pos_base + pos_rel < gc.size() && gc[pos_base + pos_rel]->has_game() ? &gc[pos_base + pos_rel]->game_get() : 0;
 
@@ -1637,10 +1686,33 @@ static int run_menu_user(config_state& rs, bool flipxy, menu_array& gc, sort_ite
 
 		int_update(rs.mode_get() != mode_full_mixed && rs.mode_get() != mode_list_mixed);
 
+		// prefetch the backdrops of the next games in the scroll direction
+		if (rs.mode_get() != mode_full_mixed && rs.mode_get() != mode_list_mixed) {
+			int pos_current = pos_base + pos_rel;
+			bool forward = pos_current >= pos_last;
+			if (backdrop_mac == 1) {
+				for (int i = 1; i <= INT_BACKDROP_PREFETCH_MAX; ++i) {
+					int pos = forward ? pos_current + i : pos_current - i;
+					if (pos >= 0 && pos < gc.size() && gc[pos]->has_game())
+						backdrop_game_prefetch(&gc[pos]->game_get(), 0, effective_preview, rs);
+				}
+			} else if (backdrop_mac > 1) {
+				// the next row scrolls in the last row, the previous in the first
+				for (int i = 0; i < coln; ++i) {
+					int pos = forward ? pos_base + coln * rown + i : pos_base - coln + i;
+					int back_pos = forward ? coln * (rown - 1) + i : i;
+					if (pos >= 0 && pos < gc.size() && gc[pos]->has_game())
+						backdrop_game_prefetch(&gc[pos]->game_get().clone_best_get(), back_pos, effective_preview, rs);
+				}
+			}
+			pos_last = pos_current;
+		}
+
 		log_std(("menu: wait begin\n"));
 
 		int_idle_0_enable(rs.current_game && rs.current_game->emulator_get()->is_runnable());
 		int_idle_1_enable(true);
+		int_rescan_enable(rs.watch);
 
 		run_background_wait(rs, sound, silent, pos_rel, backdrop_mac, false);
 
@@ -1651,6 +1723,9 @@ static int run_menu_user(config_state& rs, bool flipxy, menu_array& gc, sort_ite
 
 		key = int_event_get(false);
 
+		// the directory changes are applied only from the main menu
+		int_rescan_enable(false);
+
 		log_std(("menu: key %d\n", key));
 
 		string oldfast = rs.fast;
@@ -1711,6 +1786,7 @@ static int run_menu_user(config_state& rs, bool flipxy, menu_array& gc, sort_ite
 		case EVENT_IDLE_0:
 		case EVENT_IDLE_1:
 		case EVENT_CALIBRATION:
+		case EVENT_RESCAN:
 			done = true;
 			break;
 		case EVENT_HELP:
@@ -2114,9 +2190,94 @@ void run_runinfo(config_state& rs)
 	}
 }
 
+struct pgame_sort_equal {
+	pgame_sort_func func;
+
+	pgame_sort_equal(pgame_sort_func Afunc) : func(Afunc) { }
+
+	bool operator()(const game* A, const game* B) const
+	{
+		return !func(A, B) && !func(B, A);
+	}
+};
+
+#ifdef USE_SMP
+#define SORT_THREAD_MAX 8 // max number of sort threads
+#define SORT_SLICE_MIN 4096 // min number of games sorted by a thread
+
+struct pgame_sort_slice {
+	pgame_sort_set::iterator begin;
+	pgame_sort_set::iterator end;
+	pgame_sort_func func;
+};
+
+static void* pgame_sort_thread(void* arg)
+{
+	pgame_sort_slice* slice = static_cast<pgame_sort_slice*>(arg);
+
+	stable_sort(slice->begin, slice->end, slice->func);
+
+	return 0;
+}
+#endif
+
+/**
+ * Sort the games and remove the duplicates, like inserting them in a std::set.
+ * With more processors the list is split in slices sorted by different threads
+ * and then merged.
+ */
+static void pgame_sort(pgame_sort_set& gss, pgame_sort_func func)
+{
+#ifdef USE_SMP
+	long cpu = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned slice_mac = cpu > 1 ? cpu : 1;
+	if (slice_mac > SORT_THREAD_MAX)
+		slice_mac = SORT_THREAD_MAX;
+	if (slice_mac > gss.size() / SORT_SLICE_MIN)
+		slice_mac = gss.size() / SORT_SLICE_MIN;
+
+	if (slice_mac > 1) {
+		pgame_sort_slice slice_map[SORT_THREAD_MAX];
+		pthread_t thread_map[SORT_THREAD_MAX];
+		bool thread_active[SORT_THREAD_MAX];
+
+		for (unsigned i = 0; i < slice_mac; ++i) {
+			slice_map[i].begin = gss.begin() + gss.size() * i / slice_mac;
+			slice_map[i].end = gss.begin() + gss.size() * (i + 1) / slice_mac;
+			slice_map[i].func = func;
+		}
+
+		// the first slice is sorted by the current thread
+		for (unsigned i = 1; i < slice_mac; ++i) {
+			thread_active[i] = pthread_create(&thread_map[i], 0, pgame_sort_thread, &slice_map[i]) == 0;
+			if (!thread_active[i])
+				pgame_sort_thread(&slice_map[i]);
+		}
+
+		pgame_sort_thread(&slice_map[0]);
+
+		for (unsigned i = 1; i < slice_mac; ++i) {
+			if (thread_active[i])
+				pthread_join(thread_map[i], 0);
+		}
+
+		// merge keeping the order of the slices, as stable_sort() does
+		for (unsigned i = 1; i < slice_mac; ++i)
+			inplace_merge(gss.begin(), slice_map[i].begin, slice_map[i].end, func);
+	} else {
+		stable_sort(gss.begin(), gss.end(), func);
+	}
+#else
+	stable_sort(gss.begin(), gss.end(), func);
+#endif
+
+	gss.erase(unique(gss.begin(), gss.end(), pgame_sort_equal(func)), gss.end());
+}
+
 int run_menu(config_state& rs, bool flipxy, bool silent)
 {
-	pgame_sort_set* psc;
+	pgame_sort_set psc;
+	pgame_sort_func sort_func;
 	sort_item_func* category_func;
 
 	log_std(("menu: sort begin\n"));
@@ -2124,59 +2285,59 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 	// setup the sorted container
 	switch (rs.sort_get()) {
 	case sort_by_root_name:
-		psc = new pgame_sort_set(sort_by_root_name_func);
+		sort_func = sort_by_root_name_func;
 		category_func = sort_item_root_name;
 		break;
 	case sort_by_name:
-		psc = new pgame_sort_set(sort_by_name_func);
+		sort_func = sort_by_name_func;
 		category_func = sort_item_name;
 		break;
 	case sort_by_manufacturer:
-		psc = new pgame_sort_set(sort_by_manufacturer_func);
+		sort_func = sort_by_manufacturer_func;
 		category_func = sort_item_manufacturer;
 		break;
 	case sort_by_year:
-		psc = new pgame_sort_set(sort_by_year_func);
+		sort_func = sort_by_year_func;
 		category_func = sort_item_year;
 		break;
 	case sort_by_time:
-		psc = new pgame_sort_set(sort_by_time_func);
+		sort_func = sort_by_time_func;
 		category_func = sort_item_time;
 		break;
 	case sort_by_smart_time:
-		psc = new pgame_sort_set(sort_by_smart_time_func);
+		sort_func = sort_by_smart_time_func;
 		category_func = sort_item_smart_time;
 		break;
 	case sort_by_session:
-		psc = new pgame_sort_set(sort_by_session_func);
+		sort_func = sort_by_session_func;
 		category_func = sort_item_session;
 		break;
 	case sort_by_group:
-		psc = new pgame_sort_set(sort_by_group_func);
+		sort_func = sort_by_group_func;
 		category_func = sort_item_group;
 		break;
 	case sort_by_type:
-		psc = new pgame_sort_set(sort_by_type_func);
+		sort_func = sort_by_type_func;
 		category_func = sort_item_type;
 		break;
 	case sort_by_size:
-		psc = new pgame_sort_set(sort_by_size_func);
+		sort_func = sort_by_size_func;
 		category_func = sort_item_size;
 		break;
 	case sort_by_res:
-		psc = new pgame_sort_set(sort_by_res_func);
+		sort_func = sort_by_res_func;
 		category_func = sort_item_res;
 		break;
 	case sort_by_info:
-		psc = new pgame_sort_set(sort_by_info_func);
+		sort_func = sort_by_info_func;
 		category_func = sort_item_info;
 		break;
 	case sort_by_timepersession:
-		psc = new pgame_sort_set(sort_by_timepersession_func);
+		sort_func = sort_by_timepersession_func;
 		category_func = sort_item_timepersession;
 		break;
 	case sort_by_emulator:
-		psc = new pgame_sort_set(sort_by_emulator_func);
+		sort_func = sort_by_emulator_func;
 		category_func = sort_item_emulator;
 		break;
 	default:
@@ -2247,6 +2408,7 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 	rs.preview_mask = 0;
 
 	// select and sort
+	psc.reserve(rs.gar.size());
 	for (game_set::const_iterator i = rs.gar.begin(); i != rs.gar.end(); ++i) {
 		// emulator
 		if (!i->emulator_get()->state_get())
@@ -2272,7 +2434,7 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 
 		has_filter = true;
 
-		psc->insert(&*i);
+		psc.push_back(&*i);
 
 		// update the preview mask
 		if (i->preview_snap_get().is_valid() || i->preview_clip_get().is_valid())
@@ -2289,6 +2451,8 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 			rs.preview_mask |= preview_title;
 	}
 
+	pgame_sort(psc, sort_func);
+
 	/* prepare a warning message if the game list is empty */
 	string empty_msg;
 	if (rs.gar.empty())
@@ -2330,7 +2494,7 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 	int key = 0;
 
 	while (!done) {
-		key = run_menu_sort(rs, *psc, category_func, flipxy, silent, empty_msg);
+		key = run_menu_sort(rs, psc, category_func, flipxy, silent, empty_msg);
 
 		// don't replay the sound and clip
 		silent = true;
@@ -2380,6 +2544,7 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 		case EVENT_CLONE:
 		case EVENT_IDLE_0:
 		case EVENT_IDLE_1:
+		case EVENT_RESCAN:
 		case EVENT_LOCK:
 		case EVENT_HELP:
 		case EVENT_GROUP:
@@ -2405,8 +2570,6 @@ int run_menu(config_state& rs, bool flipxy, bool silent)
 		}
 	}
 
-	delete psc;
-
 	return key;
 }
 
@@ -25,6 +25,7 @@
 #include "submenu.h"
 #include "text.h"
 #include "play.h"
+#include "watch.h"
 
 #include "advance.h"
 
@@ -173,6 +174,9 @@ int run_sub(config_state& rs, bool silent)
 		case EVENT_OFF:
 			done = true;
 			break;
+		case EVENT_RESCAN:
+			rs.watch_update();
+			break;
 		}
 
 		switch (key) {
@@ -864,6 +868,8 @@ int os_main(int argc, char* argv[])
 
 	key = run_all(config_context, rs);
 
+	watch_done();
+
 	// restore or set the changed data
 	if (rs.restore == restore_none) {
 		rs.restore_save();
@@ -24,6 +24,7 @@
 #include "common.h"
 #include "play.h"
 #include "mconfig.h"
+#include "watch.h"
 
 #include "advance.h"
 
@@ -33,8 +34,14 @@
 #include <sstream>
 #include <set>
 #include <deque>
+#include <vector>
 #include <cmath>
 
+#ifdef USE_SMP
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 // -------------------------------------------------------------------------
@@ -453,12 +460,15 @@ static target_clock_t int_idle_time_current; ///< Last time check in idle.
 static bool int_idle_0_state; ///< Idle event 0 enabler.
 static bool int_idle_1_state; ///< Idle event 1 enabler.
 static bool int_idle_2_state; ///< Idle event 2 enabler.
+static bool int_rescan_state; ///< Rescan event enabler.
 static int int_last; ///< Last event.
 static bool int_auto_calib; ///< Auto calibration
 static bool int_keyboard_detected; ///< If an active and *USED* keyboard was detected
 static int int_joystick_removal; ///< If a joystick was removed
 
 static bool int_wait_for_backdrop; ///< Wait for the backdrop draw completion before accepting events.
+static unsigned int_backdrop_cache_size; ///< Memory used by the cached backdrops not displayed, in bytes.
+static string int_backdrop_cache_dir; ///< Directory of the resized backdrops saved on disk, empty if disabled.
 
 static unsigned video_buffer_size; ///< Video buffer size in bytes.
 static unsigned video_buffer_line_size; ///< Bideo buffer scanline size in bytes.
@@ -472,18 +482,89 @@ static adv_bitmap* video_background_bitmap; ///< Video buffer bitmap in memory.
 adv_bool video_alpha_flag; ///< Color translucency enabled.
 adv_color_def video_alpha_color_def; ///< Color definition for the alpha buffers.
 unsigned video_alpha_bytes_per_pixel; ///< Pixel size of the alpha buffers.
+static vector<unsigned> video_damage_x0; ///< First changed column of every row of the foreground buffer.
+static vector<unsigned> video_damage_x1; ///< Column after the last changed one, 0 if the row isn't changed.
+
+/**
+ * Mark a part of the foreground buffer as changed.
+ * The coordinates are in the buffer, already rotated.
+ * Only the changed parts are copied in the video memory.
+ */
+static void int_damage(int x, int y, int dx, int dy)
+{
+	if (x < 0) {
+		dx += x;
+		x = 0;
+	}
+	if (y < 0) {
+		dy += y;
+		y = 0;
+	}
+	if (x + dx > (int)video_size_x())
+		dx = video_size_x() - x;
+	if (y + dy > (int)video_damage_x1.size())
+		dy = video_damage_x1.size() - y;
+	if (dx <= 0 || dy <= 0)
+		return;
 
+	for (int i = y; i < y + dy; ++i) {
+		if (video_damage_x1[i] == 0) {
+			video_damage_x0[i] = x;
+			video_damage_x1[i] = x + dx;
+		} else {
+			if (video_damage_x0[i] > x)
+				video_damage_x0[i] = x;
+			if (video_damage_x1[i] < x + dx)
+				video_damage_x1[i] = x + dx;
+		}
+	}
+}
+
+static void int_damage_all()
+{
+	int_damage(0, 0, video_size_x(), video_size_y());
+}
+
+/**
+ * Copy in the video memory the changed parts of the foreground buffer in the specified rows.
+ */
 static void int_copy_partial(unsigned y0, unsigned y1)
 {
-	video_write_lock();
+	bool locked = false;
+	unsigned x_min = video_size_x();
+	unsigned x_max = 0;
+	unsigned y_min = 0;
+	unsigned y_max = 0;
+
+	if (y1 > video_damage_x1.size())
+		y1 = video_damage_x1.size();
 
-	unsigned char* buffer = video_foreground_buffer + y0 * video_buffer_line_size;
 	for (unsigned y = y0; y < y1; ++y) {
-		memcpy(video_write_line(y), buffer, video_buffer_line_size);
-		buffer += video_buffer_line_size;
+		unsigned x1 = video_damage_x1[y];
+		if (!x1)
+			continue;
+
+		unsigned x0 = video_damage_x0[y];
+
+		if (!locked) {
+			video_write_lock();
+			locked = true;
+			y_min = y;
+		}
+
+		memcpy(video_write_line(y) + x0 * video_buffer_pixel_size, video_foreground_buffer + y * video_buffer_line_size + x0 * video_buffer_pixel_size, (x1 - x0) * video_buffer_pixel_size);
+
+		video_damage_x1[y] = 0;
+
+		if (x_min > x0)
+			x_min = x0;
+		if (x_max < x1)
+			x_max = x1;
+		y_max = y + 1;
 	}
 
-	video_write_unlock(0, y0, video_size_x(), y1 - y0, 0);
+	if (locked)
+		video_write_unlock(x_min, y_min, x_max - x_min, y_max - y_min, 0);
 }
 
 void int_reg(adv_conf* config_context)
@@ -494,6 +575,9 @@ void int_reg(adv_conf* config_context)
 	generate_interpolate_register(config_context);
 	monitor_register(config_context);
 
+	conf_int_register_limit_default(config_context, "preview_cache_size", 0, 1024, 32);
+	conf_string_register_default(config_context, "preview_cache_dir", "none");
+
 	video_reg(config_context, 1);
 	video_reg_driver_all(config_context);
 
@@ -538,6 +622,16 @@ bool int_load(adv_conf* config_context)
 		log_std(("text: clock options not found. Use default SVGA monitor clocks.\n"));
 	}
 
+	int_backdrop_cache_size = conf_int_get_default(config_context, "preview_cache_size") * 1024 * 1024;
+
+	int_backdrop_cache_dir = conf_string_get_default(config_context, "preview_cache_dir");
+	if (int_backdrop_cache_dir == "none") {
+		int_backdrop_cache_dir = "";
+	} else if (access(cpath_export(int_backdrop_cache_dir), F_OK) != 0 && target_mkdir(cpath_export(int_backdrop_cache_dir)) != 0) {
+		log_std(("text: unable to create the preview cache dir %s\n", int_backdrop_cache_dir.c_str()));
+		int_backdrop_cache_dir = "";
+	}
+
 	err = video_load(config_context, "");
 	if (err != 0) {
 		target_err("%s\n", error_get());
@@ -936,6 +1030,11 @@ bool int_enable(
 	memset(video_background_buffer, 0, video_buffer_size);
 	memset(video_foreground_buffer, 0, video_buffer_size);
 
+	// the video memory is unknown, the first update copies all
+	video_damage_x0.assign(video_size_y(), 0);
+	video_damage_x1.assign(video_size_y(), 0);
+	int_damage_all();
+
 	int_updating_active = false;
 
 	return true;
@@ -971,6 +1070,8 @@ void int_restore(void* buffer)
 {
 	memcpy(video_foreground_buffer, buffer, video_buffer_size);
 
+	int_damage_all();
+
 	operator delete(buffer);
 }
 
@@ -1113,13 +1214,16 @@ static void gen_clear_raw(int x, int y, int dx, int dy, const adv_color_rgb& col
 	adv_pixel pixel = video_pixel_get(color.red, color.green, color.blue);
 
 	adv_bitmap_clear(video_foreground_bitmap, x, y, dx, dy, pixel);
+
+	int_damage(x, y, dx, dy);
 }
 
 static void gen_clear_alpha(int x, int y, int dx, int dy, const adv_color_rgb& color)
 {
-	if (video_alpha_flag)
+	if (video_alpha_flag) {
 		adv_bitmap_clear_alphaback(video_foreground_bitmap, x, y, video_color_def(), video_background_bitmap, x, y, color, dx, dy);
-	else
+		int_damage(x, y, dx, dy);
+	} else
 		gen_clear_raw(x, y, dx, dy, color);
 }
 
@@ -1139,6 +1243,8 @@ void cell_pos_t::draw_backdrop(const adv_bitmap* map, const adv_color_rgb& backg
 		gen_clear_alpha(real_x, real_y + real_dy - y1, real_dx, y1, background);
 
 	adv_bitmap_put(video_foreground_bitmap, real_x + x0, real_y + y0, map, 0, 0, map->size_x, map->size_y);
+
+	int_damage(real_x + x0, real_y + y0, map->size_x, map->size_y);
 }
 
 void cell_pos_t::clear(const adv_color_rgb& background)
@@ -1150,6 +1256,8 @@ void cell_pos_t::draw_clip(const adv_bitmap* bitmap, adv_color_rgb* rgb_map, uns
 {
 	adv_pixel pixel = video_pixel_get(background.red, background.green, background.blue);
 
+	int_damage(real_x, real_y, real_dx, real_dy);
+
 	// source range and steps
 	unsigned char* ptr = bitmap->ptr;
 	int dw = bitmap->bytes_per_scanline;
@@ -1353,14 +1461,46 @@ class backdrop_data {
 	void icon_apply(adv_bitmap* bitmap, adv_bitmap* bitmap_mask, adv_color_rgb* rgb, unsigned* rgb_max, const adv_color_rgb& background);
 	adv_bitmap* image_load(const resource& res, adv_color_rgb* rgb, unsigned* rgb_max, const adv_color_rgb& background);
 	adv_bitmap* adapt(adv_bitmap* bitmap, adv_color_rgb* rgb, unsigned* rgb_max, unsigned dst_dx, unsigned dst_dy, int resizeeffect);
+	adv_bitmap* decode(const cell_pos_t& cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect);
+	string disk_key(const cell_pos_t& cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect);
+	adv_bitmap* disk_load(const string& file, const string& key);
+	void disk_save(const string& file, const string& key, const adv_bitmap* bitmap);
+
+#ifdef USE_SMP
+	friend class backdrop_loader;
+
+	// Background load request, set before queuing it
+	cell_pos_t req_pos;
+	adv_color_rgb req_background;
+	double req_aspect_expand;
+	int req_resizeeffect;
+
+	// Accessed only by the main thread
+	bool requested; ///< Already requested, the load parameters can't change anymore.
+	bool pending; ///< Requested and not yet published.
+
+	// Accessed with the loader mutex
+	unsigned state; ///< One of the backdrop_state_* values.
+	bool urgent; ///< Queued before the prefetches.
+	bool orphan; ///< Released while loading, the loader thread deletes it.
+	adv_bitmap* result; ///< Decoded image waiting to be published.
+#endif
 
 public:
 	backdrop_data(const resource& Ares, unsigned Atarget_dx, unsigned Atarget_dy, unsigned Aaspectx, unsigned Aaspecty);
 	~backdrop_data();
 
 	bool is_active() const { return map != 0; }
+#ifdef USE_SMP
+	bool is_pending() const { return pending; }
+	void prepare(const cell_pos_t& cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect);
+#else
+	bool is_pending() const { return false; }
+#endif
 	const resource& res_get() const { return res; }
 	const adv_bitmap* bitmap_get() const { return map; }
+	bool match(const resource& Ares, unsigned dx, unsigned dy) const { return res == Ares && target_dx == dx && target_dy == dy; }
+	unsigned size_get() const;
 
 	unsigned target_dx_get() const { return target_dx; }
 	unsigned target_dy_get() const { return target_dy; }
@@ -1374,6 +1514,14 @@ backdrop_data::backdrop_data(const resource& Ares, unsigned Atarget_dx, unsigned
 	: res(Ares), target_dx(Atarget_dx), target_dy(Atarget_dy), aspectx(Aaspectx), aspecty(Aaspecty)
 {
 	map = 0;
+#ifdef USE_SMP
+	requested = false;
+	pending = false;
+	state = 0;
+	urgent = false;
+	orphan = false;
+	result = 0;
+#endif
 }
 
 backdrop_data::~backdrop_data()
@@ -1382,6 +1530,15 @@ backdrop_data::~backdrop_data()
 		adv_bitmap_free(map);
 }
 
+// Memory used by the image, estimated from the target size if not yet loaded
+unsigned backdrop_data::size_get() const
+{
+	if (map)
+		return sizeof(*this) + map->size_y * map->bytes_per_scanline;
+	else
+		return sizeof(*this) + target_dx * target_dy * video_bytes_per_pixel();
+}
+
 void backdrop_data::icon_apply(adv_bitmap* bitmap, adv_bitmap* bitmap_mask, adv_color_rgb* rgb, unsigned* rgb_max, const adv_color_rgb& background)
 {
 	unsigned index;
@@ -1666,231 +1823,1114 @@ adv_bitmap* backdrop_data::adapt(adv_bitmap* bitmap, adv_color_rgb* rgb_map, uns
 	return raw;
 }
 
-void backdrop_data::load(struct cell_pos_t* cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect)
+#define BACKDROP_DISK_MAGIC "ADVBACK1"
+
+// Key of the resized image in the disk cache. It contains everything that
+// changes the result of decode(), the source file is identified by its path,
+// size and modification time.
+string backdrop_data::disk_key(const cell_pos_t& cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect)
 {
-	if (map)
-		return; // already loaded
+	struct stat st;
+	if (stat(cpath_export(res.archive_get()), &st) != 0)
+		return "";
+
+	ostringstream os;
+	os << res.path_get() << "|" << (unsigned long)st.st_size << "|" << (unsigned long)st.st_mtime;
+	os << "|" << cell.real_dx << "x" << cell.real_dy << "|" << video_size_x() << "x" << video_size_y();
+	os << "|" << aspectx << "x" << aspecty << "|" << aspect_expand << "|" << resizeeffect << "|" << int_orientation;
+	os << "|" << video_color_def() << "|" << (unsigned)background.red << "," << (unsigned)background.green << "," << (unsigned)background.blue;
+	return os.str();
+}
+
+// Load the resized image from the disk cache
+adv_bitmap* backdrop_data::disk_load(const string& file, const string& key)
+{
+	adv_fz* f = fzopen(cpath_export(file), "rb");
+	if (!f)
+		return 0;
+
+	char magic[8];
+	unsigned key_size;
+	unsigned size_x;
+	unsigned size_y;
+	unsigned bytes_per_pixel;
+	if (fzread(magic, 8, 1, f) != 1 || memcmp(magic, BACKDROP_DISK_MAGIC, 8) != 0
+		|| le_uint32_fzread(f, &key_size) != 0 || key_size != key.length()) {
+		fzclose(f);
+		return 0;
+	}
+
+	string file_key(key_size, ' ');
+	if (fzread(&file_key[0], key_size, 1, f) != 1 || file_key != key
+		|| le_uint32_fzread(f, &size_x) != 0
+		|| le_uint32_fzread(f, &size_y) != 0
+		|| le_uint32_fzread(f, &bytes_per_pixel) != 0
+		|| bytes_per_pixel != video_bytes_per_pixel()
+		|| size_x > video_size_x() || size_y > video_size_y()) {
+		fzclose(f);
+		return 0;
+	}
+
+	adv_bitmap* bitmap = adv_bitmap_alloc(size_x, size_y, bytes_per_pixel);
+
+	for (unsigned y = 0; y < size_y; ++y) {
+		if (fzread(adv_bitmap_line(bitmap, y), size_x * bytes_per_pixel, 1, f) != 1) {
+			adv_bitmap_free(bitmap);
+			fzclose(f);
+			return 0;
+		}
+	}
+
+	fzclose(f);
+
+	return bitmap;
+}
+
+// Save the resized image in the disk cache, using a temporary file to never
+// leave a partial image if interrupted
+void backdrop_data::disk_save(const string& file, const string& key, const adv_bitmap* bitmap)
+{
+	ostringstream os;
+	os << file << "." << (unsigned long)this << ".tmp";
+	string tmp = os.str();
+
+	adv_fz* f = fzopen(cpath_export(tmp), "wb");
+	if (!f) {
+		log_std(("text: unable to write the preview cache file %s\n", tmp.c_str()));
+		return;
+	}
 
+	unsigned char header[12];
+	unsigned char size[4];
+	bool ok = true;
+
+	le_uint32_write(size, key.length());
+	le_uint32_write(header, bitmap->size_x);
+	le_uint32_write(header + 4, bitmap->size_y);
+	le_uint32_write(header + 8, bitmap->bytes_per_pixel);
+
+	ok = ok && fzwrite(BACKDROP_DISK_MAGIC, 8, 1, f) == 1;
+	ok = ok && fzwrite(size, 4, 1, f) == 1;
+	ok = ok && fzwrite(key.data(), key.length(), 1, f) == 1;
+	ok = ok && fzwrite(header, 12, 1, f) == 1;
+	for (unsigned y = 0; ok && y < bitmap->size_y; ++y)
+		ok = fzwrite(bitmap->ptr + y * bitmap->bytes_per_scanline, bitmap->size_x * bitmap->bytes_per_pixel, 1, f) == 1;
+
+	if (fzclose(f) != 0)
+		ok = false;
+
+	if (!ok || rename(cpath_export(tmp), cpath_export(file)) != 0) {
+		log_std(("text: unable to write the preview cache file %s\n", file.c_str()));
+		remove(cpath_export(tmp));
+	}
+}
+
+// Load and resize the image, it doesn't change the object and it may be called by any thread
+adv_bitmap* backdrop_data::decode(const cell_pos_t& cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect)
+{
 	adv_color_rgb rgb[256];
 	unsigned rgb_max;
+	string key;
+	string file;
+
+	// the already resized image in the disk cache
+	if (int_backdrop_cache_dir.length()) {
+		key = disk_key(cell, background, aspect_expand, resizeeffect);
+		if (key.length()) {
+			unsigned hash = 2166136261U;
+			for (string::const_iterator i = key.begin(); i != key.end(); ++i)
+				hash = (hash ^ (unsigned char)*i) * 16777619U;
+
+			ostringstream os;
+			os << int_backdrop_cache_dir << "/" << hex << setw(8) << setfill('0') << hash << ".dat";
+			file = os.str();
+
+			adv_bitmap* bitmap = disk_load(file, key);
+			if (bitmap)
+				return bitmap;
+		}
+	}
 
 	adv_bitmap* bitmap = image_load(res_get(), rgb, &rgb_max, background);
 	if (!bitmap)
-		return;
+		return 0;
 
 	// compute the size of the bitmap
 	unsigned dst_dx;
 	unsigned dst_dy;
 
-	cell->compute_size(&dst_dx, &dst_dy, bitmap, aspectx, aspecty, aspect_expand);
+	cell_pos_t pos = cell;
+	pos.compute_size(&dst_dx, &dst_dy, bitmap, aspectx, aspecty, aspect_expand);
 
 	adv_bitmap* scaled_bitmap = adapt(bitmap, rgb, &rgb_max, dst_dx, dst_dy, resizeeffect);
 
 	adv_bitmap_free(bitmap);
 
-	if (!scaled_bitmap)
-		return;
+	if (file.length())
+		disk_save(file, key, scaled_bitmap);
+
+	return scaled_bitmap;
+}
+
+void backdrop_data::load(struct cell_pos_t* cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect)
+{
+	if (map)
+		return; // already loaded
+
+	map = decode(*cell, background, aspect_expand, resizeeffect);
+}
+
+#ifdef USE_SMP
+// Set the parameters for the load in background
+void backdrop_data::prepare(const cell_pos_t& cell, const adv_color_rgb& background, double aspect_expand, int resizeeffect)
+{
+	if (requested)
+		return; // a thread may be already using them
 
-	map = scaled_bitmap;
+	req_pos = cell;
+	req_background = background;
+	req_aspect_expand = aspect_expand;
+	req_resizeeffect = resizeeffect;
 }
+#endif
 
+#ifdef USE_SMP
 // -------------------------------------------------------------------------
-// Backdrop Cache
+// Backdrop Loader
+
+#define BACKDROP_THREAD_MAX 4 // max number of loader threads
+
+enum backdrop_state_t {
+	backdrop_state_idle, ///< Never requested.
+	backdrop_state_queued, ///< In the request queue.
+	backdrop_state_loading, ///< Decoded by a thread.
+	backdrop_state_ready, ///< Decoded, waiting to be published.
+	backdrop_state_done ///< Published, map is the result.
+};
+
+// Pool of threads decoding and resizing the backdrop images.
+// The main thread queues the requests and publishes the decoded images,
+// the threads never touch the map of a backdrop or the screen.
+// Every thread has its own blit buffers (USE_BLIT_THREAD). The blit
+// library also has some static masks, but they are computed from the
+// target color definition, that is always the video one.
+class backdrop_loader {
+	pthread_mutex_t mutex;
+	pthread_cond_t notempty; ///< Signaled when a request is queued.
+	pthread_cond_t notbusy; ///< Signaled when a request is decoded.
+	pthread_t thread_map[BACKDROP_THREAD_MAX];
+	unsigned thread_mac;
+	bool thread_exit;
+
+	list<backdrop_data*> queue; ///< Requests to decode, the urgent ones first.
+	unsigned queue_urgent; ///< Number of urgent requests in the queue.
+	list<backdrop_data*> ready; ///< Requests decoded and not yet published.
+
+	static void* thread_func(void* arg);
+	void run();
+	void enqueue(backdrop_data* data, bool urgent);
+	void dequeue(backdrop_data* data);
+	void publish(backdrop_data* data);
 
-class backdrop_cache {
-	unsigned max;
-	list<backdrop_data*> bag;
 public:
-	backdrop_cache(unsigned Amax);
-	~backdrop_cache();
+	backdrop_loader();
+	~backdrop_loader();
 
-	void reduce();
-	void free(backdrop_data* data);
-	backdrop_data* alloc(const resource& res, unsigned dx, unsigned dy, unsigned aspectx, unsigned aspecty);
+	bool is_active() const { return thread_mac != 0; }
+
+	void request(backdrop_data* data, bool urgent);
+	void demote(backdrop_data* data);
+	void wait(backdrop_data* data);
+	void release(backdrop_data* data);
+	bool publish_all();
 };
 
-backdrop_cache::backdrop_cache(unsigned Amax)
+backdrop_loader::backdrop_loader()
 {
-	max = Amax;
-}
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&notempty, 0);
+	pthread_cond_init(&notbusy, 0);
+	thread_exit = false;
+	queue_urgent = 0;
 
-backdrop_cache::~backdrop_cache()
-{
-	for (list<backdrop_data*>::iterator i = bag.begin(); i != bag.end(); ++i)
-		delete *i;
+	// keep one processor for the user interface
+	long cpu = 2;
+#ifdef _SC_NPROCESSORS_ONLN
+	cpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	unsigned max = cpu > 2 ? cpu - 1 : 1;
+	if (max > BACKDROP_THREAD_MAX)
+		max = BACKDROP_THREAD_MAX;
+
+	for (thread_mac = 0; thread_mac < max; ++thread_mac) {
+		if (pthread_create(&thread_map[thread_mac], 0, thread_func, this) != 0) {
+			log_std(("ERROR:text: error calling pthread_create()\n"));
+			break;
+		}
+	}
+
+	log_std(("text: backdrop loader with %u threads\n", thread_mac));
 }
 
-// Reduce the size of the cache
-void backdrop_cache::reduce()
+backdrop_loader::~backdrop_loader()
 {
-	// limit the cache size
-	while (bag.size() > max) {
-		list<backdrop_data*>::iterator i = bag.end();
-		--i;
-		backdrop_data* data = *i;
-		bag.erase(i);
-		delete data;
-	}
+	pthread_mutex_lock(&mutex);
+	thread_exit = true;
+	pthread_cond_broadcast(&notempty);
+	pthread_mutex_unlock(&mutex);
+
+	// the threads complete the image in progress, and delete it if orphan
+	for (unsigned i = 0; i < thread_mac; ++i)
+		pthread_join(thread_map[i], 0);
+
+	// all the backdrops are already released by the owners
+	assert(queue.empty() && ready.empty());
+
+	pthread_cond_destroy(&notbusy);
+	pthread_cond_destroy(&notempty);
+	pthread_mutex_destroy(&mutex);
 }
 
-// Delete or insert in the cache the backdrop image
-void backdrop_cache::free(backdrop_data* data)
+void* backdrop_loader::thread_func(void* arg)
 {
-	if (data) {
-		if (data->is_active()) {
-			// insert the image in the cache
-			bag.insert(bag.begin(), data);
-		} else {
-			delete data;
-		}
-	}
+	static_cast<backdrop_loader*>(arg)->run();
+	return 0;
 }
 
-backdrop_data* backdrop_cache::alloc(const resource& res, unsigned dx, unsigned dy, unsigned aspectx, unsigned aspecty)
+void backdrop_loader::run()
 {
-	// search in the cache
-	for (list<backdrop_data*>::iterator i = bag.begin(); i != bag.end(); ++i) {
-		if ((*i)->res_get() == res
-			&& dx == (*i)->target_dx_get()
-			&& dy == (*i)->target_dy_get()) {
+	pthread_mutex_lock(&mutex);
 
-			// extract from the cache
-			backdrop_data* data = *i;
+	while (true) {
+		while (!thread_exit && queue.empty())
+			pthread_cond_wait(&notempty, &mutex);
 
-			// remove from the cache
-			bag.erase(i);
+		if (thread_exit)
+			break;
 
-			return data;
-		}
-	}
+		backdrop_data* data = queue.front();
+		dequeue(data);
+		data->state = backdrop_state_loading;
 
-	return new backdrop_data(res, dx, dy, aspectx, aspecty);
-}
+		pthread_mutex_unlock(&mutex);
 
-// -------------------------------------------------------------------------
-// Clip
+		adv_bitmap* bitmap = data->decode(data->req_pos, data->req_background, data->req_aspect_expand, data->req_resizeeffect);
 
-class clip_data {
-	bool active;
-	bool running;
-	bool waiting;
-	resource res;
-	adv_fz* f;
-	target_clock_t wait;
-	unsigned count;
-	adv_mng* mng_context;
+		pthread_mutex_lock(&mutex);
 
-	clip_data();
-	clip_data(const clip_data&);
+		if (data->orphan) {
+			if (bitmap)
+				adv_bitmap_free(bitmap);
+			delete data;
+		} else {
+			data->result = bitmap;
+			data->state = backdrop_state_ready;
+			ready.push_back(data);
+		}
 
-public:
-	clip_data(const resource& Ares);
-	~clip_data();
+		pthread_cond_broadcast(&notbusy);
+	}
 
-	void start();
-	void rewind();
+	pthread_mutex_unlock(&mutex);
 
-	adv_bitmap* load(adv_color_rgb* rgb_map, unsigned* rgb_max);
-	bool is_waiting();
-	bool is_old();
-	bool is_first();
-	bool is_active();
-	const resource& res_get() const { return res; }
-};
+	video_blit_thread_done();
+}
 
-clip_data::clip_data(const resource& Ares)
+// Insert in the queue, the urgent requests after the other urgent ones, called with the mutex locked
+void backdrop_loader::enqueue(backdrop_data* data, bool urgent)
 {
-	f = 0;
-	active = true;
-	running = false;
-	waiting = true;
-	res = Ares;
+	data->urgent = urgent;
+
+	if (urgent) {
+		list<backdrop_data*>::iterator i = queue.begin();
+		for (unsigned j = 0; j < queue_urgent; ++j)
+			++i;
+		queue.insert(i, data);
+		++queue_urgent;
+	} else {
+		queue.push_back(data);
+	}
 }
 
-clip_data::~clip_data()
+// Remove from the queue, called with the mutex locked
+void backdrop_loader::dequeue(backdrop_data* data)
 {
-	if (f) {
-		fzclose(f);
-		adv_mng_done(mng_context);
-	}
+	if (data->urgent)
+		--queue_urgent;
+
+	queue.remove(data);
 }
 
-void clip_data::rewind()
+// Queue the decoding of a backdrop, the load parameters must be already set
+void backdrop_loader::request(backdrop_data* data, bool urgent)
 {
-	if (f) {
-		fzclose(f);
-		adv_mng_done(mng_context);
-		f = 0;
+	data->requested = true;
+
+	pthread_mutex_lock(&mutex);
+
+	if (data->state == backdrop_state_idle) {
+		data->state = backdrop_state_queued;
+		data->pending = true;
+		enqueue(data, urgent);
+		pthread_cond_signal(&notempty);
+	} else if (data->state == backdrop_state_queued && urgent && !data->urgent) {
+		// a prefetch now needed
+		dequeue(data);
+		enqueue(data, true);
 	}
 
-	active = true;
-	running = false;
-	waiting = true;
+	pthread_mutex_unlock(&mutex);
 }
 
-void clip_data::start()
+// Move after the urgent requests a backdrop not anymore displayed
+void backdrop_loader::demote(backdrop_data* data)
 {
-	waiting = false;
+	pthread_mutex_lock(&mutex);
 
-	if (!active)
-		return;
-	if (running)
-		return;
+	if (data->state == backdrop_state_queued && data->urgent) {
+		dequeue(data);
+		enqueue(data, false);
+	}
 
-	running = true;
-	wait = target_clock(); // reset the start time
+	pthread_mutex_unlock(&mutex);
 }
 
-bool clip_data::is_first()
+// Publish a decoded backdrop, called with the mutex locked
+void backdrop_loader::publish(backdrop_data* data)
 {
-	return count == 1;
+	data->map = data->result;
+	data->result = 0;
+	data->state = backdrop_state_done;
+	data->pending = false;
 }
 
-bool clip_data::is_waiting()
+// Wait for the decoding of a backdrop, decoding it directly if not yet started
+void backdrop_loader::wait(backdrop_data* data)
 {
-	return waiting;
+	data->requested = true;
+
+	pthread_mutex_lock(&mutex);
+
+	if (data->state == backdrop_state_idle || data->state == backdrop_state_queued) {
+		if (data->state == backdrop_state_queued)
+			dequeue(data);
+		data->state = backdrop_state_loading;
+
+		pthread_mutex_unlock(&mutex);
+
+		data->result = data->decode(data->req_pos, data->req_background, data->req_aspect_expand, data->req_resizeeffect);
+
+		pthread_mutex_lock(&mutex);
+	} else {
+		while (data->state == backdrop_state_loading)
+			pthread_cond_wait(&notbusy, &mutex);
+
+		if (data->state == backdrop_state_ready)
+			ready.remove(data);
+	}
+
+	if (data->state != backdrop_state_done)
+		publish(data);
+
+	pthread_mutex_unlock(&mutex);
 }
 
-bool clip_data::is_old()
+// Delete a backdrop, if a thread is decoding it, the thread deletes it
+void backdrop_loader::release(backdrop_data* data)
 {
-	if (!active || !running)
-		return false;
+	pthread_mutex_lock(&mutex);
 
-	if (!f || target_clock() > wait)
-		return true;
+	switch (data->state) {
+	case backdrop_state_loading :
+		data->orphan = true;
+		data = 0;
+		break;
+	case backdrop_state_queued :
+		dequeue(data);
+		break;
+	case backdrop_state_ready :
+		ready.remove(data);
+		if (data->result)
+			adv_bitmap_free(data->result);
+		data->result = 0;
+		break;
+	}
 
-	return false;
+	pthread_mutex_unlock(&mutex);
+
+	delete data;
 }
 
-bool clip_data::is_active()
+// Publish all the decoded backdrops, return true if at least one is published
+bool backdrop_loader::publish_all()
 {
-	return active && running;
+	bool any = false;
+
+	pthread_mutex_lock(&mutex);
+
+	while (!ready.empty()) {
+		backdrop_data* data = ready.front();
+		ready.pop_front();
+		publish(data);
+		any = true;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	return any;
 }
 
-adv_bitmap* clip_data::load(adv_color_rgb* rgb_map, unsigned* rgb_max)
+static void backdrop_release(backdrop_loader* loader, backdrop_data* data)
+{
+	if (loader)
+		loader->release(data);
+	else
+		delete data;
+}
+#else
+class backdrop_loader;
+
+static void backdrop_release(backdrop_loader* loader, backdrop_data* data)
+{
+	delete data;
+}
+#endif
+
+// -------------------------------------------------------------------------
+// Cache Index
+
+#define CACHE_BUCKET_MAX 256 // number of hash buckets, a power of 2
+
+// Hash of a resource and of the size of the image
+static unsigned cache_hash(const resource& res, unsigned dx, unsigned dy)
+{
+	const string& path = res.path_get();
+	unsigned h = dx * 31 + dy;
+	for (string::const_iterator i = path.begin(); i != path.end(); ++i)
+		h = h * 31 + (unsigned char)*i;
+	return h;
+}
+
+// Cached objects in LRU order, hashed by resource and size.
+// The objects must have a match(res, dx, dy) method.
+template<class T>
+class cache_index {
+	struct entry_t {
+		T* data;
+		unsigned hash;
+		unsigned size; ///< Bytes accounted for the object.
+	};
+	typedef typename list<entry_t>::iterator iterator;
+
+	list<entry_t> bag; ///< Cached objects, the most recently used first.
+	list<iterator> bucket[CACHE_BUCKET_MAX]; ///< Objects in the bag for every hash.
+	unsigned long total; ///< Sum of the sizes.
+
+	void erase(list<iterator>& chain, typename list<iterator>::iterator j);
+
+public:
+	cache_index() : total(0) { }
+
+	bool empty() const { return bag.empty(); }
+	unsigned long size_get() const { return total; }
+
+	void insert(T* data, unsigned hash, unsigned size);
+	T* extract(unsigned hash, const resource& res, unsigned dx, unsigned dy);
+	T* extract_last();
+};
+
+template<class T>
+void cache_index<T>::erase(list<iterator>& chain, typename list<iterator>::iterator j)
+{
+	iterator i = *j;
+	total -= i->size;
+	chain.erase(j);
+	bag.erase(i);
+}
+
+// Insert an object as the most recently used
+template<class T>
+void cache_index<T>::insert(T* data, unsigned hash, unsigned size)
+{
+	entry_t entry;
+	entry.data = data;
+	entry.hash = hash;
+	entry.size = size;
+
+	bag.push_front(entry);
+	bucket[hash & (CACHE_BUCKET_MAX - 1)].push_front(bag.begin());
+	total += size;
+}
+
+// Remove and return the object with the specified resource and size, 0 if missing
+template<class T>
+T* cache_index<T>::extract(unsigned hash, const resource& res, unsigned dx, unsigned dy)
+{
+	list<iterator>& chain = bucket[hash & (CACHE_BUCKET_MAX - 1)];
+
+	for (typename list<iterator>::iterator j = chain.begin(); j != chain.end(); ++j) {
+		if ((*j)->hash == hash && (*j)->data->match(res, dx, dy)) {
+			T* data = (*j)->data;
+			erase(chain, j);
+			return data;
+		}
+	}
+
+	return 0;
+}
+
+// Remove and return the least recently used object, 0 if empty
+template<class T>
+T* cache_index<T>::extract_last()
+{
+	if (bag.empty())
+		return 0;
+
+	iterator i = bag.end();
+	--i;
+
+	list<iterator>& chain = bucket[i->hash & (CACHE_BUCKET_MAX - 1)];
+	for (typename list<iterator>::iterator j = chain.begin(); j != chain.end(); ++j) {
+		if (*j == i) {
+			T* data = i->data;
+			erase(chain, j);
+			return data;
+		}
+	}
+
+	return 0;
+}
+
+// -------------------------------------------------------------------------
+// Backdrop Cache
+
+class backdrop_cache {
+	unsigned long max; ///< Max memory used by the cached images, in bytes.
+	cache_index<backdrop_data> index;
+	backdrop_loader* loader;
+public:
+	backdrop_cache(unsigned long Amax, backdrop_loader* Aloader);
+	~backdrop_cache();
+
+	void reduce();
+	void free(backdrop_data* data);
+	backdrop_data* alloc(const resource& res, unsigned dx, unsigned dy, unsigned aspectx, unsigned aspecty);
+};
+
+backdrop_cache::backdrop_cache(unsigned long Amax, backdrop_loader* Aloader)
+{
+	max = Amax;
+	loader = Aloader;
+}
+
+backdrop_cache::~backdrop_cache()
+{
+	backdrop_data* data;
+	while ((data = index.extract_last()) != 0)
+		backdrop_release(loader, data);
+}
+
+// Reduce the size of the cache
+void backdrop_cache::reduce()
+{
+	// limit the cache size, starting from the least recently used
+	while (index.size_get() > max) {
+		backdrop_data* data = index.extract_last();
+		if (!data)
+			break;
+		backdrop_release(loader, data);
+	}
+}
+
+// Delete or insert in the cache the backdrop image
+void backdrop_cache::free(backdrop_data* data)
+{
+	if (data) {
+		if (data->is_active() || data->is_pending()) {
+#ifdef USE_SMP
+			// not anymore displayed, don't load it before the others
+			if (data->is_pending())
+				loader->demote(data);
+#endif
+			// insert the image in the cache, also if still loading
+			// with the size estimated from the target size
+			index.insert(data, cache_hash(data->res_get(), data->target_dx_get(), data->target_dy_get()), data->size_get());
+		} else {
+			backdrop_release(loader, data);
+		}
+	}
+}
+
+backdrop_data* backdrop_cache::alloc(const resource& res, unsigned dx, unsigned dy, unsigned aspectx, unsigned aspecty)
+{
+	// search in the cache
+	backdrop_data* data = index.extract(cache_hash(res, dx, dy), res, dx, dy);
+	if (data)
+		return data;
+
+	return new backdrop_data(res, dx, dy, aspectx, aspecty);
+}
+
+// -------------------------------------------------------------------------
+// Clip
+
+#define CLIP_AHEAD 4 // number of frames decoded in advance
+#define CLIP_FILM_MAX (4*1024*1024) // max memory used to keep a whole clip and loop from it, in bytes
+#define CLIP_MEMORY_MAX (16*1024*1024) // max memory used by the decoded frames of all the clips, in bytes
+
+// Decoded frame, with its own copy of the pixels.
+// The MNG context applies the delta frames in its image, that is
+// overwritten by the next read, so every frame is copied out of it.
+struct clip_frame {
+	adv_bitmap* bitmap;
+	adv_color_rgb rgb_map[256];
+	unsigned rgb_max;
+	target_clock_t delay; ///< Time to display the frame.
+};
+
+// Memory used by all the decoded frames, in the films, decoded in advance or displayed.
+// The frames are allocated by the loader threads and freed by the main thread.
+static unsigned long clip_memory;
+#ifdef USE_SMP
+static pthread_mutex_t clip_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned long clip_bitmap_size(const adv_bitmap* bitmap)
+{
+	return bitmap->size_y * bitmap->bytes_per_scanline;
+}
+
+static void clip_memory_inc(unsigned long size)
+{
+#ifdef USE_SMP
+	pthread_mutex_lock(&clip_memory_mutex);
+#endif
+	clip_memory += size;
+#ifdef USE_SMP
+	pthread_mutex_unlock(&clip_memory_mutex);
+#endif
+}
+
+static void clip_memory_dec(unsigned long size)
+{
+#ifdef USE_SMP
+	pthread_mutex_lock(&clip_memory_mutex);
+#endif
+	clip_memory -= size;
+#ifdef USE_SMP
+	pthread_mutex_unlock(&clip_memory_mutex);
+#endif
+}
+
+// Check if the decoded frames use all the memory allowed
+static bool clip_memory_is_full()
+{
+#ifdef USE_SMP
+	pthread_mutex_lock(&clip_memory_mutex);
+#endif
+	bool full = clip_memory > CLIP_MEMORY_MAX;
+#ifdef USE_SMP
+	pthread_mutex_unlock(&clip_memory_mutex);
+#endif
+	return full;
+}
+
+static void clip_bitmap_free(adv_bitmap* bitmap)
+{
+	clip_memory_dec(clip_bitmap_size(bitmap));
+	adv_bitmap_free(bitmap);
+}
+
+static void clip_frame_free(list<clip_frame>& frame_list)
+{
+	for (list<clip_frame>::iterator i = frame_list.begin(); i != frame_list.end(); ++i)
+		clip_bitmap_free(i->bitmap);
+	frame_list.clear();
+}
+
+class clip_loader;
+
+class clip_data {
+	bool active;
+	bool running;
+	bool waiting;
+	resource res;
+	target_clock_t wait;
+	unsigned count;
+
+	// Decoder, when queued or decoding accessed only by the loader thread
+	adv_fz* f;
+	adv_mng* mng_context;
+
+	// Accessed with the loader mutex
+	list<clip_frame> ahead; ///< Frames decoded and not yet displayed.
+	bool ended; ///< The decoder reached the end of the clip.
+	int ended_result; ///< Result of the last decoding, 1 at the end, -1 if the clip cannot be read.
+
+	// Accessed only by the main thread
+	list<clip_frame> film; ///< Frames displayed, kept to loop from memory.
+	list<clip_frame>::iterator film_pos; ///< Next frame to display from the film.
+	unsigned long film_size; ///< Memory used by the film.
+	bool film_keep; ///< The frames displayed are kept in the film.
+	bool film_fit; ///< The whole clip fits in CLIP_FILM_MAX.
+	bool film_done; ///< The film contains the whole clip.
+	adv_bitmap* shown; ///< Frame displayed and not kept in the film.
+
+	clip_loader* loader;
+#ifdef USE_SMP
+	friend class clip_loader;
+
+	// Accessed with the loader mutex
+	bool queued; ///< In the request queue.
+	bool busy; ///< Decoded by a thread.
+	bool orphan; ///< Released while decoding, the loader thread deletes it.
+#endif
+
+	clip_data();
+	clip_data(const clip_data&);
+
+	int decode(clip_frame& frame);
+	void decode_close();
+	int next(clip_frame& frame);
+	bool is_ready();
+	void prefetch();
+
+public:
+	clip_data(const resource& Ares, clip_loader* Aloader);
+	~clip_data();
+
+	void start();
+	void rewind();
+
+	adv_bitmap* load(adv_color_rgb* rgb_map, unsigned* rgb_max);
+	bool is_waiting();
+	bool is_old();
+	bool is_first();
+	bool is_active();
+	const resource& res_get() const { return res; }
+	bool match(const resource& Ares, unsigned dx, unsigned dy) const { return res == Ares; }
+};
+
+#ifdef USE_SMP
+// -------------------------------------------------------------------------
+// Clip Loader
+
+#define CLIP_THREAD_MAX 2 // max number of loader threads
+
+// Pool of threads decoding the clips in advance.
+// Every clip in the queue gets one frame at time, and it's queued
+// again at the end until it has CLIP_AHEAD frames ready, so all the
+// clips of a multiclip layout are decoded at the same rate.
+// When the frames of all the clips use CLIP_MEMORY_MAX, only the frame
+// needed next is decoded.
+class clip_loader {
+	pthread_mutex_t mutex;
+	pthread_cond_t notempty; ///< Signaled when a request is queued.
+	pthread_cond_t notbusy; ///< Signaled when a frame is decoded.
+	pthread_t thread_map[CLIP_THREAD_MAX];
+	unsigned thread_mac;
+	bool thread_exit;
+
+	list<clip_data*> queue; ///< Clips to decode.
+
+	static void* thread_func(void* arg);
+	void run();
+
+public:
+	clip_loader();
+	~clip_loader();
+
+	bool is_active() const { return thread_mac != 0; }
+
+	void request(clip_data* data);
+	void cancel(clip_data* data);
+	int next(clip_data* data, clip_frame& frame);
+	bool is_ready(clip_data* data);
+	void release(clip_data* data);
+};
+
+clip_loader::clip_loader()
+{
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&notempty, 0);
+	pthread_cond_init(&notbusy, 0);
+	thread_exit = false;
+
+	// keep one processor for the user interface
+	long cpu = 2;
+#ifdef _SC_NPROCESSORS_ONLN
+	cpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	unsigned max = cpu > 2 ? cpu - 1 : 1;
+	if (max > CLIP_THREAD_MAX)
+		max = CLIP_THREAD_MAX;
+
+	for (thread_mac = 0; thread_mac < max; ++thread_mac) {
+		if (pthread_create(&thread_map[thread_mac], 0, thread_func, this) != 0) {
+			log_std(("ERROR:text: error calling pthread_create()\n"));
+			break;
+		}
+	}
+
+	log_std(("text: clip loader with %u threads\n", thread_mac));
+}
+
+clip_loader::~clip_loader()
+{
+	pthread_mutex_lock(&mutex);
+	thread_exit = true;
+	pthread_cond_broadcast(&notempty);
+	pthread_mutex_unlock(&mutex);
+
+	// the threads complete the frame in progress, and delete the clip if orphan
+	for (unsigned i = 0; i < thread_mac; ++i)
+		pthread_join(thread_map[i], 0);
+
+	// all the clips are already released by the owners
+	assert(queue.empty());
+
+	pthread_cond_destroy(&notbusy);
+	pthread_cond_destroy(&notempty);
+	pthread_mutex_destroy(&mutex);
+}
+
+void* clip_loader::thread_func(void* arg)
+{
+	static_cast<clip_loader*>(arg)->run();
+	return 0;
+}
+
+void clip_loader::run()
+{
+	pthread_mutex_lock(&mutex);
+
+	while (true) {
+		while (!thread_exit && queue.empty())
+			pthread_cond_wait(&notempty, &mutex);
+
+		if (thread_exit)
+			break;
+
+		clip_data* data = queue.front();
+		queue.pop_front();
+		data->queued = false;
+		data->busy = true;
+
+		pthread_mutex_unlock(&mutex);
+
+		clip_frame frame;
+		int r = data->decode(frame);
+
+		pthread_mutex_lock(&mutex);
+
+		data->busy = false;
+
+		if (data->orphan) {
+			if (r == 0)
+				clip_bitmap_free(frame.bitmap);
+			delete data;
+		} else if (r == 0) {
+			data->ahead.push_back(frame);
+			if (data->ahead.size() < CLIP_AHEAD && !clip_memory_is_full()) {
+				data->queued = true;
+				queue.push_back(data);
+			}
+		} else {
+			data->ended = true;
+			data->ended_result = r;
+		}
+
+		pthread_cond_broadcast(&notbusy);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+// Queue the decoding of the next frames of a clip
+void clip_loader::request(clip_data* data)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (!data->queued && !data->busy && !data->ended && data->ahead.size() < CLIP_AHEAD && !clip_memory_is_full()) {
+		data->queued = true;
+		queue.push_back(data);
+		pthread_cond_signal(&notempty);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+// Stop the decoding of a clip, after it the decoder can be used by the caller
+void clip_loader::cancel(clip_data* data)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (data->queued) {
+		queue.remove(data);
+		data->queued = false;
+	}
+
+	while (data->busy)
+		pthread_cond_wait(&notbusy, &mutex);
+
+	pthread_mutex_unlock(&mutex);
+}
+
+// Get the next frame of a clip, waiting for it if not yet decoded
+int clip_loader::next(clip_data* data, clip_frame& frame)
+{
+	int r;
+
+	pthread_mutex_lock(&mutex);
+
+	if (data->ahead.empty() && !data->ended && !data->queued && !data->busy) {
+		data->queued = true;
+		queue.push_back(data);
+		pthread_cond_signal(&notempty);
+	}
+
+	while (data->ahead.empty() && !data->ended)
+		pthread_cond_wait(&notbusy, &mutex);
+
+	if (!data->ahead.empty()) {
+		frame = data->ahead.front();
+		data->ahead.pop_front();
+		r = 0;
+
+		// decode the frame that takes the free place
+		if (!data->queued && !data->busy && !data->ended && !clip_memory_is_full()) {
+			data->queued = true;
+			queue.push_back(data);
+			pthread_cond_signal(&notempty);
+		}
+	} else {
+		// the next request restarts the decoding
+		r = data->ended_result;
+		data->ended = false;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	return r;
+}
+
+// Check if the next frame of a clip is already decoded
+bool clip_loader::is_ready(clip_data* data)
+{
+	pthread_mutex_lock(&mutex);
+
+	bool ready = !data->ahead.empty() || data->ended;
+
+	pthread_mutex_unlock(&mutex);
+
+	return ready;
+}
+
+// Delete a clip, if a thread is decoding it, the thread deletes it
+void clip_loader::release(clip_data* data)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (data->busy) {
+		data->orphan = true;
+		data = 0;
+	} else if (data->queued) {
+		queue.remove(data);
+		data->queued = false;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	delete data;
+}
+
+static void clip_release(clip_loader* loader, clip_data* data)
+{
+	if (loader)
+		loader->release(data);
+	else
+		delete data;
+}
+#else
+static void clip_release(clip_loader* loader, clip_data* data)
+{
+	delete data;
+}
+#endif
+
+// -------------------------------------------------------------------------
+// Clip Data
+
+clip_data::clip_data(const resource& Ares, clip_loader* Aloader)
+{
+	f = 0;
+	mng_context = 0;
+	active = true;
+	running = false;
+	waiting = true;
+	res = Ares;
+	count = 0;
+	ended = false;
+	ended_result = 0;
+	film_size = 0;
+	film_keep = true;
+	film_fit = true;
+	film_done = false;
+	film_pos = film.end();
+	shown = 0;
+	loader = Aloader;
+#ifdef USE_SMP
+	queued = false;
+	busy = false;
+	orphan = false;
+#endif
+
+	// start to decode before the clip is started
+	prefetch();
+}
+
+clip_data::~clip_data()
+{
+	decode_close();
+	clip_frame_free(ahead);
+	clip_frame_free(film);
+	if (shown)
+		clip_bitmap_free(shown);
+}
+
+// Start to decode the next frames in background
+void clip_data::prefetch()
+{
+#ifdef USE_SMP
+	// a whole film is replayed from memory, the decoder isn't used
+	if (loader && !film_done)
+		loader->request(this);
+#endif
+}
+
+void clip_data::decode_close()
+{
+	if (f) {
+		adv_mng_done(mng_context);
+		fzclose(f);
+		f = 0;
+	}
+}
+
+// Decode the next frame, return 1 at the end of the clip, -1 if the clip cannot be read
+int clip_data::decode(clip_frame& frame)
 {
-	if (!active)
-		return 0;
-
 	if (!f) {
-		// first load
 		f = res.open();
-		if (!f) {
-			active = false;
-			f = 0;
-			return 0;
-		}
+		if (!f)
+			return -1;
 
 		mng_context = adv_mng_init(f);
 		if (mng_context == 0) {
 			fzclose(f);
 			f = 0;
-			active = false;
-			return 0;
+			return -1;
 		}
-
-		wait = target_clock();
-		count = 0;
 	}
 
 	unsigned pix_width;
@@ -1906,29 +2946,209 @@ adv_bitmap* clip_data::load(adv_color_rgb* rgb_map, unsigned* rgb_max)
 
 	int r = adv_mng_read(mng_context, &pix_width, &pix_height, &pix_pixel, &dat_ptr, &dat_size, &pix_ptr, &pix_scanline, &pal_ptr, &pal_size, &tick, f);
 	if (r != 0) {
-		adv_mng_done(mng_context);
-		fzclose(f);
-		f = 0;
-		running = false;
-		return 0;
+		decode_close();
+		return 1;
 	}
 
 	double delay = tick / (double)adv_mng_frequency_get(mng_context);
 
-	adv_bitmap* bitmap = adv_bitmap_import_palette(rgb_map, rgb_max, pix_width, pix_height, pix_pixel, dat_ptr, dat_size, pix_ptr, pix_scanline, pal_ptr, pal_size);
+	adv_bitmap* bitmap = adv_bitmap_import_palette(frame.rgb_map, &frame.rgb_max, pix_width, pix_height, pix_pixel, dat_ptr, dat_size, pix_ptr, pix_scanline, pal_ptr, pal_size);
 	if (!bitmap) {
 		free(dat_ptr);
 		free(pal_ptr);
-		adv_mng_done(mng_context);
-		fzclose(f);
-		f = 0;
-		active = false;
-		return 0;
+		decode_close();
+		return -1;
 	}
 
 	free(pal_ptr);
 
-	wait += (target_clock_t)(delay * TARGET_CLOCKS_PER_SEC);
+	frame.bitmap = adv_bitmap_dup(bitmap);
+	adv_bitmap_free(bitmap);
+	if (!frame.bitmap) {
+		decode_close();
+		return -1;
+	}
+
+	clip_memory_inc(clip_bitmap_size(frame.bitmap));
+
+	frame.delay = (target_clock_t)(delay * TARGET_CLOCKS_PER_SEC);
+
+	return 0;
+}
+
+// Get the next frame from the decoder
+int clip_data::next(clip_frame& frame)
+{
+#ifdef USE_SMP
+	if (loader)
+		return loader->next(this, frame);
+#endif
+	return decode(frame);
+}
+
+// Check if the next frame is available without waiting
+bool clip_data::is_ready()
+{
+#ifdef USE_SMP
+	if (loader && !film_done)
+		return loader->is_ready(this);
+#endif
+	return true;
+}
+
+void clip_data::rewind()
+{
+#ifdef USE_SMP
+	if (loader)
+		loader->cancel(this);
+#endif
+
+	// a whole film is replayed, otherwise restart from the file
+	if (!film_done) {
+		decode_close();
+		clip_frame_free(ahead);
+		ended = false;
+		clip_frame_free(film);
+		film_size = 0;
+	}
+	film_pos = film.begin();
+	film_keep = film_fit;
+
+	if (shown) {
+		clip_bitmap_free(shown);
+		shown = 0;
+	}
+
+	count = 0;
+	active = true;
+	running = false;
+	waiting = true;
+
+	prefetch();
+}
+
+void clip_data::start()
+{
+	waiting = false;
+
+	if (!active)
+		return;
+	if (running)
+		return;
+
+	running = true;
+	wait = target_clock(); // reset the start time
+}
+
+bool clip_data::is_first()
+{
+	return count == 1;
+}
+
+bool clip_data::is_waiting()
+{
+	return waiting;
+}
+
+bool clip_data::is_old()
+{
+	if (!active || !running)
+		return false;
+
+	if (count == 0 || target_clock() > wait)
+		return is_ready();
+
+	return false;
+}
+
+bool clip_data::is_active()
+{
+	return active && running;
+}
+
+adv_bitmap* clip_data::load(adv_color_rgb* rgb_map, unsigned* rgb_max)
+{
+	if (!active)
+		return 0;
+
+	// the previous frame is already drawn
+	if (shown) {
+		clip_bitmap_free(shown);
+		shown = 0;
+	}
+
+	if (count == 0)
+		wait = target_clock();
+
+	clip_frame* frame;
+	clip_frame decoded;
+
+	if (film_done) {
+		if (film_pos == film.end()) {
+			// loop from memory at the next start
+			film_pos = film.begin();
+			count = 0;
+			running = false;
+			return 0;
+		}
+
+		frame = &*film_pos;
+		++film_pos;
+	} else {
+		int r = next(decoded);
+		if (r < 0) {
+			clip_frame_free(film);
+			film_size = 0;
+			active = false;
+			return 0;
+		}
+
+		if (r > 0) {
+			if (film_keep && !film.empty()) {
+				log_std(("text: clip '%s' kept in memory, %lu frames, %lu bytes\n", res.path_get().c_str(), (unsigned long)film.size(), film_size));
+				film_done = true;
+				film_pos = film.begin();
+			} else {
+				// restart from the file, and start to decode it
+				film_keep = film_fit;
+				prefetch();
+			}
+			count = 0;
+			running = false;
+			return 0;
+		}
+
+		frame = &decoded;
+
+		if (film_keep) {
+			unsigned long size = clip_bitmap_size(decoded.bitmap);
+			if (film_size + size > CLIP_FILM_MAX) {
+				// too big, never keep it
+				clip_frame_free(film);
+				film_size = 0;
+				film_keep = false;
+				film_fit = false;
+			} else if (clip_memory_is_full()) {
+				// no memory for it, retry at the next pass
+				clip_frame_free(film);
+				film_size = 0;
+				film_keep = false;
+			} else {
+				film.push_back(decoded);
+				film_size += size;
+				frame = &film.back();
+			}
+		}
+
+		if (!film_keep)
+			shown = decoded.bitmap;
+	}
+
+	for (unsigned i = 0; i < frame->rgb_max; ++i)
+		rgb_map[i] = frame->rgb_map[i];
+	*rgb_max = frame->rgb_max;
+
+	wait += frame->delay;
 
 	// limit the late time to 1/10 second
 	if (target_clock() - wait > TARGET_CLOCKS_PER_SEC / 10)
@@ -1936,7 +3156,7 @@ adv_bitmap* clip_data::load(adv_color_rgb* rgb_map, unsigned* rgb_max)
 
 	++count;
 
-	return bitmap;
+	return frame->bitmap;
 }
 
 // -------------------------------------------------------------------------
@@ -1944,9 +3164,10 @@ adv_bitmap* clip_data::load(adv_color_rgb* rgb_map, unsigned* rgb_max)
 
 class clip_cache {
 	unsigned max;
-	list<clip_data*> bag;
+	cache_index<clip_data> index;
+	clip_loader* loader;
 public:
-	clip_cache(unsigned Amax);
+	clip_cache(unsigned Amax, clip_loader* Aloader);
 	~clip_cache();
 
 	void reduce();
@@ -1954,60 +3175,48 @@ public:
 	clip_data* alloc(const resource& res);
 };
 
-clip_cache::clip_cache(unsigned Amax)
+clip_cache::clip_cache(unsigned Amax, clip_loader* Aloader)
 {
 	max = Amax;
+	loader = Aloader;
 }
 
 clip_cache::~clip_cache()
 {
-	for (list<clip_data*>::iterator i = bag.begin(); i != bag.end(); ++i) {
-		clip_data* data = *i;
-		delete data;
-	}
+	reduce();
 }
 
 // Reduce the size of the cache
 void clip_cache::reduce()
 {
-	// limit the cache size
-	while (bag.size() > 0) {
-		list<clip_data*>::iterator i = bag.end();
-		--i;
-		clip_data* data = *i;
-		bag.erase(i);
-		delete data;
-	}
+	// the clips keep the file open, don't keep them
+	clip_data* data;
+	while ((data = index.extract_last()) != 0)
+		clip_release(loader, data);
 }
 
-// Delete or insert in the cache the backdrop image
+// Delete or insert in the cache the clip
 void clip_cache::free(clip_data* data)
 {
 	if (data) {
-		if (max)
-			bag.insert(bag.begin(), data);
-		else
-			delete data;
+		if (max) {
+			// keep all the clip state, the clips not displayed
+			// again are released by reduce() after the update
+			index.insert(data, cache_hash(data->res_get(), 0, 0), 0);
+		} else {
+			clip_release(loader, data);
+		}
 	}
 }
 
 clip_data* clip_cache::alloc(const resource& res)
 {
 	// search in the cache
-	for (list<clip_data*>::iterator i = bag.begin(); i != bag.end(); ++i) {
-		if ((*i)->res_get() == res) {
-
-			// extract from the cache
-			clip_data* data = *i;
+	clip_data* data = index.extract(cache_hash(res, 0, 0), res, 0, 0);
+	if (data)
+		return data;
 
-			// remove from the cache
-			bag.erase(i);
-
-			return data;
-		}
-	}
-
-	return new clip_data(res);
+	return new clip_data(res, loader);
 }
 
 //---------------------------------------------------------------------------
@@ -2029,6 +3238,10 @@ struct cell_t {
 class cell_manager {
 	class backdrop_cache* int_backdrop_cache;
 	class clip_cache* int_clip_cache;
+#ifdef USE_SMP
+	class backdrop_loader* int_loader;
+	class clip_loader* int_clip_loader;
+#endif
 
 	unsigned backdrop_mac;
 
@@ -2051,6 +3264,7 @@ class cell_manager {
 	target_clock_t backdrop_box_last;
 
 	bool idle_update(int index);
+	bool idle_publish();
 
 	unsigned idle_iterator;
 
@@ -2069,6 +3283,7 @@ public:
 	void backdrop_box();
 	bool is_box_flashing();
 	void backdrop_redraw_all();
+	void backdrop_prefetch(int index, const resource& res, unsigned aspectx, unsigned aspecty);
 
 	void clip_set(int index, const resource& res, unsigned aspectx, unsigned aspecty, bool restart);
 	void clip_clear(int index);
@@ -2094,13 +3309,33 @@ cell_manager::cell_manager(const int_color& Abackdrop_missing_color, const int_c
 	backdrop_expand_factor = expand_factor;
 	backdrop_mac = Amac;
 
-	int_backdrop_cache = new backdrop_cache(backdrop_mac * 2 + Ainc + 1);
+#ifdef USE_SMP
+	int_loader = new backdrop_loader();
+	if (!int_loader->is_active()) {
+		delete int_loader;
+		int_loader = 0;
+	}
+
+	int_backdrop_cache = new backdrop_cache(int_backdrop_cache_size, int_loader);
+
+	int_clip_loader = new clip_loader();
+	if (!int_clip_loader->is_active()) {
+		delete int_clip_loader;
+		int_clip_loader = 0;
+	}
+
+	clip_loader* cloader = int_clip_loader;
+#else
+	int_backdrop_cache = new backdrop_cache(int_backdrop_cache_size, 0);
+
+	clip_loader* cloader = 0;
+#endif
 
 	multiclip = Amulticlip;
 	if (multiclip)
-		int_clip_cache = new clip_cache(backdrop_mac);
+		int_clip_cache = new clip_cache(backdrop_mac, cloader);
 	else
-		int_clip_cache = new clip_cache(0);
+		int_clip_cache = new clip_cache(0, cloader);
 
 	resizeeffect = Aresizeeffect;
 
@@ -2117,12 +3352,20 @@ cell_manager::cell_manager(const int_color& Abackdrop_missing_color, const int_c
 
 cell_manager::~cell_manager()
 {
+#ifdef USE_SMP
+	backdrop_loader* loader = int_loader;
+	clip_loader* cloader = int_clip_loader;
+#else
+	backdrop_loader* loader = 0;
+	clip_loader* cloader = 0;
+#endif
+
 	for (int i = 0; i < backdrop_mac; ++i) {
 		if (backdrop_map[i].data)
-			delete backdrop_map[i].data;
+			backdrop_release(loader, backdrop_map[i].data);
 		backdrop_map[i].data = 0;
 		if (backdrop_map[i].cdata)
-			delete backdrop_map[i].cdata;
+			clip_release(cloader, backdrop_map[i].cdata);
 		backdrop_map[i].cdata = 0;
 	}
 
@@ -2131,6 +3374,15 @@ cell_manager::~cell_manager()
 
 	delete int_clip_cache;
 	int_clip_cache = 0;
+
+#ifdef USE_SMP
+	// after all the backdrops and clips are released
+	delete int_loader;
+	int_loader = 0;
+
+	delete int_clip_loader;
+	int_clip_loader = 0;
+#endif
 }
 
 void cell_manager::backdrop_redraw_all()
@@ -2261,6 +3513,19 @@ void cell_manager::backdrop_update(int index)
 
 	assert(index >= 0 && index < backdrop_mac);
 
+#ifdef USE_SMP
+	if (int_loader) {
+		int_loader->publish_all();
+
+		if (back->data && !back->data->is_active()) {
+			back->data->prepare(back->pos, backdrop_missing_color.background, backdrop_expand_factor, resizeeffect);
+			if (int_wait_for_backdrop)
+				int_loader->wait(back->data);
+			else
+				int_loader->request(back->data, true);
+		}
+	} else
+#endif
 	if (back->data) {
 		if (!fast_exit_handler())
 			back->data->load(&back->pos, backdrop_missing_color.background, backdrop_expand_factor, resizeeffect);
@@ -2285,6 +3550,36 @@ void cell_manager::backdrop_update(int index)
 	}
 }
 
+// Start to load in background an image that will be displayed in the cell
+void cell_manager::backdrop_prefetch(int index, const resource& res, unsigned aspectx, unsigned aspecty)
+{
+#ifdef USE_SMP
+	struct cell_t* back = backdrop_map + index;
+
+	assert(index >= 0 && index < backdrop_mac);
+
+	if (!int_loader)
+		return;
+
+	// skip if already in a cell
+	for (int i = 0; i < backdrop_mac; ++i) {
+		backdrop_data* data = backdrop_map[i].data;
+		if (data && data->res_get() == res && data->target_dx_get() == back->pos.dx && data->target_dy_get() == back->pos.dy)
+			return;
+	}
+
+	backdrop_data* data = int_backdrop_cache->alloc(res, back->pos.dx, back->pos.dy, aspectx, aspecty);
+
+	if (!data->is_active()) {
+		data->prepare(back->pos, backdrop_missing_color.background, backdrop_expand_factor, resizeeffect);
+		int_loader->request(data, false);
+	}
+
+	// put it back in the cache
+	int_backdrop_cache->free(data);
+#endif
+}
+
 void cell_manager::reduce()
 {
 	if (int_backdrop_cache)
@@ -2323,18 +3618,45 @@ bool cell_manager::idle_update(int index)
 
 	cell->pos.redraw();
 
-	adv_bitmap_free(bitmap);
-
 	// ensure to fill the audio buffer
 	play_poll();
 
 	return true;
 }
 
+// Draw the backdrops decoded in background
+bool cell_manager::idle_publish()
+{
+#ifdef USE_SMP
+	if (!int_loader || !int_loader->publish_all())
+		return false;
+
+	for (int i = 0; i < backdrop_mac; ++i) {
+		cell_t* cell = backdrop_map + i;
+
+		// the clip, if playing, has the precedence
+		if (cell->cdata && cell->cdata->is_active())
+			continue;
+
+		if (cell->redraw && cell->data && cell->data->bitmap_get()) {
+			backdrop_update(i);
+
+			cell->pos.redraw();
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
 bool cell_manager::idle()
 {
 	bool late = false;
 
+	idle_publish();
+
 	if (multiclip) {
 		int highlight_index = -1;
 
@@ -2485,6 +3807,12 @@ void int_backdrop_set(int index, const resource& res, bool highlight, unsigned a
 	int_cell->backdrop_set(index, res, highlight, aspectx, aspecty);
 }
 
+void int_backdrop_prefetch(int index, const resource& res, unsigned aspectx, unsigned aspecty)
+{
+	if (int_cell)
+		int_cell->backdrop_prefetch(index, res, aspectx, aspecty);
+}
+
 void int_backdrop_redraw_all()
 {
 	if (int_cell)
@@ -2555,6 +3883,8 @@ void int_put(font_t font, int x, int y, char c, const int_color& color)
 		assert(x >= 0 && y >= 0 && x + src->size_x <= video_size_x() && y + src->size_y <= video_size_y());
 
 		adv_font_put_char_map(int_font[font], video_foreground_bitmap, x, y, c, color.opaque);
+
+		int_damage(x, y, src->size_x, src->size_y);
 	}
 }
 
@@ -2583,6 +3913,8 @@ void int_put_alpha(font_t font, int x, int y, char c, const int_color& color)
 		} else {
 			adv_font_put_char_map(int_font[font], video_foreground_bitmap, x, y, c, color.opaque);
 		}
+
+		int_damage(x, y, src->size_x, src->size_y);
 	}
 }
 
@@ -2747,6 +4079,8 @@ void int_clear(const adv_color_rgb& cbackground, const adv_color_rgb& coverscan)
 
 	adv_bitmap_clear(video_foreground_bitmap, 0, 0, video_size_x(), video_size_y(), overscan);
 	adv_bitmap_clear(video_background_bitmap, 0, 0, video_size_x(), video_size_y(), background);
+
+	int_damage_all();
 }
 
 void int_box(int x, int y, int dx, int dy, int width, const adv_color_rgb& color)
@@ -2950,6 +4284,7 @@ void int_image_buffer(adv_bitmap* bitmap, adv_color_rgb* rgb_map, unsigned rgb_m
 
 	// copy also into the foreground
 	memcpy(video_foreground_buffer, video_background_buffer, video_buffer_size);
+	int_damage_all();
 
 	// invalidate all the backdrop if any
 	int_backdrop_redraw_all();
@@ -2987,6 +4322,9 @@ void int_image_direct(adv_bitmap* bitmap, adv_color_rgb* rgb_map, unsigned rgb_m
 	video_display_set(0, 0);
 
 	video_pipeline_done(&pipeline);
+
+	// the video memory doesn't match the foreground buffer anymore
+	int_damage_all();
 }
 
 bool int_image(const string& file, unsigned& scale_x, unsigned& scale_y)
@@ -3109,6 +4447,11 @@ void int_idle_2_enable(bool state, unsigned delay)
 	int_idle_2 = delay;
 }
 
+void int_rescan_enable(bool state)
+{
+	int_rescan_state = state;
+}
+
 static void int_idle()
 {
 	target_clock_t now = target_clock() / 1000000;
@@ -3153,6 +4496,13 @@ static void int_idle()
 		}
 	}
 
+	if (int_rescan_state) {
+		if (watch_poll()) {
+			log_std(("text: push RESCAN\n"));
+			event_push_repeat(EVENT_RESCAN);
+		}
+	}
+
 	if (event_peek() == EVENT_NONE) {
 		if (int_updating_active) {
 			if (int_cell) {
@@ -3227,9 +4577,11 @@ bool int_event_waiting()
 	}
 
 	if (event_peek() != EVENT_NONE) {
-		// something happened, restart the timers
-		int_idle_time_current = target_clock() / 1000000;
-		joy_idle_time = now;
+		// something happened, restart the timers, but not for a directory change
+		if (event_peek() != EVENT_RESCAN) {
+			int_idle_time_current = target_clock() / 1000000;
+			joy_idle_time = now;
+		}
 		return 1;
 	}
 
@@ -3260,6 +4612,12 @@ unsigned int_event_get(bool update_background)
 	}
 #endif
 
-	return int_last = event_pop();
+	unsigned event = event_pop();
+
+	// a directory change doesn't break the sequence of idle events
+	if (event != EVENT_RESCAN)
+		int_last = event;
+
+	return event;
 }
 
@@ -97,6 +97,9 @@ void int_backdrop_set(int index, const resource& res, bool highlight, unsigned a
 void int_backdrop_clear(int index, bool highlight);
 void int_backdrop_redraw_all();
 
+#define INT_BACKDROP_PREFETCH_MAX 4 ///< Max number of backdrops to prefetch in a single list
+void int_backdrop_prefetch(int index, const resource& res, unsigned aspectx, unsigned aspecty);
+
 bool int_clip(const std::string& file, bool loop);
 void int_clip_set(int index, const resource& res, unsigned aspectx, unsigned aspecty, bool restart);
 void int_clip_clear(int index);
@@ -114,6 +117,7 @@ void int_idle_time_reset();
 void int_idle_0_enable(bool state);
 void int_idle_1_enable(bool state);
 void int_idle_2_enable(bool state, unsigned delay);
+void int_rescan_enable(bool state);
 
 int int_font_dx_get(font_t font);
 int int_font_dx_get(font_t font, const std::string& s);
@@ -0,0 +1,222 @@
+/*
+ * This file is part of the Advance project.
+ *
+ * Copyright (C) 2009 Andrea Mazzoleni
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "portable.h"
+
+#include "watch.h"
+#include "common.h"
+
+#include "advance.h"
+
+#include <map>
+
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+using namespace std;
+
+/**
+ * Seconds without notifications before reporting the changes.
+ * A file copy generates many notifications, and a copy of many
+ * files is processed all together.
+ */
+#define WATCH_SETTLE 2
+
+/**
+ * Minimum seconds between two reports of the same pending changes.
+ * The report is only a request, and it's lost if it arrives when
+ * the menu isn't able to process it.
+ */
+#define WATCH_REPEAT 1
+
+static int watch_fd = -1; ///< Notification handle.
+static map<int, string> watch_map; ///< Directory of every watch descriptor.
+static watch_change_container watch_bag; ///< Pending changes.
+static bool watch_overflow; ///< Some changes were lost.
+static target_clock_t watch_last; ///< Time of the last notification.
+static target_clock_t watch_report; ///< Time of the last report.
+
+#if HAVE_SYS_INOTIFY_H
+
+bool watch_init()
+{
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch_fd < 0) {
+		log_std(("menu:watch: inotify_init1() failed, %s\n", strerror(errno)));
+		return false;
+	}
+
+	watch_map.clear();
+	watch_bag.clear();
+	watch_overflow = false;
+	watch_last = 0;
+	watch_report = 0;
+
+	return true;
+}
+
+void watch_done()
+{
+	if (watch_fd >= 0) {
+		close(watch_fd);
+		watch_fd = -1;
+	}
+
+	watch_map.clear();
+	watch_bag.clear();
+}
+
+bool watch_insert(const string& dir)
+{
+	if (watch_fd < 0)
+		return false;
+
+	int wd = inotify_add_watch(watch_fd, cpath_export(slash_remove(dir)), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR);
+	if (wd < 0) {
+		log_std(("menu:watch: failed watching %s, %s\n", cpath_export(dir), strerror(errno)));
+		return false;
+	}
+
+	// the same directory may be present in more lists, keep the first name
+	if (watch_map.find(wd) == watch_map.end())
+		watch_map[wd] = dir;
+
+	log_std(("menu:watch: watching %s\n", cpath_export(dir)));
+
+	return true;
+}
+
+static void watch_read()
+{
+	// buffer aligned as the inotify_event
+	long buffer[4096 / sizeof(long)];
+
+	while (1) {
+		ssize_t size = read(watch_fd, buffer, sizeof(buffer));
+		if (size <= 0)
+			break;
+
+		watch_last = target_clock();
+
+		char* i = (char*)buffer;
+		char* end = i + size;
+		while (i < end) {
+			struct inotify_event* e = (struct inotify_event*)i;
+			i += sizeof(struct inotify_event) + e->len;
+
+			if ((e->mask & IN_Q_OVERFLOW) != 0) {
+				log_std(("menu:watch: overflow\n"));
+				watch_overflow = true;
+				continue;
+			}
+
+			map<int, string>::iterator j = watch_map.find(e->wd);
+			if (j == watch_map.end())
+				continue;
+
+			if ((e->mask & IN_IGNORED) != 0) {
+				// the directory was removed or unmounted
+				log_std(("menu:watch: lost %s\n", cpath_export(j->second)));
+				watch_map.erase(j);
+				watch_overflow = true;
+				continue;
+			}
+
+			if (e->len == 0 || (e->mask & IN_ISDIR) != 0)
+				continue;
+
+			watch_change c;
+			c.dir = j->second;
+			c.file = file_import(e->name);
+			watch_bag.insert(watch_bag.end(), c);
+		}
+	}
+}
+
+#else
+
+bool watch_init()
+{
+	log_std(("menu:watch: not supported\n"));
+	return false;
+}
+
+void watch_done()
+{
+}
+
+bool watch_insert(const string& dir)
+{
+	return false;
+}
+
+static void watch_read()
+{
+}
+
+#endif
+
+bool watch_is_active()
+{
+	return watch_fd >= 0;
+}
+
+/**
+ * Read the pending notifications.
+ * Called at every idle. It never waits.
+ * \return If the changes have to be processed with watch_extract().
+ */
+bool watch_poll()
+{
+	if (watch_fd < 0)
+		return false;
+
+	watch_read();
+
+	if (watch_bag.empty() && !watch_overflow)
+		return false;
+
+	target_clock_t now = target_clock();
+
+	if (now - watch_last < WATCH_SETTLE * TARGET_CLOCKS_PER_SEC)
+		return false;
+	if (now - watch_report < WATCH_REPEAT * TARGET_CLOCKS_PER_SEC)
+		return false;
+
+	watch_report = now;
+
+	return true;
+}
+
+/**
+ * Get the pending changes.
+ * \return If some changes were lost, and all the directories have to be read again.
+ */
+bool watch_extract(watch_change_container& bag)
+{
+	bool overflow = watch_overflow;
+
+	bag.splice(bag.end(), watch_bag);
+	watch_overflow = false;
+
+	return overflow;
+}
+
@@ -0,0 +1,45 @@
+/*
+ * This file is part of the Advance project.
+ *
+ * Copyright (C) 2009 Andrea Mazzoleni
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __WATCH_H
+#define __WATCH_H
+
+#include <string>
+#include <list>
+
+/**
+ * A file created, deleted, renamed or rewritten in a watched directory.
+ */
+struct watch_change {
+	std::string dir; ///< Directory as specified in watch_insert().
+	std::string file; ///< File name in the directory.
+};
+
+typedef std::list<watch_change> watch_change_container;
+
+bool watch_init();
+void watch_done();
+bool watch_is_active();
+bool watch_insert(const std::string& dir);
+bool watch_poll();
+bool watch_extract(watch_change_container& bag);
+
+#endif
+
@@ -230,6 +230,9 @@ static void help(void)
 	target_out("%slog            create a log of operations\n", slash);
 	target_out("%slistxml        output the rom XML file\n", slash);
 	target_out("%slistbare       output the rom XML file removing info not required by frontends\n", slash);
+#ifndef MESS
+	target_out("%sverifyroms     verify all the rom sets\n", slash);
+#endif
 	target_out("%srecord FILE    record an .inp file\n", slash);
 	target_out("%splayback FILE  play an .inp file\n", slash);
 	target_out("%sversion        print the version\n", slash);
@@ -623,6 +626,7 @@ int os_main(int argc, char* argv[])
 	struct mame_option option;
 	int opt_xml;
 	int opt_bare;
+	int opt_verify;
 	int opt_log;
 	int opt_logsync;
 	int opt_default;
@@ -641,6 +645,7 @@ int os_main(int argc, char* argv[])
 
 	opt_xml = 0;
 	opt_bare = 0;
+	opt_verify = 0;
 	opt_log = 0;
 	opt_logsync = 0;
 	opt_gamename = 0;
@@ -719,6 +724,10 @@ int os_main(int argc, char* argv[])
 			opt_xml = 1;
 		} else if (target_option_compare(argv[i], "listbare")) {
 			opt_bare = 1;
+#ifndef MESS
+		} else if (target_option_compare(argv[i], "verifyroms")) {
+			opt_verify = 1;
+#endif
 		} else if (target_option_compare(argv[i], "record") && i + 1 < argc && argv[i + 1][0] != '-') {
 			if (strchr(argv[i + 1], '.') == 0)
 				snprintf(option.record_file_buffer, sizeof(option.record_file_buffer), "%s.inp", argv[i + 1]);
@@ -857,6 +866,18 @@ int os_main(int argc, char* argv[])
 	section_map[0] = "";
 	conf_section_set(context->cfg, section_map, 1);
 
+#ifndef MESS
+	if (opt_verify) {
+		if (advance_fileio_config_load(&context->fileio, context->cfg, &option) != 0)
+			goto err_os;
+
+		/* report the bad sets with the exit code */
+		if (mame_print_audit() != 0)
+			goto err_os;
+		goto done_os;
+	}
+#endif
+
 	if (!opt_gamename) {
 		if (!option.playback_file_buffer[0]) {
 			target_err("No game specified in the command line.\n");
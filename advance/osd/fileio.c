@@ -34,6 +34,12 @@
 
 #include "glueint.h"
 
+#ifndef MESS
+#include "../../src/unzip.h"
+#include "../../src/romcache.h"
+#include "../../src/chd.h"
+#endif
+
 #include "advance.h"
 
 #include <zlib.h>
@@ -91,6 +97,10 @@ static struct fileio_item FILEIO_CONFIG[] = {
 	/* FILETYPE_CTRLR */
 	/* FILETYPE_INI */
 	/* FILETYPE_HASH, */
+#ifndef MESS
+	{ FILETYPE_HASHCACHE, 0, 0, FILEIO_MODE_FILE, 0, 0 }, /* used for romhash.dat */
+	{ FILETYPE_ROMCACHE, "dir_romcache", "romcache", FILEIO_MODE_SINGLE, 0, 0 },
+#endif
 	{ FILETYPE_end, 0, 0, 0, 0 }
 };
 
@@ -159,6 +169,33 @@ int osd_get_path_info(int pathtype, int pathindex, const char* filename)
 	return PATH_NOT_FOUND;
 }
 
+#ifndef MESS
+int osd_get_path_stamp(int pathtype, int pathindex, const char* filename, UINT64* size, UINT64* mtime)
+{
+	struct fileio_item* i;
+	char path_buffer[FILE_MAXPATH];
+	struct stat st;
+
+	log_debug(("osd: osd_get_path_stamp(pathtype:%d,pathindex:%d,filename:%s)\n", pathtype, pathindex, filename));
+
+	i = fileio_find(pathtype);
+	if (!i) {
+		log_std(("WARNING:fileio: file type %d unknown\n", pathtype));
+		return -1;
+	}
+
+	sncpy(path_buffer, sizeof(path_buffer), file_abs(i->dir_map[pathindex], filename));
+
+	if (stat(path_buffer, &st) != 0 || !S_ISREG(st.st_mode))
+		return -1;
+
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+
+	return 0;
+}
+#endif
+
 static int partialequal(const char* zipfile, const char* file)
 {
 	const char* s1 = file;
@@ -392,6 +429,25 @@ UINT32 osd_fread(osd_file* file, void* buffer, UINT32 length)
 	return r;
 }
 
+const void* osd_fmap(osd_file* file, UINT64 offset, UINT32 length)
+{
+	adv_fz* h = (adv_fz*)file;
+	const void* r;
+
+	r = fzmap(h, offset, length);
+
+	log_debug(("osd: osd_fmap(%p, offset:%d, length:%d) -> %p\n", file, (int)offset, (int)length, r));
+
+	return r;
+}
+
+void osd_funmap(const void* data, UINT32 length)
+{
+	log_debug(("osd: osd_funmap(%p, length:%d)\n", data, (int)length));
+
+	fzunmap(data, length);
+}
+
 UINT32 osd_fwrite(osd_file* file, const void* buffer, UINT32 length)
 {
 	adv_fz* h = (adv_fz*)file;
@@ -741,6 +797,10 @@ adv_error advance_fileio_init(struct advance_fileio_context* context, adv_conf*
 
 #ifdef MESS
 	conf_string_register_default(cfg_context, "dir_crc", file_config_dir_singledir("crc"));
+#else
+	conf_int_register_limit_default(cfg_context, "misc_zipcache", 1, 256, 32);
+	conf_int_register_limit_default(cfg_context, "misc_chdcache", 2, 4096, 64);
+	conf_bool_register_default(cfg_context, "misc_romcache", 0);
 #endif
 
 	return 0;
@@ -833,6 +893,10 @@ adv_error advance_fileio_config_load(struct advance_fileio_context* context, adv
 		log_std(("advance:fileio: %s %s\n", "dir_crc", a));
 		sncpy(option->crc_dir_buffer, sizeof(option->crc_dir_buffer), a);
 	}
+#else
+	unzip_cache_set_size(conf_int_get_default(cfg_context, "misc_zipcache"));
+	chd_set_cache_size(conf_int_get_default(cfg_context, "misc_chdcache"));
+	romcache_set_enable(conf_bool_get_default(cfg_context, "misc_romcache"));
 #endif
 
 	return 0;
@@ -1973,28 +1973,32 @@ static void video_frame_palette(struct advance_video_context* context)
 {
 	if (context->state.palette_dirty_flag) {
 		unsigned i;
+		unsigned bytes_per_pixel;
+		adv_bool buffer_def_flag;
 
 		context->state.palette_dirty_flag = 0;
 
+		/* the video mode doesn't change in the loop */
+		bytes_per_pixel = video_bytes_per_pixel();
+		buffer_def_flag = video_color_def() != context->state.buffer_def;
+
 		for (i = 0; i < context->state.palette_dirty_total; ++i) {
 			if (context->state.palette_dirty_map[i]) {
-				unsigned j;
-				unsigned jl;
-				unsigned t;
+				unsigned p;
+				unsigned pl;
 				unsigned m;
 
 				m = context->state.palette_dirty_map[i];
 				context->state.palette_dirty_map[i] = 0;
 
-				jl = context->state.palette_total - i * osd_mask_size;
-				if (jl > osd_mask_size)
-					jl = osd_mask_size;
-
-				t = 1;
-				for (j = 0; j < jl; ++j) {
-					if ((m & t) != 0) {
-						unsigned p = i * osd_mask_size + j;
+				p = i * osd_mask_size;
+				pl = context->state.palette_total;
+				if (pl > p + osd_mask_size)
+					pl = p + osd_mask_size;
 
+				/* stop at the last dirty color of the block */
+				for (; m != 0 && p < pl; ++p, m >>= 1) {
+					if ((m & 1) != 0) {
 						adv_color_rgb c = context->state.palette_map[p];
 
 						/* update the palette */
@@ -2009,7 +2013,7 @@ static void video_frame_palette(struct advance_video_context* context)
 							video_pixel_make(&pixel, c.red, c.green, c.blue);
 
 							/* update only the currently used palette to not overload the memory cache */
-							switch (video_bytes_per_pixel()) {
+							switch (bytes_per_pixel) {
 							case 4:
 								context->state.palette_index32_map[p] = pixel;
 								break;
@@ -2021,12 +2025,12 @@ static void video_frame_palette(struct advance_video_context* context)
 								break;
 							}
 
-							if (video_color_def() != context->state.buffer_def) {
+							if (buffer_def_flag) {
 								pixel = pixel_make_from_def(c.red, c.green, c.blue, context->state.buffer_def);
 								/* update only the 32 bit palette, the others are never used */
 								context->state.buffer_index32_map[p] = pixel;
 							} else {
-								switch (video_bytes_per_pixel()) {
+								switch (bytes_per_pixel) {
 								case 4:
 									context->state.buffer_index32_map[p] = pixel;
 									break;
@@ -2040,8 +2044,6 @@ static void video_frame_palette(struct advance_video_context* context)
 							}
 						}
 					}
-
-					t <<= 1;
 				}
 			}
 		}
@@ -48,6 +48,11 @@
 #include <sys/mman.h> /* for mprotect */
 #endif
 
+#ifndef MESS
+#include "../../src/audit.h"
+#include "../../src/hashcache.h"
+#endif
+
 #ifdef MESS
 /* This is the list of the MESS recognized devices, it must be syncronized */
 /* with the devices names present in the mess/device.c file */
@@ -582,6 +587,56 @@ void mame_print_xml(FILE* out, int bare)
 	print_mame_xml(out, bare, drivers);
 }
 
+#ifndef MESS
+/**
+ * Verify all the rom sets, printing the problems found.
+ * All the archives are scanned only one time, before auditing the sets.
+ * \return Number of bad sets.
+ */
+unsigned mame_print_audit(void)
+{
+	unsigned i;
+	unsigned correct = 0;
+	unsigned incorrect = 0;
+
+	if (audit_index_begin() != 0)
+		log_std(("WARNING:glue: audit index not available, the sets are checked one at time\n"));
+
+	for (i = 0; drivers[i]; ++i) {
+		const game_driver* clone_of = driver_get_clone(drivers[i]);
+		int res;
+
+		if (!drivers[i]->rom)
+			continue;
+
+		res = audit_verify_roms(i, (verify_printf_proc)printf);
+		if (res == NOTFOUND || res == CLONE_NOTFOUND)
+			continue;
+
+		if (res == INCORRECT || res == BEST_AVAILABLE) {
+			printf("romset %s ", drivers[i]->name);
+			if (clone_of)
+				printf("[%s] ", clone_of->name);
+			printf(res == INCORRECT ? "is bad\n" : "is best available\n");
+		}
+
+		if (res == INCORRECT)
+			++incorrect;
+		else
+			++correct;
+	}
+
+	audit_index_end();
+
+	/* save the checksums computed */
+	hashcache_exit();
+
+	printf("found %u romsets, %u were OK.\n", correct + incorrect, correct);
+
+	return incorrect;
+}
+#endif
+
 /**
  * Check if a game use a vector display.
  */
@@ -2436,6 +2491,10 @@ void osd_update_video_and_audio(mame_display *display)
 	/* update the palette */
 	if ((display->changed_flags & GAME_PALETTE_CHANGED) != 0) {
 		osd2_palette(display->game_palette_dirty, display->game_palette, display->game_palette_entries);
+
+		/* the dirty colors are now stored in the osd palette, clear them */
+		/* to send only the colors changed in the next frames */
+		memset(display->game_palette_dirty, 0, (display->game_palette_entries + osd_mask_size - 1) / osd_mask_size * sizeof(display->game_palette_dirty[0]));
 	}
 
 	/* update the area */
@@ -1384,10 +1384,32 @@ void osd2_palette(const osd_mask_t* mask, const osd_rgb_t* palette, unsigned siz
 	}
 
 	context->state.palette_dirty_flag = 1;
-	for (i = 0; i < size; ++i) {
-		context->state.palette_map[i].red = osd_rgb_red(palette[i]);
-		context->state.palette_map[i].green = osd_rgb_green(palette[i]);
-		context->state.palette_map[i].blue = osd_rgb_blue(palette[i]);
+
+	/* copy only the dirty colors, the others are unchanged from the previous call */
+	for (i = 0; i < dirty_size; ++i) {
+		osd_mask_t m = mask[i];
+		unsigned p = i * osd_mask_size;
+		unsigned pl = p + osd_mask_size;
+
+		if (pl > size)
+			pl = size;
+
+		if (m == osd_mask_full) {
+			/* whole block changed, as in palette fades */
+			for (; p < pl; ++p) {
+				context->state.palette_map[p].red = osd_rgb_red(palette[p]);
+				context->state.palette_map[p].green = osd_rgb_green(palette[p]);
+				context->state.palette_map[p].blue = osd_rgb_blue(palette[p]);
+			}
+		} else {
+			for (; m != 0 && p < pl; ++p, m >>= 1) {
+				if ((m & 1) != 0) {
+					context->state.palette_map[p].red = osd_rgb_red(palette[p]);
+					context->state.palette_map[p].green = osd_rgb_green(palette[p]);
+					context->state.palette_map[p].blue = osd_rgb_blue(palette[p]);
+				}
+			}
+		}
 	}
 
 	if (dirty_size > 0 && dirty_size == context->state.palette_dirty_total) {
@@ -14,6 +14,8 @@
 #include "hash.h"
 #include "audit.h"
 #include "harddisk.h"
+#include "hashcache.h"
+#include "unzip.h"
 #include "sound/samples.h"
 
 static audit_record *audit_records = NULL;
@@ -101,6 +103,395 @@ static chd_interface audit_chd_interface =
 };
 
 
+/***************************************************************************
+    SET INDEX
+
+    Auditing a whole set one game at a time reopens every archive for each
+    clone and for each ROM. The index scans instead each archive once, in
+    parallel, remembering the name, the length and the crc of all the
+    members, and the games are then resolved against it in memory.
+***************************************************************************/
+
+typedef struct _audit_archive audit_archive;
+typedef struct _audit_member audit_member;
+
+struct _audit_member
+{
+	audit_member *	next_name;		/* next in the name bucket */
+	audit_member *	next_crc;		/* next in the crc bucket */
+	audit_archive *	archive;		/* archive containing the member */
+	UINT32			length;			/* uncompressed length */
+	UINT32			crc;			/* crc from the central directory */
+	const char *	name;			/* name, without the directory */
+};
+
+struct _audit_archive
+{
+	audit_archive *	next;			/* next in the set bucket */
+	const game_driver *driver;		/* set stored in the archive */
+	int				pathindex;		/* path containing the archive */
+	int				directory;		/* loose files instead of a zip */
+	int				count;			/* number of members */
+	audit_member *	member;			/* members, in directory order */
+	char *			pool;			/* names of the members */
+};
+
+static audit_archive **audit_set_bucket;
+static unsigned audit_set_mask;
+static audit_member **audit_name_bucket;
+static audit_member **audit_crc_bucket;
+static unsigned audit_member_mask;
+
+
+
+/*-------------------------------------------------
+    compose_zip_name - name of the zip of a set
+-------------------------------------------------*/
+
+INLINE void compose_zip_name(char *output, size_t outputlen, const char *gamename)
+{
+	snprintf(output, outputlen, "%s.zip", gamename);
+}
+
+
+
+/*-------------------------------------------------
+    audit_hash_set/name/crc - hash functions of
+    the index
+-------------------------------------------------*/
+
+INLINE unsigned audit_hash_set(const game_driver *drv)
+{
+	return (unsigned)((size_t)drv / sizeof(game_driver)) & audit_set_mask;
+}
+
+INLINE unsigned audit_hash_name(const audit_archive *archive, const char *name)
+{
+	unsigned h = (unsigned)(size_t)archive;
+
+	while (*name)
+		h = h * 31 + toupper((UINT8)*name++);
+	return h & audit_member_mask;
+}
+
+INLINE unsigned audit_hash_crc(const audit_archive *archive, UINT32 crc)
+{
+	return ((unsigned)(size_t)archive ^ crc ^ (crc >> 16)) & audit_member_mask;
+}
+
+
+
+/*-------------------------------------------------
+    audit_scan_archive - read the central
+    directory of a zip
+-------------------------------------------------*/
+
+static void audit_scan_archive(audit_archive *archive)
+{
+	char name[256];
+	zip_file *zip;
+	zip_entry *ent;
+	size_t pool_size = 0;
+	char *pool;
+	int count = 0;
+
+	compose_zip_name(name, sizeof(name), archive->driver->name);
+	zip = openzip(FILETYPE_ROM, archive->pathindex, name);
+	if (!zip)
+		return;
+
+	/* count the entries and the space for the names */
+	rewindzip(zip);
+	while ((ent = readzip(zip)) != NULL)
+	{
+		const char *base = strrchr(ent->name, '/');
+		pool_size += strlen(base ? base + 1 : ent->name) + 1;
+		count++;
+	}
+
+	archive->member = malloc(count * sizeof(audit_member) + pool_size);
+	if (!archive->member)
+	{
+		closezip(zip);
+		return;
+	}
+	pool = archive->pool = (char *)(archive->member + count);
+
+	/* copy them */
+	rewindzip(zip);
+	while ((ent = readzip(zip)) != NULL && archive->count < count)
+	{
+		audit_member *member = &archive->member[archive->count++];
+		const char *base = strrchr(ent->name, '/');
+
+		base = base ? base + 1 : ent->name;
+		member->archive = archive;
+		member->length = ent->uncompressed_size;
+		member->crc = ent->crc32;
+		member->name = pool;
+		strcpy(pool, base);
+		pool += strlen(base) + 1;
+	}
+
+	closezip(zip);
+}
+
+
+
+/*-------------------------------------------------
+    audit_index_begin - scan all the sets and
+    build the index
+-------------------------------------------------*/
+
+int audit_index_begin(void)
+{
+	audit_archive **zips;
+	int pathcount = osd_get_path_count(FILETYPE_ROM);
+	int archives = 0, zipcount = 0, members = 0;
+	unsigned buckets;
+	int drvindex, i;
+
+	audit_index_end();
+
+	/* the set lookup is keyed by driver */
+	for (drvindex = 0; drivers[drvindex]; drvindex++)
+		;
+	buckets = 16;
+	while (buckets < drvindex * 2)
+		buckets *= 2;
+	audit_set_bucket = malloc(buckets * sizeof(audit_set_bucket[0]));
+	if (!audit_set_bucket)
+		return 1;
+	memset(audit_set_bucket, 0, buckets * sizeof(audit_set_bucket[0]));
+	audit_set_mask = buckets - 1;
+
+	/* look for the archives; the paths are added backward to get them in
+       search order, and in each path the directory comes before the zip */
+	for (drvindex = 0; drivers[drvindex]; drvindex++)
+	{
+		const game_driver *drv = drivers[drvindex];
+		int pathindex;
+
+		for (pathindex = pathcount - 1; pathindex >= 0; pathindex--)
+		{
+			char name[256];
+			int type;
+
+			for (type = 1; type >= 0; type--)
+			{
+				audit_archive *archive;
+
+				if (type)
+				{
+					compose_zip_name(name, sizeof(name), drv->name);
+					if (osd_get_path_info(FILETYPE_ROM, pathindex, name) != PATH_IS_FILE)
+						continue;
+				}
+				else if (osd_get_path_info(FILETYPE_ROM, pathindex, drv->name) != PATH_IS_DIRECTORY)
+					continue;
+
+				archive = malloc(sizeof(*archive));
+				if (!archive)
+					goto error;
+				memset(archive, 0, sizeof(*archive));
+				archive->driver = drv;
+				archive->pathindex = pathindex;
+				archive->directory = !type;
+
+				archive->next = audit_set_bucket[audit_hash_set(drv)];
+				audit_set_bucket[audit_hash_set(drv)] = archive;
+				archives++;
+				if (type)
+					zipcount++;
+			}
+		}
+	}
+
+	/* read the zips, each one in a different thread */
+	zips = malloc((zipcount + 1) * sizeof(zips[0]));
+	if (!zips)
+		goto error;
+	zipcount = 0;
+	for (i = 0; i <= audit_set_mask; i++)
+	{
+		audit_archive *archive;
+
+		for (archive = audit_set_bucket[i]; archive; archive = archive->next)
+			if (!archive->directory)
+				zips[zipcount++] = archive;
+	}
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for (i = 0; i < zipcount; i++)
+		audit_scan_archive(zips[i]);
+
+	for (i = 0; i < zipcount; i++)
+		members += zips[i]->count;
+
+	/* hash the members; they are added backward so the first one in the
+       directory is found, like findzip() does */
+	buckets = 16;
+	while (buckets < members * 2)
+		buckets *= 2;
+	audit_name_bucket = malloc(buckets * sizeof(audit_name_bucket[0]));
+	audit_crc_bucket = malloc(buckets * sizeof(audit_crc_bucket[0]));
+	if (!audit_name_bucket || !audit_crc_bucket)
+	{
+		free(zips);
+		goto error;
+	}
+	memset(audit_name_bucket, 0, buckets * sizeof(audit_name_bucket[0]));
+	memset(audit_crc_bucket, 0, buckets * sizeof(audit_crc_bucket[0]));
+	audit_member_mask = buckets - 1;
+
+	for (i = 0; i < zipcount; i++)
+	{
+		audit_archive *archive = zips[i];
+		int j;
+
+		for (j = archive->count - 1; j >= 0; j--)
+		{
+			audit_member *member = &archive->member[j];
+			unsigned name = audit_hash_name(archive, member->name);
+			unsigned crc = audit_hash_crc(archive, member->crc);
+
+			member->next_name = audit_name_bucket[name];
+			audit_name_bucket[name] = member;
+			member->next_crc = audit_crc_bucket[crc];
+			audit_crc_bucket[crc] = member;
+		}
+	}
+
+	free(zips);
+
+	logerror("audit: indexed %d archives, %d zips with %d members\n", archives, zipcount, members);
+	return 0;
+
+error:
+	audit_index_end();
+	return 1;
+}
+
+
+
+/*-------------------------------------------------
+    audit_index_end - free the index
+-------------------------------------------------*/
+
+void audit_index_end(void)
+{
+	int i;
+
+	if (audit_set_bucket)
+	{
+		for (i = 0; i <= audit_set_mask; i++)
+			while (audit_set_bucket[i])
+			{
+				audit_archive *archive = audit_set_bucket[i];
+				audit_set_bucket[i] = archive->next;
+				free(archive->member);
+				free(archive);
+			}
+		free(audit_set_bucket);
+		audit_set_bucket = NULL;
+	}
+
+	free(audit_name_bucket);
+	audit_name_bucket = NULL;
+	free(audit_crc_bucket);
+	audit_crc_bucket = NULL;
+}
+
+
+
+/*-------------------------------------------------
+    audit_set_exists - check if a set is present
+    in the ROM paths
+-------------------------------------------------*/
+
+static int audit_set_exists(const game_driver *drv)
+{
+	audit_archive *archive;
+
+	if (!audit_set_bucket)
+		return mame_faccess(drv->name, FILETYPE_ROM);
+
+	for (archive = audit_set_bucket[audit_hash_set(drv)]; archive; archive = archive->next)
+		if (archive->driver == drv)
+			return 1;
+	return 0;
+}
+
+
+
+/*-------------------------------------------------
+    audit_checksum - get the length and the
+    checksums of a ROM of a set, using the index
+    like mame_fchecksum() does with the files
+-------------------------------------------------*/
+
+static int audit_checksum(const game_driver *drv, const char *filename, unsigned int *length, char *hash)
+{
+	unsigned int functions = hash_data_used_functions(hash);
+	audit_archive *archive;
+	UINT8 crcs[4];
+	UINT32 crc = 0;
+
+	if (!audit_set_bucket)
+		return mame_fchecksum(drv->name, filename, length, hash);
+
+	/* the expected crc for the load by crc */
+	if (hash_data_extract_binary_checksum(hash, HASH_CRC, crcs) != 0)
+		crc = ((UINT32)crcs[0] << 24) | ((UINT32)crcs[1] << 16) | ((UINT32)crcs[2] << 8) | (UINT32)crcs[3];
+
+	for (archive = audit_set_bucket[audit_hash_set(drv)]; archive; archive = archive->next)
+	{
+		audit_member *member;
+
+		if (archive->driver != drv)
+			continue;
+
+		/* the loose files aren't indexed, search them in the usual way */
+		if (archive->directory)
+			return mame_fchecksum(drv->name, filename, length, hash);
+
+		for (member = audit_name_bucket[audit_hash_name(archive, filename)]; member; member = member->next_name)
+			if (member->archive == archive && !mame_stricmp(member->name, filename))
+				break;
+		if (!member && crc)
+			for (member = audit_crc_bucket[audit_hash_crc(archive, crc)]; member; member = member->next_crc)
+				if (member->archive == archive && member->crc == crc)
+					break;
+
+		if (member)
+		{
+			char name[256];
+			char cached[HASH_BUF_SIZE];
+			hashcache_entry *entry;
+
+			*length = member->length;
+			hash_data_clear(hash);
+			crcs[0] = (UINT8)(member->crc >> 24);
+			crcs[1] = (UINT8)(member->crc >> 16);
+			crcs[2] = (UINT8)(member->crc >> 8);
+			crcs[3] = (UINT8)(member->crc >> 0);
+			hash_data_insert_binary_checksum(hash, HASH_CRC, crcs);
+
+			/* add the other checksums if they were computed when the file was loaded */
+			compose_zip_name(name, sizeof(name), drv->name);
+			entry = hashcache_find(FILETYPE_ROM, archive->pathindex, name, filename);
+			if (entry && hashcache_get(entry, cached, functions) && hash_data_is_equal(cached, hash, HASH_CRC) == 1)
+				hash_data_copy(hash, cached);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
 /* returns 1 if rom is defined in this set */
 int audit_is_rom_used (const game_driver *gamedrv, const char* hash)
 {
@@ -163,7 +554,7 @@ int audit_has_missing_roms (int game)
 		return !cloneRomsFound;
 	}
 	else
-		return !mame_faccess (gamedrv->name, FILETYPE_ROM);
+		return !audit_set_exists (gamedrv);
 }
 
 /* Fills in an audit record for each rom in the romset. Sets 'audit' to
@@ -200,11 +591,11 @@ int audit_roms (int game, audit_record **audit)
 	if (!gamedrv->rom) return -1;
 
 	/* check for existence of romset */
-	if (!mame_faccess (gamedrv->name, FILETYPE_ROM))
+	if (!audit_set_exists (gamedrv))
 	{
 		/* if the game is a clone, check for parent */
 		if (clone_of == NULL || (clone_of->flags & NOT_A_DRIVER) ||
-				!mame_faccess(clone_of->name,FILETYPE_ROM))
+				!audit_set_exists(clone_of))
 			return 0;
 	}
 
@@ -231,7 +622,7 @@ int audit_roms (int game, audit_record **audit)
 				drv = gamedrv;
 				do
 				{
-					err = mame_fchecksum(drv->name, name, &aud->length, aud->hash);
+					err = audit_checksum(drv, name, &aud->length, aud->hash);
 					drv = driver_get_clone(drv);
 				} while (err && drv);
 
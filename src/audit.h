@@ -70,5 +70,10 @@ int audit_verify_samples(int game,verify_printf_proc verify_printf);
 int audit_is_rom_used (const game_driver *gamedrv, const char* hash);
 int audit_has_missing_roms (int game);
 
+/* scan all the sets once, the functions above then audit from memory
+   until audit_index_end() is called */
+int audit_index_begin(void);
+void audit_index_end(void);
+
 
 #endif	/* __AUDIT_H__ */
@@ -28,8 +28,6 @@ struct _cdrom_file
 	chd_file *chd;				/* CHD file */
 	cdrom_toc 		cdtoc;		/* TOC for the CD */
 	UINT32				hunksectors;	/* sectors per hunk */
-	UINT32				cachehunk;	/* which hunk is cached */
-	UINT8 *				cache;		/* cache of the current hunk */
 
 	INT8				audio_playing, audio_pause, audio_ended_normally;
 	UINT32				audio_lba, audio_length;
@@ -238,17 +236,9 @@ cdrom_file *cdrom_open(chd_file *chd)
 	/* fill in the data */
 	file->chd = chd;
 	file->hunksectors = CD_FRAMES_PER_HUNK;
-	file->cachehunk = -1;
 
-	/* allocate a cache */
-	file->cache = malloc(chd_get_header(chd)->hunkbytes);
-	if (!file->cache)
-	{
-		free(file);
-		return NULL;
-	}
-
-	/* allocate an audio cache */
+	/* allocate an audio cache; the sectors themselves come from the CHD */
+	/* hunk cache, which holds both the audio and the data hunks */
 	file->audio_cache = malloc(CD_MAX_SECTOR_DATA*4);
 	if (!file->audio_cache)
 	{
@@ -270,8 +260,6 @@ cdrom_file *cdrom_open(chd_file *chd)
 void cdrom_close(cdrom_file *file)
 {
 	/* free the cache */
-	if (file->cache)
-		free(file->cache);
 	if (file->audio_cache)
 		free(file->audio_cache);
 	free(file);
@@ -320,32 +308,27 @@ UINT32 cdrom_read_data(cdrom_file *file, UINT32 lbasector, UINT32 numsectors, vo
 		return total;
 	}
 
-	/* if we haven't cached this hunk, read it now */
-	if (file->cachehunk != hunknum)
-	{
-		if (!chd_read(file->chd, hunknum, 1, file->cache))
-			return 0;
-		file->cachehunk = hunknum;
-	}
-
 	/* copy out the requested sector */
 	if (datatype == tracktype)
 	{
-		memcpy(buffer, &file->cache[sectoroffs * CD_FRAME_SIZE], file->cdtoc.tracks[track].datasize);
+		if (!chd_read_partial(file->chd, hunknum, sectoroffs * CD_FRAME_SIZE, file->cdtoc.tracks[track].datasize, buffer))
+			return 0;
 	}
 	else
 	{
 		/* return 2048 bytes of mode1 data from a 2336 byte mode1 raw sector */
 		if ((datatype == CD_TRACK_MODE1) && (tracktype == CD_TRACK_MODE1_RAW))
 		{
-			memcpy(buffer, &file->cache[(sectoroffs * CD_FRAME_SIZE) + 16], 2048);
+			if (!chd_read_partial(file->chd, hunknum, (sectoroffs * CD_FRAME_SIZE) + 16, 2048, buffer))
+				return 0;
 			return 1;
 		}
 
 		/* return 2048 bytes of mode1 data from a 2352 byte mode2 form 1 raw sector */
 		if ((datatype == CD_TRACK_MODE1) && (tracktype == CD_TRACK_MODE2_FORM1))
 		{
-			memcpy(buffer, &file->cache[(sectoroffs * CD_FRAME_SIZE) + 24], 2048);
+			if (!chd_read_partial(file->chd, hunknum, (sectoroffs * CD_FRAME_SIZE) + 24, 2048, buffer))
+				return 0;
 			return 1;
 		}
 
@@ -372,16 +355,9 @@ UINT32 cdrom_read_subcode(cdrom_file *file, UINT32 lbasector, void *buffer)
 
 	tracktype = file->cdtoc.tracks[track].trktype;
 
-	/* if we haven't cached this hunk, read it now */
-	if (file->cachehunk != hunknum)
-	{
-		if (!chd_read(file->chd, hunknum, 1, file->cache))
-			return 0;
-		file->cachehunk = hunknum;
-	}
-
 	/* copy out the requested data */
-	memcpy(buffer, &file->cache[(sectoroffs * CD_FRAME_SIZE) + file->cdtoc.tracks[track].datasize], file->cdtoc.tracks[track].subsize);
+	if (!chd_read_partial(file->chd, hunknum, (sectoroffs * CD_FRAME_SIZE) + file->cdtoc.tracks[track].datasize, file->cdtoc.tracks[track].subsize, buffer))
+		return 0;
 	return 1;
 }
 
@@ -10,8 +10,15 @@
 #include "chd.h"
 #include "md5.h"
 #include "sha1.h"
+#include "fastcrc.h"
 #include <zlib.h>
 #include <time.h>
+#ifdef USE_SMP
+#include <pthread.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 
@@ -56,6 +63,20 @@
 
 #define NO_MATCH					(~0)
 
+#define HUNK_CACHE_DEFAULT			64			/* default number of hunks in the LRU cache */
+#define HUNK_CACHE_MAX				4096		/* max number of hunks in the LRU cache */
+#define NO_SLOT						0xffff		/* hunk not in the LRU cache */
+
+#define HUNK_FREE					0			/* cache entry unused */
+#define HUNK_READY					1			/* cache entry holds valid data */
+#define HUNK_LOADING				2			/* cache entry being decompressed */
+
+#define READAHEAD_HUNKS				16			/* hunks decompressed ahead of a sequential reader */
+#define READAHEAD_STREAMS			4			/* sequential readers tracked for each file */
+#define READAHEAD_QUEUE				64			/* max number of queued read-ahead hunks */
+
+#define BATCH_HUNKS					64			/* hunks compressed or verified at a time */
+
 
 
 /*************************************
@@ -66,6 +87,21 @@
 
 #define SET_ERROR_AND_CLEANUP(err) do { last_error = (err); goto cleanup; } while (0)
 
+/* the hunk caches and the read-ahead queues are shared with the read-ahead thread */
+#ifdef USE_SMP
+#define CACHE_LOCK()				pthread_mutex_lock(&cache_mutex)
+#define CACHE_UNLOCK()				pthread_mutex_unlock(&cache_mutex)
+#define CACHE_WAIT()				pthread_cond_wait(&cache_done, &cache_mutex)
+#define IO_LOCK()					pthread_mutex_lock(&io_mutex)
+#define IO_UNLOCK()					pthread_mutex_unlock(&io_mutex)
+#else
+#define CACHE_LOCK()				do { } while (0)
+#define CACHE_UNLOCK()				do { } while (0)
+#define CACHE_WAIT()				do { } while (0)
+#define IO_LOCK()					do { } while (0)
+#define IO_UNLOCK()					do { } while (0)
+#endif
+
 
 
 /*************************************
@@ -92,6 +128,24 @@ struct _crcmap_entry
 typedef struct _crcmap_entry crcmap_entry;
 
 
+struct _hunk_decoder
+{
+	UINT8 *					compressed;		/* buffer for the compressed data */
+	void *					codecdata;		/* decompression stream */
+};
+typedef struct _hunk_decoder hunk_decoder;
+
+
+struct _hunk_cache_entry
+{
+	UINT32					hunknum;		/* hunk held by this entry */
+	UINT32					stamp;			/* time of the last access, for the LRU */
+	UINT32					state;			/* HUNK_FREE, HUNK_READY or HUNK_LOADING */
+	UINT8 *					data;			/* decompressed data */
+};
+typedef struct _hunk_cache_entry hunk_cache_entry;
+
+
 struct _metadata_entry
 {
 	UINT64					offset;			/* offset within the file of the header */
@@ -118,6 +172,20 @@ struct _chd_file
 	UINT8 *					cache;			/* hunk cache pointer */
 	UINT32					cachehunk;		/* index of currently cached hunk */
 
+	hunk_cache_entry *		hunkcache;		/* LRU cache of decompressed hunks */
+	UINT32					hunkcachesize;	/* number of entries in the LRU cache */
+	UINT32					hunkstamp;		/* access counter for the LRU */
+	UINT16 *				hunkslot;		/* cache entry of each hunk, or NO_SLOT */
+	UINT8 *					hunkdata;		/* data of all the cache entries */
+
+	int						readahead;		/* read-ahead enabled */
+	UINT32					streamlast[READAHEAD_STREAMS];	/* last hunk of each sequential reader */
+	UINT32					streamnext;		/* next reader to replace */
+	UINT32					queue[READAHEAD_QUEUE];	/* hunks to read ahead */
+	UINT32					queuehead;		/* first hunk in the queue */
+	UINT32					queuecount;		/* number of hunks in the queue */
+	hunk_decoder			aheaddecoder;	/* decompressor of the read-ahead thread */
+
 	UINT8 *					compare;		/* hunk compare pointer */
 	UINT32					comparehunk;	/* index of current compare data */
 
@@ -132,6 +200,20 @@ struct _chd_file
 };
 
 
+struct _hunk_batch
+{
+	UINT8 *					raw[2];			/* raw data of the hunks */
+	UINT8 *					compressed;		/* compressed data of the hunks */
+	UINT32					crc[BATCH_HUNKS];		/* CRC of each hunk */
+	UINT32					length[BATCH_HUNKS];	/* compressed length of each hunk */
+	int						err[BATCH_HUNKS];		/* decompression result of each hunk */
+	int						threads;		/* number of threads */
+	void **					codecdata;		/* a compression stream for each thread */
+	hunk_decoder *			decoder;		/* a decompressor for each thread */
+};
+typedef struct _hunk_batch hunk_batch;
+
+
 struct _chd_exfile
 {
 	chd_file *chd;
@@ -139,6 +221,7 @@ struct _chd_exfile
 	struct sha1_ctx sha;
 	int hunknum;
 	UINT64 sourceoffset;
+	hunk_batch *batch;
 };
 
 
@@ -162,6 +245,19 @@ static chd_interface cur_interface;
 static chd_file *first_file;
 static int last_error;
 
+static UINT32 hunk_cache_size = HUNK_CACHE_DEFAULT;
+
+#ifdef USE_SMP
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cache_done = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t readahead_thread;
+static int readahead_started;
+static int readahead_exit;
+static chd_file *readahead_current;
+#endif
+
 static const UINT8 nullmd5[CHD_MD5_BYTES] = { 0 };
 static const UINT8 nullsha1[CHD_SHA1_BYTES] = { 0 };
 
@@ -174,9 +270,14 @@ static const UINT8 nullsha1[CHD_SHA1_BYTES] = { 0 };
  *************************************/
 
 static int validate_header(const chd_header *header);
-static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest);
+static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest, const hunk_decoder *decoder);
 static int read_hunk_into_cache(chd_file *chd, UINT32 hunknum);
+static int read_hunk_from_lru(chd_file *chd, UINT32 hunknum, UINT32 offset, UINT32 count, void *buffer);
+static void update_hunk_in_lru(chd_file *chd, UINT32 hunknum, const UINT8 *src);
+static void queue_read_ahead(chd_file *chd, UINT32 hunknum);
 static int write_hunk_from_memory(chd_file *chd, UINT32 hunknum, const UINT8 *src);
+static UINT32 compress_hunk(chd_file *chd, void *codecdata, const UINT8 *src, UINT8 *dest);
+static int write_compressed_hunk(chd_file *chd, UINT32 hunknum, const UINT8 *src, UINT32 crc, const UINT8 *compressed, UINT32 length);
 static int read_header(chd_interface_file *file, chd_header *header);
 static int write_header(chd_interface_file *file, const chd_header *header);
 static int read_hunk_map(chd_file *chd);
@@ -187,6 +288,16 @@ static int find_metadata_entry(chd_file *chd, UINT32 metatag, UINT32 metaindex,
 
 static int init_codec(chd_file *chd);
 static void free_codec(chd_file *chd);
+static void *init_zlib_stream(int deflater);
+static void free_zlib_stream(void *codecdata);
+static int init_decoder(hunk_decoder *decoder, UINT32 hunkbytes);
+static void free_decoder(hunk_decoder *decoder);
+
+static hunk_batch *alloc_batch(chd_file *chd, int decode);
+static void free_batch(hunk_batch *batch);
+static void checksum_batch(chd_file *chd, const UINT8 *raw, UINT32 count, UINT64 sourceoffset, struct MD5Context *md5, struct sha1_ctx *sha);
+static int compress_batch(chd_file *chd, hunk_batch *batch, UINT32 hunknum, UINT32 count, UINT64 sourceoffset, struct MD5Context *md5, struct sha1_ctx *sha);
+static void decompress_batch(chd_file *chd, hunk_batch *batch, int which, UINT32 hunknum, UINT32 count, UINT32 prevcount, UINT64 prevoffset, struct MD5Context *md5, struct sha1_ctx *sha);
 
 static chd_interface_file *multi_open(const char *filename, const char *mode);
 static void multi_close(chd_interface_file *file);
@@ -310,6 +421,24 @@ void chd_save_interface(chd_interface *interface_save)
 
 
 
+/*************************************
+ *
+ *  Hunk cache setup
+ *
+ *************************************/
+
+void chd_set_cache_size(UINT32 hunks)
+{
+	/* applies to the files opened from now on */
+	if (hunks < 1)
+		hunks = 1;
+	if (hunks > HUNK_CACHE_MAX)
+		hunks = HUNK_CACHE_MAX;
+	hunk_cache_size = hunks;
+}
+
+
+
 /*************************************
  *
  *  Create a new data file
@@ -501,6 +630,7 @@ chd_file *chd_open(const char *filename, int writeable, chd_file *parent)
 {
 	chd_file *finalchd;
 	chd_file chd = { 0 };
+	UINT32 i;
 	int err;
 
 	last_error = CHDERR_NONE;
@@ -574,6 +704,28 @@ chd_file *chd_open(const char *filename, int writeable, chd_file *parent)
 	chd.cachehunk = ~0;
 	chd.comparehunk = ~0;
 
+	/* allocate the LRU cache, no bigger than the file */
+	chd.hunkcachesize = hunk_cache_size;
+	if (chd.hunkcachesize > chd.header.totalhunks)
+		chd.hunkcachesize = chd.header.totalhunks;
+	if (chd.hunkcachesize < 1)
+		chd.hunkcachesize = 1;
+	chd.hunkcache = malloc(chd.hunkcachesize * sizeof(chd.hunkcache[0]));
+	chd.hunkdata = malloc(chd.hunkcachesize * chd.header.hunkbytes);
+	chd.hunkslot = malloc(chd.header.totalhunks * sizeof(chd.hunkslot[0]));
+	if (!chd.hunkcache || !chd.hunkdata || !chd.hunkslot)
+		SET_ERROR_AND_CLEANUP(CHDERR_OUT_OF_MEMORY);
+	for (i = 0; i < chd.hunkcachesize; i++)
+	{
+		chd.hunkcache[i].hunknum = ~0;
+		chd.hunkcache[i].stamp = 0;
+		chd.hunkcache[i].state = HUNK_FREE;
+		chd.hunkcache[i].data = chd.hunkdata + i * chd.header.hunkbytes;
+	}
+	memset(chd.hunkslot, 0xff, chd.header.totalhunks * sizeof(chd.hunkslot[0]));
+	for (i = 0; i < READAHEAD_STREAMS; i++)
+		chd.streamlast[i] = ~0;
+
 	/* allocate the temporary compressed buffer */
 	chd.compressed = malloc(chd.header.hunkbytes);
 	if (!chd.compressed)
@@ -584,6 +736,12 @@ chd_file *chd_open(const char *filename, int writeable, chd_file *parent)
 	if (err != CHDERR_NONE)
 		SET_ERROR_AND_CLEANUP(err);
 
+#ifdef USE_SMP
+	/* read ahead only read-only files with a spare cache entry */
+	if (!writeable && chd.hunkcachesize > 1)
+		chd.readahead = (init_decoder(&chd.aheaddecoder, chd.header.hunkbytes) == CHDERR_NONE);
+#endif
+
 	/* okay, now allocate our entry and copy it */
 	finalchd = malloc(sizeof(chd));
 	if (!finalchd)
@@ -591,18 +749,27 @@ chd_file *chd_open(const char *filename, int writeable, chd_file *parent)
 	*finalchd = chd;
 
 	/* hook us into the global list */
+	CACHE_LOCK();
 	finalchd->cookie = COOKIE_VALUE;
 	finalchd->next = first_file;
 	first_file = finalchd;
+	CACHE_UNLOCK();
 
 	/* all done */
 	return finalchd;
 
 cleanup:
+	free_decoder(&chd.aheaddecoder);
 	if (chd.codecdata)
 		free_codec(&chd);
 	if (chd.compressed)
 		free(chd.compressed);
+	if (chd.hunkslot)
+		free(chd.hunkslot);
+	if (chd.hunkdata)
+		free(chd.hunkdata);
+	if (chd.hunkcache)
+		free(chd.hunkcache);
 	if (chd.compare)
 		free(chd.compare);
 	if (chd.cache)
@@ -630,7 +797,40 @@ void chd_close(chd_file *chd)
 	if (!chd || chd->cookie != COOKIE_VALUE)
 		return;
 
-	/* deinit the codec */
+	/* drop the pending read-ahead and unlink ourselves */
+	CACHE_LOCK();
+	chd->queuecount = 0;
+#ifdef USE_SMP
+	while (readahead_current)
+		CACHE_WAIT();
+#endif
+	for (prev = NULL, curr = first_file; curr; prev = curr, curr = curr->next)
+		if (curr == chd)
+		{
+			if (prev)
+				prev->next = curr->next;
+			else
+				first_file = curr->next;
+			break;
+		}
+	CACHE_UNLOCK();
+
+#ifdef USE_SMP
+	/* stop the read-ahead thread with the last file */
+	if (!first_file && readahead_started)
+	{
+		CACHE_LOCK();
+		readahead_exit = 1;
+		pthread_cond_signal(&cache_queued);
+		CACHE_UNLOCK();
+		pthread_join(readahead_thread, NULL);
+		readahead_started = 0;
+		readahead_exit = 0;
+	}
+#endif
+
+	/* deinit the codecs */
+	free_decoder(&chd->aheaddecoder);
 	if (chd->codecdata)
 		free_codec(chd);
 
@@ -644,6 +844,14 @@ void chd_close(chd_file *chd)
 	if (chd->cache)
 		free(chd->cache);
 
+	/* free the LRU cache */
+	if (chd->hunkslot)
+		free(chd->hunkslot);
+	if (chd->hunkdata)
+		free(chd->hunkdata);
+	if (chd->hunkcache)
+		free(chd->hunkcache);
+
 	/* free the hunk map */
 	if (chd->map)
 		free(chd->map);
@@ -656,17 +864,6 @@ void chd_close(chd_file *chd)
 	if (chd->file)
 		multi_close(chd->file);
 
-	/* unlink ourselves */
-	for (prev = NULL, curr = first_file; curr; prev = curr, curr = curr->next)
-		if (curr == chd)
-		{
-			if (prev)
-				prev->next = curr->next;
-			else
-				first_file = curr->next;
-			break;
-		}
-
 #if PRINTF_MAX_HUNK
 	printf("Max hunk = %d/%d\n", chd->maxhunk, chd->header.totalhunks);
 #endif
@@ -879,16 +1076,10 @@ UINT32 chd_read(chd_file *chd, UINT32 hunknum, UINT32 hunkcount, void *buffer)
 	if (hunknum > chd->maxhunk)
 		chd->maxhunk = hunknum;
 
-	/* if the hunk is not cached, load and decompress it */
-	if (chd->cachehunk != hunknum)
-	{
-		err = read_hunk_into_cache(chd, hunknum);
-		if (err != CHDERR_NONE)
-			SET_ERROR_AND_CLEANUP(err);
-	}
-
-	/* now copy the data from the cache */
-	memcpy(buffer, chd->cache, chd->header.hunkbytes);
+	/* copy the data from the LRU cache, loading and decompressing it if needed */
+	err = read_hunk_from_lru(chd, hunknum, 0, chd->header.hunkbytes, buffer);
+	if (err != CHDERR_NONE)
+		SET_ERROR_AND_CLEANUP(err);
 	return 1;
 
 cleanup:
@@ -897,6 +1088,42 @@ cleanup:
 
 
 
+/*************************************
+ *
+ *  Reading part of a hunk
+ *
+ *************************************/
+
+UINT32 chd_read_partial(chd_file *chd, UINT32 hunknum, UINT32 offset, UINT32 count, void *buffer)
+{
+	int err;
+
+	last_error = CHDERR_NONE;
+
+	/* punt if NULL or invalid */
+	if (!chd || chd->cookie != COOKIE_VALUE || offset + count > chd->header.hunkbytes)
+		SET_ERROR_AND_CLEANUP(CHDERR_INVALID_PARAMETER);
+
+	/* if we're past the end, fail */
+	if (hunknum >= chd->header.totalhunks)
+		SET_ERROR_AND_CLEANUP(CHDERR_HUNK_OUT_OF_RANGE);
+
+	/* track the max */
+	if (hunknum > chd->maxhunk)
+		chd->maxhunk = hunknum;
+
+	/* copy the data from the LRU cache, loading and decompressing it if needed */
+	err = read_hunk_from_lru(chd, hunknum, offset, count, buffer);
+	if (err != CHDERR_NONE)
+		SET_ERROR_AND_CLEANUP(err);
+	return count;
+
+cleanup:
+	return 0;
+}
+
+
+
 /*************************************
  *
  *  Writing to a data file
@@ -934,6 +1161,11 @@ UINT32 chd_write(chd_file *chd, UINT32 hunknum, UINT32 hunkcount, const void *bu
 	err = write_hunk_from_memory(chd, hunknum, buffer);
 	if (err != CHDERR_NONE)
 		SET_ERROR_AND_CLEANUP(err);
+
+	/* keep the caches up to date */
+	if (chd->cachehunk == hunknum)
+		chd->cachehunk = ~0;
+	update_hunk_in_lru(chd, hunknum, buffer);
 	return 1;
 
 cleanup:
@@ -1052,11 +1284,12 @@ cleanup:
 int chd_compress(chd_file *chd, const char *rawfile, UINT32 offset, void (*progress)(const char *, ...))
 {
 	chd_interface_file *sourcefile = NULL;
+	hunk_batch *batch = NULL;
 	UINT64 sourceoffset = 0;
 	struct MD5Context md5;
 	struct sha1_ctx sha;
 	clock_t lastupdate;
-	int err, hunknum;
+	int err, hunknum, count;
 
 	/* punt if no interface */
 	if (!cur_interface.open)
@@ -1071,6 +1304,11 @@ int chd_compress(chd_file *chd, const char *rawfile, UINT32 offset, void (*progr
 	if (!sourcefile)
 		SET_ERROR_AND_CLEANUP(CHDERR_FILE_NOT_FOUND);
 
+	/* allocate the buffers and the compressors of the batches */
+	batch = alloc_batch(chd, 0);
+	if (!batch)
+		SET_ERROR_AND_CLEANUP(CHDERR_OUT_OF_MEMORY);
+
 	/* mark the CHD writeable and write the updated header */
 	chd->header.flags |= CHDFLAGS_IS_WRITEABLE;
 	err = write_header(chd->file, &chd->header);
@@ -1086,18 +1324,27 @@ int chd_compress(chd_file *chd, const char *rawfile, UINT32 offset, void (*progr
 	MD5Init(&md5);
 	sha1_init(&sha);
 
-	/* loop over source hunks until we run out */
+	/* loop over batches of source hunks until we run out */
 	lastupdate = 0;
-	for (hunknum = 0; hunknum < chd->header.totalhunks; hunknum++)
+	for (hunknum = 0; hunknum < chd->header.totalhunks; hunknum += count)
 	{
 		clock_t curtime = clock();
-		UINT32 bytestochecksum;
-		UINT32 bytesread;
+		int i;
+
+		count = chd->header.totalhunks - hunknum;
+		if (count > BATCH_HUNKS)
+			count = BATCH_HUNKS;
 
 		/* read the data */
-		bytesread = multi_read(sourcefile, sourceoffset + offset, chd->header.hunkbytes, chd->cache);
-		if (bytesread < chd->header.hunkbytes)
-			memset(&chd->cache[bytesread], 0, chd->header.hunkbytes - bytesread);
+		for (i = 0; i < count; i++)
+		{
+			UINT8 *raw = batch->raw[0] + i * chd->header.hunkbytes;
+			UINT32 bytesread;
+
+			bytesread = multi_read(sourcefile, sourceoffset + (UINT64)i * chd->header.hunkbytes + offset, chd->header.hunkbytes, raw);
+			if (bytesread < chd->header.hunkbytes)
+				memset(&raw[bytesread], 0, chd->header.hunkbytes - bytesread);
+		}
 
 		/* progress */
 		if (curtime - lastupdate > CLOCKS_PER_SEC / 2)
@@ -1108,33 +1355,13 @@ int chd_compress(chd_file *chd, const char *rawfile, UINT32 offset, void (*progr
 			lastupdate = curtime;
 		}
 
-		/* update the MD5/SHA1 */
-		bytestochecksum = chd->header.hunkbytes;
-		if (sourceoffset + chd->header.hunkbytes > chd->header.logicalbytes)
-		{
-			if (sourceoffset >= chd->header.logicalbytes)
-				bytestochecksum = 0;
-			else
-				bytestochecksum = chd->header.logicalbytes - sourceoffset;
-		}
-		if (bytestochecksum)
-		{
-			MD5Update(&md5, chd->cache, bytestochecksum);
-			sha1_update(&sha, bytestochecksum, chd->cache);
-		}
-
-		/* write out the hunk */
-		err = write_hunk_from_memory(chd, hunknum, chd->cache);
+		/* checksum, compress and write out the hunks */
+		err = compress_batch(chd, batch, hunknum, count, sourceoffset, &md5, &sha);
 		if (err != CHDERR_NONE)
 			SET_ERROR_AND_CLEANUP(err);
 
-		/* update our CRC map */
-		if ((chd->map[hunknum].flags & MAP_ENTRY_FLAG_TYPE_MASK) != MAP_ENTRY_TYPE_SELF_HUNK &&
-			(chd->map[hunknum].flags & MAP_ENTRY_FLAG_TYPE_MASK) != MAP_ENTRY_TYPE_PARENT_HUNK)
-			add_to_crcmap(chd, hunknum);
-
-		/* prepare for the next hunk */
-		sourceoffset += chd->header.hunkbytes;
+		/* prepare for the next batch */
+		sourceoffset += (UINT64)count * chd->header.hunkbytes;
 	}
 
 	/* compute the final MD5/SHA1 values */
@@ -1157,15 +1384,20 @@ int chd_compress(chd_file *chd, const char *rawfile, UINT32 offset, void (*progr
 	}
 
 	/* close the file */
+	free_batch(batch);
 	multi_close(sourcefile);
 	return CHDERR_NONE;
 
 cleanup:
+	if (batch)
+		free_batch(batch);
 	if (sourcefile)
 		multi_close(sourcefile);
 	return last_error;
 }
 
+
+
 /*************************************
  *
  *  All-in-one file verifier
@@ -1176,8 +1408,10 @@ int chd_verify(chd_file *chd, void (*progress)(const char *, ...), UINT8 actualm
 {
 	struct MD5Context md5;
 	struct sha1_ctx sha;
+	hunk_batch *batch = NULL;
 	UINT64 sourceoffset = 0;
 	int err, prev_err = CHDERR_NONE, hunknum = 0;
+	int count, prevcount = 0, which = 0;
 	clock_t lastupdate;
 
 	/* punt if no interface */
@@ -1192,16 +1426,25 @@ int chd_verify(chd_file *chd, void (*progress)(const char *, ...), UINT8 actualm
 	if (chd->header.flags & CHDFLAGS_IS_WRITEABLE)
 		SET_ERROR_AND_CLEANUP(CHDERR_CANT_VERIFY);
 
+	/* allocate the buffers and the decompressors of the batches */
+	batch = alloc_batch(chd, 1);
+	if (!batch)
+		SET_ERROR_AND_CLEANUP(CHDERR_OUT_OF_MEMORY);
+
 	/* init the MD5/SHA1 computations */
 	MD5Init(&md5);
 	sha1_init(&sha);
 
-	/* loop over source hunks until we run out */
+	/* loop over batches of source hunks until we run out */
 	lastupdate = 0;
-	for (hunknum = 0; hunknum < chd->header.totalhunks; hunknum++)
+	for (hunknum = 0; hunknum < chd->header.totalhunks; hunknum += count)
 	{
 		clock_t curtime = clock();
-		UINT32 bytestochecksum;
+		int i;
+
+		count = chd->header.totalhunks - hunknum;
+		if (count > BATCH_HUNKS)
+			count = BATCH_HUNKS;
 
 		/* progress */
 		if (curtime - lastupdate > CLOCKS_PER_SEC / 2)
@@ -1211,35 +1454,33 @@ int chd_verify(chd_file *chd, void (*progress)(const char *, ...), UINT8 actualm
 			lastupdate = curtime;
 		}
 
-		/* read the hunk into the cache */
-		err = read_hunk_into_cache(chd, hunknum);
-		if (err == CHDERR_DECOMPRESSION_ERROR)
-		{
-			prev_err = CHDERR_DECOMPRESSION_ERROR;
-			if (progress)
-				(*progress)("Bad hunk %d/%d.        \r\n", hunknum, chd->header.totalhunks);
-		}
-		else if (err != CHDERR_NONE)
-			SET_ERROR_AND_CLEANUP(err);
-
-		/* update the MD5/SHA1 */
-		bytestochecksum = chd->header.hunkbytes;
-		if (sourceoffset + chd->header.hunkbytes > chd->header.logicalbytes)
+		/* read the hunks, while checksumming the previous batch */
+		decompress_batch(chd, batch, which, hunknum, count, prevcount, sourceoffset - (UINT64)prevcount * chd->header.hunkbytes, &md5, &sha);
+		for (i = 0; i < count; i++)
 		{
-			if (sourceoffset >= chd->header.logicalbytes)
-				bytestochecksum = 0;
-			else
-				bytestochecksum = chd->header.logicalbytes - sourceoffset;
-		}
-		if (bytestochecksum)
-		{
-			MD5Update(&md5, chd->cache, bytestochecksum);
-			sha1_update(&sha, bytestochecksum, chd->cache);
+			err = batch->err[i];
+			if (err == CHDERR_DECOMPRESSION_ERROR)
+			{
+				prev_err = CHDERR_DECOMPRESSION_ERROR;
+				if (progress)
+					(*progress)("Bad hunk %d/%d.        \r\n", hunknum + i, chd->header.totalhunks);
+			}
+			else if (err != CHDERR_NONE)
+				SET_ERROR_AND_CLEANUP(err);
 		}
 
-		/* prepare for the next hunk */
-		sourceoffset += chd->header.hunkbytes;
+		/* prepare for the next batch */
+		sourceoffset += (UINT64)count * chd->header.hunkbytes;
+		prevcount = count;
+		which ^= 1;
 	}
+
+	/* checksum the last batch */
+	if (prevcount)
+		checksum_batch(chd, batch->raw[which ^ 1], prevcount, sourceoffset - (UINT64)prevcount * chd->header.hunkbytes, &md5, &sha);
+	free_batch(batch);
+	batch = NULL;
+
 	if (prev_err == CHDERR_DECOMPRESSION_ERROR)
 		SET_ERROR_AND_CLEANUP(prev_err);
 
@@ -1254,6 +1495,8 @@ int chd_verify(chd_file *chd, void (*progress)(const char *, ...), UINT8 actualm
 	return CHDERR_NONE;
 
 cleanup:
+	if (batch)
+		free_batch(batch);
 	return last_error;
 }
 
@@ -1321,9 +1564,11 @@ static int validate_header(const chd_header *header)
  *
  *************************************/
 
-static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest)
+/* decompress with the given decoder, or with the one of the file if NULL */
+static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest, const hunk_decoder *decoder)
 {
 	map_entry *entry = &chd->map[hunknum];
+	UINT8 *compressed = decoder ? decoder->compressed : chd->compressed;
 	UINT32 bytes;
 	int err;
 
@@ -1334,7 +1579,7 @@ static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest)
 		case MAP_ENTRY_TYPE_COMPRESSED:
 
 			/* read it into the decompression buffer */
-			bytes = multi_read(chd->file, entry->offset, entry->length, chd->compressed);
+			bytes = multi_read(chd->file, entry->offset, entry->length, compressed);
 			if (bytes != entry->length)
 				return CHDERR_READ_ERROR;
 
@@ -1344,10 +1589,10 @@ static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest)
 				case CHDCOMPRESSION_ZLIB:
 				case CHDCOMPRESSION_ZLIB_PLUS:
 				{
-					zlib_codec_data *codec = chd->codecdata;
+					zlib_codec_data *codec = decoder ? decoder->codecdata : chd->codecdata;
 
 					/* reset the decompressor */
-					codec->inflater.next_in = chd->compressed;
+					codec->inflater.next_in = compressed;
 					codec->inflater.avail_in = entry->length;
 					codec->inflater.total_in = 0;
 					codec->inflater.next_out = dest;
@@ -1384,18 +1629,18 @@ static int read_hunk_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest)
 		case MAP_ENTRY_TYPE_SELF_HUNK:
 			if (chd->cachehunk == entry->offset && dest == chd->cache)
 				break;
-			return read_hunk_into_memory(chd, entry->offset, dest);
+			return read_hunk_into_memory(chd, entry->offset, dest, decoder);
 
 		/* parent-referenced data */
 		case MAP_ENTRY_TYPE_PARENT_HUNK:
-			err = read_hunk_into_memory(chd->parent, entry->offset, dest);
+			err = read_hunk_into_memory(chd->parent, entry->offset, dest, decoder);
 			if (err != CHDERR_NONE)
 				return err;
 			break;
 	}
 
 	/* validate the CRC if we have one */
-	if (!(entry->flags & MAP_ENTRY_FLAG_NO_CRC) && entry->crc != crc32(0, &dest[0], chd->header.hunkbytes))
+	if (!(entry->flags & MAP_ENTRY_FLAG_NO_CRC) && entry->crc != fast_crc32(0, &dest[0], chd->header.hunkbytes))
 		return CHDERR_DECOMPRESSION_ERROR;
 	return CHDERR_NONE;
 }
@@ -1411,7 +1656,7 @@ static int read_hunk_into_cache(chd_file *chd, UINT32 hunknum)
 	chd->cachehunk = ~0;
 
 	/* otherwise, read the data */
-	err = read_hunk_into_memory(chd, hunknum, chd->cache);
+	err = read_hunk_into_memory(chd, hunknum, chd->cache, NULL);
 	if (err != CHDERR_NONE)
 		return err;
 
@@ -1422,6 +1667,240 @@ static int read_hunk_into_cache(chd_file *chd, UINT32 hunknum)
 
 
 
+/*************************************
+ *
+ *  Hunk LRU cache
+ *
+ *************************************/
+
+/* take the least recently used entry for a new hunk; the cache lock must be held */
+static hunk_cache_entry *alloc_lru_entry(chd_file *chd, UINT32 hunknum)
+{
+	hunk_cache_entry *best = NULL;
+	UINT32 i;
+
+	for (i = 0; i < chd->hunkcachesize; i++)
+	{
+		hunk_cache_entry *entry = &chd->hunkcache[i];
+
+		if (entry->state == HUNK_FREE)
+		{
+			best = entry;
+			break;
+		}
+		if (entry->state == HUNK_READY && (!best || chd->hunkstamp - entry->stamp > chd->hunkstamp - best->stamp))
+			best = entry;
+	}
+	if (!best)
+		return NULL;
+
+	/* forget the old hunk and claim the entry */
+	if (best->state == HUNK_READY)
+		chd->hunkslot[best->hunknum] = NO_SLOT;
+	best->hunknum = hunknum;
+	best->stamp = chd->hunkstamp++;
+	best->state = HUNK_LOADING;
+	chd->hunkslot[hunknum] = best - chd->hunkcache;
+	return best;
+}
+
+
+/* complete the loading of an entry; the cache lock must be held */
+static void finish_lru_entry(chd_file *chd, hunk_cache_entry *entry, int err)
+{
+	if (err == CHDERR_NONE)
+		entry->state = HUNK_READY;
+	else
+	{
+		chd->hunkslot[entry->hunknum] = NO_SLOT;
+		entry->hunknum = ~0;
+		entry->state = HUNK_FREE;
+	}
+#ifdef USE_SMP
+	pthread_cond_broadcast(&cache_done);
+#endif
+}
+
+
+static int read_hunk_from_lru(chd_file *chd, UINT32 hunknum, UINT32 offset, UINT32 count, void *buffer)
+{
+	hunk_cache_entry *entry;
+	int err;
+
+	CACHE_LOCK();
+
+	/* let the read-ahead thread work on the next hunks while we wait for this one */
+	if (chd->readahead)
+		queue_read_ahead(chd, hunknum);
+
+	/* if the hunk is cached, or is being read ahead, copy it from there */
+	while (chd->hunkslot[hunknum] != NO_SLOT)
+	{
+		entry = &chd->hunkcache[chd->hunkslot[hunknum]];
+		if (entry->state == HUNK_READY)
+		{
+			entry->stamp = chd->hunkstamp++;
+			memcpy(buffer, &entry->data[offset], count);
+			CACHE_UNLOCK();
+			return CHDERR_NONE;
+		}
+		CACHE_WAIT();
+	}
+
+	/* otherwise decompress it into a new entry; the read-ahead thread */
+	/* loads at most one entry at a time, so there is always one left */
+	entry = alloc_lru_entry(chd, hunknum);
+	CACHE_UNLOCK();
+	if (!entry)
+	{
+		/* no spare entry, use the single hunk cache */
+		err = read_hunk_into_cache(chd, hunknum);
+		if (err == CHDERR_NONE)
+			memcpy(buffer, &chd->cache[offset], count);
+		return err;
+	}
+
+	err = read_hunk_into_memory(chd, hunknum, entry->data, NULL);
+
+	CACHE_LOCK();
+	if (err == CHDERR_NONE)
+		memcpy(buffer, &entry->data[offset], count);
+	finish_lru_entry(chd, entry, err);
+	CACHE_UNLOCK();
+	return err;
+}
+
+
+static void update_hunk_in_lru(chd_file *chd, UINT32 hunknum, const UINT8 *src)
+{
+	CACHE_LOCK();
+	if (chd->hunkslot[hunknum] != NO_SLOT)
+	{
+		hunk_cache_entry *entry = &chd->hunkcache[chd->hunkslot[hunknum]];
+		if (entry->state == HUNK_READY)
+			memcpy(entry->data, src, chd->header.hunkbytes);
+	}
+	CACHE_UNLOCK();
+}
+
+
+
+/*************************************
+ *
+ *  Hunk read-ahead
+ *
+ *************************************/
+
+#ifdef USE_SMP
+static void *read_ahead_thread(void *param)
+{
+	CACHE_LOCK();
+	while (!readahead_exit)
+	{
+		hunk_cache_entry *entry;
+		chd_file *chd;
+		UINT32 hunknum;
+		int err;
+
+		/* find a file with queued hunks, or wait for one */
+		for (chd = first_file; chd; chd = chd->next)
+			if (chd->queuecount)
+				break;
+		if (!chd)
+		{
+			pthread_cond_wait(&cache_queued, &cache_mutex);
+			continue;
+		}
+
+		/* take the oldest request, skipping the hunks read in the meantime */
+		hunknum = chd->queue[chd->queuehead];
+		chd->queuehead = (chd->queuehead + 1) % READAHEAD_QUEUE;
+		chd->queuecount--;
+		if (chd->hunkslot[hunknum] != NO_SLOT)
+			continue;
+		entry = alloc_lru_entry(chd, hunknum);
+		if (!entry)
+			continue;
+
+		/* decompress it without the lock, so the emulation can read the other hunks */
+		readahead_current = chd;
+		CACHE_UNLOCK();
+		err = read_hunk_into_memory(chd, hunknum, entry->data, &chd->aheaddecoder);
+		CACHE_LOCK();
+		readahead_current = NULL;
+		finish_lru_entry(chd, entry, err);
+	}
+	CACHE_UNLOCK();
+	return NULL;
+}
+#endif
+
+
+/* detect sequential readers and queue the hunks ahead of them; the cache lock must be held */
+static void queue_read_ahead(chd_file *chd, UINT32 hunknum)
+{
+#ifdef USE_SMP
+	UINT32 ahead, count, i, j;
+
+	/* find the reader continuing from its last hunk */
+	for (i = 0; i < READAHEAD_STREAMS; i++)
+		if (chd->streamlast[i] == hunknum || chd->streamlast[i] + 1 == hunknum)
+			break;
+
+	/* a random access starts a new reader, replacing the oldest one */
+	if (i == READAHEAD_STREAMS)
+	{
+		chd->streamlast[chd->streamnext] = hunknum;
+		chd->streamnext = (chd->streamnext + 1) % READAHEAD_STREAMS;
+		return;
+	}
+
+	/* nothing new if still in the same hunk */
+	if (chd->streamlast[i] == hunknum)
+		return;
+	chd->streamlast[i] = hunknum;
+
+	/* never read ahead more than half of the cache */
+	ahead = READAHEAD_HUNKS;
+	if (ahead > chd->hunkcachesize / 2)
+		ahead = chd->hunkcachesize / 2;
+
+	/* queue the next hunks not already cached or queued */
+	count = chd->queuecount;
+	for (i = 1; i <= ahead && hunknum + i < chd->header.totalhunks && chd->queuecount < READAHEAD_QUEUE; i++)
+	{
+		UINT32 next = hunknum + i;
+
+		if (chd->hunkslot[next] != NO_SLOT)
+			continue;
+		for (j = 0; j < chd->queuecount; j++)
+			if (chd->queue[(chd->queuehead + j) % READAHEAD_QUEUE] == next)
+				break;
+		if (j < chd->queuecount)
+			continue;
+		chd->queue[(chd->queuehead + chd->queuecount) % READAHEAD_QUEUE] = next;
+		chd->queuecount++;
+	}
+	if (chd->queuecount == count)
+		return;
+
+	/* start the thread at the first request */
+	if (!readahead_started)
+	{
+		if (pthread_create(&readahead_thread, NULL, read_ahead_thread, NULL) != 0)
+		{
+			chd->readahead = 0;
+			chd->queuecount = 0;
+			return;
+		}
+		readahead_started = 1;
+	}
+	pthread_cond_signal(&cache_queued);
+#endif
+}
+
+
+
 /*************************************
  *
  *  Hunk write/compress
@@ -1429,6 +1908,49 @@ static int read_hunk_into_cache(chd_file *chd, UINT32 hunknum)
  *************************************/
 
 static int write_hunk_from_memory(chd_file *chd, UINT32 hunknum, const UINT8 *src)
+{
+	/* compress it only if needed */
+	return write_compressed_hunk(chd, hunknum, src, fast_crc32(0, &src[0], chd->header.hunkbytes), NULL, 0);
+}
+
+
+/* compress a hunk; returns the compressed length, or hunkbytes if it doesn't compress */
+static UINT32 compress_hunk(chd_file *chd, void *codecdata, const UINT8 *src, UINT8 *dest)
+{
+	switch (chd->header.compression)
+	{
+		case CHDCOMPRESSION_ZLIB:
+		case CHDCOMPRESSION_ZLIB_PLUS:
+		{
+			zlib_codec_data *codec = codecdata;
+			int err;
+
+			/* reset the decompressor */
+			codec->deflater.next_in = (void *)src;
+			codec->deflater.avail_in = chd->header.hunkbytes;
+			codec->deflater.total_in = 0;
+			codec->deflater.next_out = dest;
+			codec->deflater.avail_out = chd->header.hunkbytes;
+			codec->deflater.total_out = 0;
+			err = deflateReset(&codec->deflater);
+			if (err != Z_OK)
+				return chd->header.hunkbytes;
+
+			/* do it */
+			err = deflate(&codec->deflater, Z_FINISH);
+
+			/* if we didn't run out of space, use the compressed data */
+			if (err == Z_STREAM_END && codec->deflater.total_out < chd->header.hunkbytes)
+				return codec->deflater.total_out;
+			break;
+		}
+	}
+	return chd->header.hunkbytes;
+}
+
+
+/* write a hunk with its CRC; the compressed data is computed here if NULL */
+static int write_compressed_hunk(chd_file *chd, UINT32 hunknum, const UINT8 *src, UINT32 crc, const UINT8 *compressed, UINT32 length)
 {
 	map_entry *entry = &chd->map[hunknum];
 	map_entry newentry;
@@ -1436,8 +1958,8 @@ static int write_hunk_from_memory(chd_file *chd, UINT32 hunknum, const UINT8 *sr
 	const void *data = src;
 	UINT32 bytes, match;
 
-	/* first compute the CRC */
-	newentry.crc = crc32(0, &src[0], chd->header.hunkbytes);
+	/* first set the CRC */
+	newentry.crc = crc;
 
 	/* some extra stuff for zlib+ compression */
 	if (chd->header.compression == CHDCOMPRESSION_ZLIB_PLUS)
@@ -1481,42 +2003,20 @@ static int write_hunk_from_memory(chd_file *chd, UINT32 hunknum, const UINT8 *sr
 	}
 
 	/* if we get here, we need to compress the data */
-	/* first, fill in an uncompressed entry */
+	if (!compressed)
+	{
+		length = compress_hunk(chd, chd->codecdata, src, chd->compressed);
+		compressed = chd->compressed;
+	}
+
+	/* fill in an uncompressed entry, unless the compression helped */
 	newentry.length = chd->header.hunkbytes;
 	newentry.flags = MAP_ENTRY_TYPE_UNCOMPRESSED;
-
-	/* now try compressing the data */
-	switch (chd->header.compression)
+	if (length < chd->header.hunkbytes)
 	{
-		case CHDCOMPRESSION_ZLIB:
-		case CHDCOMPRESSION_ZLIB_PLUS:
-		{
-			zlib_codec_data *codec = chd->codecdata;
-			int err;
-
-			/* reset the decompressor */
-			codec->deflater.next_in = (void *)src;
-			codec->deflater.avail_in = chd->header.hunkbytes;
-			codec->deflater.total_in = 0;
-			codec->deflater.next_out = chd->compressed;
-			codec->deflater.avail_out = chd->header.hunkbytes;
-			codec->deflater.total_out = 0;
-			err = deflateReset(&codec->deflater);
-			if (err != Z_OK)
-				return CHDERR_COMPRESSION_ERROR;
-
-			/* do it */
-			err = deflate(&codec->deflater, Z_FINISH);
-
-			/* if we didn't run out of space, override the raw data with compressed */
-			if (err == Z_STREAM_END && codec->deflater.total_out < newentry.length)
-			{
-				data = chd->compressed;
-				newentry.length = codec->deflater.total_out;
-				newentry.flags = MAP_ENTRY_TYPE_COMPRESSED;
-			}
-			break;
-		}
+		data = compressed;
+		newentry.length = length;
+		newentry.flags = MAP_ENTRY_TYPE_COMPRESSED;
 	}
 
 	/* if the data doesn't fit into the previous entry, make a new one at the eof */
@@ -1838,7 +2338,7 @@ static int is_really_matching_hunk(chd_file *chd, UINT32 hunknum, const UINT8 *r
 	if (hunknum != chd->comparehunk)
 	{
 		chd->comparehunk = ~0;
-		if (read_hunk_into_memory(chd, hunknum, chd->compare) == CHDERR_NONE)
+		if (read_hunk_into_memory(chd, hunknum, chd->compare, NULL) == CHDERR_NONE)
 			chd->comparehunk = hunknum;
 	}
 	return (hunknum == chd->comparehunk && !memcmp(rawdata, chd->compare, chd->header.hunkbytes));
@@ -1963,6 +2463,14 @@ chd_exfile *chd_start_compress_ex(chd_file *chd)
 	if (!finalchdex)
 		SET_ERROR_AND_CLEANUP(CHDERR_OUT_OF_MEMORY);
 
+	/* allocate the buffers and the compressors of the batches */
+	finalchdex->batch = alloc_batch(chd, 0);
+	if (!finalchdex->batch)
+	{
+		free(finalchdex);
+		SET_ERROR_AND_CLEANUP(CHDERR_OUT_OF_MEMORY);
+	}
+
 	/* init the MD5/SHA1 computations */
 	MD5Init(&finalchdex->md5);
 	sha1_init(&finalchdex->sha);
@@ -1986,7 +2494,7 @@ int chd_compress_ex(chd_exfile *chdex, const char *rawfile, UINT64 offset,
 	clock_t lastupdate;
 	int err;
 	UINT64 sourcefileoffset = 0;
-	int hunk, blksread = 0;
+	int hunk, count, blksread = 0;
 
 	/* punt if no interface */
 	if (!cur_interface.open)
@@ -2003,31 +2511,38 @@ int chd_compress_ex(chd_exfile *chdex, const char *rawfile, UINT64 offset,
 	if (!sourcefile)
 		SET_ERROR_AND_CLEANUP(CHDERR_FILE_NOT_FOUND);
 
-	/* loop over source hunks until we run out */
+	/* loop over batches of source hunks until we run out */
 	lastupdate = 0;
-	for (hunk = 0; hunk < hunks_to_read; hunk++)
+	for (hunk = 0; hunk < hunks_to_read; hunk += count)
 	{
 		clock_t curtime = clock();
-		UINT32 bytestochecksum;
-		UINT32 bytesread;
-		int i;
+		int i, j;
 
-		/* read the data.  first, zero the whole hunk */
-		memset(chd->cache, 0, chd->header.hunkbytes);
+		count = hunks_to_read - hunk;
+		if (count > BATCH_HUNKS)
+			count = BATCH_HUNKS;
 
-		/* read each frame to a maximum framesize boundry, automatically padding them out */
-		for (i = 0; i < srcperhunk; i++)
+		for (j = 0; j < count; j++)
 		{
-			bytesread = multi_read(sourcefile, sourcefileoffset + offset, inpsecsize, &chd->cache[i*hunksecsize]);
-			/*
-               NOTE: because we pad CD tracks to a hunk boundry, there is a possibility
-               that we will run off the end of the sourcefile and bytesread will be zero.
-               because we already zero out the hunk beforehand above, no special processing
-               need take place here.
-            */
-
-			blksread++;
-			sourcefileoffset += inpsecsize;
+			UINT8 *raw = chdex->batch->raw[0] + j * chd->header.hunkbytes;
+
+			/* read the data.  first, zero the whole hunk */
+			memset(raw, 0, chd->header.hunkbytes);
+
+			/* read each frame to a maximum framesize boundry, automatically padding them out */
+			for (i = 0; i < srcperhunk; i++)
+			{
+				multi_read(sourcefile, sourcefileoffset + offset, inpsecsize, &raw[i*hunksecsize]);
+				/*
+                   NOTE: because we pad CD tracks to a hunk boundry, there is a possibility
+                   that we will run off the end of the sourcefile and bytesread will be zero.
+                   because we already zero out the hunk beforehand above, no special processing
+                   need take place here.
+                */
+
+				blksread++;
+				sourcefileoffset += inpsecsize;
+			}
 		}
 
 		/* progress */
@@ -2039,37 +2554,18 @@ int chd_compress_ex(chd_exfile *chdex, const char *rawfile, UINT64 offset,
 			lastupdate = curtime;
 		}
 
-		/* update the MD5/SHA1 */
-		bytestochecksum = chd->header.hunkbytes;
-		if (chdex->sourceoffset + chd->header.hunkbytes > chd->header.logicalbytes)
-		{
-			if (chdex->sourceoffset >= chd->header.logicalbytes)
-				bytestochecksum = 0;
-			else
-				bytestochecksum = chd->header.logicalbytes - chdex->sourceoffset;
-		}
-		if (bytestochecksum)
-		{
-			MD5Update(&chdex->md5, chd->cache, bytestochecksum);
-			sha1_update(&chdex->sha, bytestochecksum, chd->cache);
-		}
-
-		/* write out the hunk */
-		err = write_hunk_from_memory(chd, hunk + chdex->hunknum, chd->cache);
+		/* checksum, compress and write out the hunks */
+		err = compress_batch(chd, chdex->batch, hunk + chdex->hunknum, count, chdex->sourceoffset, &chdex->md5, &chdex->sha);
 		if (err != CHDERR_NONE)
 			SET_ERROR_AND_CLEANUP(err);
 
-		/* update our CRC map */
-		if ((chd->map[hunk + chdex->hunknum].flags & MAP_ENTRY_FLAG_TYPE_MASK) != MAP_ENTRY_TYPE_SELF_HUNK &&
-			(chd->map[hunk + chdex->hunknum].flags & MAP_ENTRY_FLAG_TYPE_MASK) != MAP_ENTRY_TYPE_PARENT_HUNK)
-			add_to_crcmap(chd, hunk + chdex->hunknum);
-
-		/* prepare for the next hunk */
-		chdex->sourceoffset += chd->header.hunkbytes;
+		/* prepare for the next batch */
+		chdex->sourceoffset += (UINT64)count * chd->header.hunkbytes;
 	}
 
 	chdex->hunknum += hunks_to_read;
 
+	multi_close(sourcefile);
 	return CHDERR_NONE;
 
 cleanup:
@@ -2105,6 +2601,7 @@ int chd_end_compress_ex(chd_exfile *chdex, void (*progress)(const char *, ...))
 	}
 
 cleanup:
+	free_batch(chdex->batch);
 	free(chdex);
 	return err;
 }
@@ -2288,6 +2785,272 @@ static void free_codec(chd_file *chd)
 
 
 
+/*************************************
+ *
+ *  Additional codecs
+ *
+ *************************************/
+
+/* a zlib stream for the additional threads, with its own fast memory */
+static void *init_zlib_stream(int deflater)
+{
+	zlib_codec_data *data;
+	int err;
+
+	data = malloc(sizeof(zlib_codec_data));
+	if (!data)
+		return NULL;
+	memset(data, 0, sizeof(zlib_codec_data));
+
+	if (deflater)
+	{
+		data->deflater.zalloc = fast_alloc;
+		data->deflater.zfree = fast_free;
+		data->deflater.opaque = data;
+		err = deflateInit2(&data->deflater, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	}
+	else
+	{
+		data->inflater.zalloc = fast_alloc;
+		data->inflater.zfree = fast_free;
+		data->inflater.opaque = data;
+		err = inflateInit2(&data->inflater, -MAX_WBITS);
+	}
+	if (err != Z_OK)
+	{
+		free_zlib_stream(data);
+		return NULL;
+	}
+	return data;
+}
+
+
+static void free_zlib_stream(void *codecdata)
+{
+	zlib_codec_data *data = codecdata;
+	int i;
+
+	/* ending a stream never initialized is harmless */
+	inflateEnd(&data->inflater);
+	deflateEnd(&data->deflater);
+	for (i = 0; i < MAX_ZLIB_ALLOCS; i++)
+		if (data->allocptr[i])
+			free(data->allocptr[i]);
+	free(data);
+}
+
+
+/* a decoder works also for the parents, whatever their compression */
+static int init_decoder(hunk_decoder *decoder, UINT32 hunkbytes)
+{
+	decoder->compressed = malloc(hunkbytes);
+	decoder->codecdata = init_zlib_stream(0);
+	if (!decoder->compressed || !decoder->codecdata)
+	{
+		free_decoder(decoder);
+		return CHDERR_OUT_OF_MEMORY;
+	}
+	return CHDERR_NONE;
+}
+
+
+static void free_decoder(hunk_decoder *decoder)
+{
+	if (decoder->codecdata)
+		free_zlib_stream(decoder->codecdata);
+	if (decoder->compressed)
+		free(decoder->compressed);
+	decoder->codecdata = NULL;
+	decoder->compressed = NULL;
+}
+
+
+
+/*************************************
+ *
+ *  Hunk batches
+ *
+ *************************************/
+
+static hunk_batch *alloc_batch(chd_file *chd, int decode)
+{
+	hunk_batch *batch;
+	int i;
+
+	batch = malloc(sizeof(*batch));
+	if (!batch)
+		return NULL;
+	memset(batch, 0, sizeof(*batch));
+
+	/* one zlib stream for each thread */
+	batch->threads = 1;
+#ifdef _OPENMP
+	batch->threads = omp_get_max_threads();
+#endif
+
+	batch->raw[0] = malloc(BATCH_HUNKS * chd->header.hunkbytes);
+	if (!batch->raw[0])
+		goto error;
+
+	if (decode)
+	{
+		/* a second buffer is checksummed while the first is decompressed */
+		batch->raw[1] = malloc(BATCH_HUNKS * chd->header.hunkbytes);
+		batch->decoder = malloc(batch->threads * sizeof(batch->decoder[0]));
+		if (!batch->raw[1] || !batch->decoder)
+			goto error;
+		memset(batch->decoder, 0, batch->threads * sizeof(batch->decoder[0]));
+		for (i = 0; i < batch->threads; i++)
+			if (init_decoder(&batch->decoder[i], chd->header.hunkbytes) != CHDERR_NONE)
+				goto error;
+	}
+	else
+	{
+		batch->compressed = malloc(BATCH_HUNKS * chd->header.hunkbytes);
+		batch->codecdata = malloc(batch->threads * sizeof(batch->codecdata[0]));
+		if (!batch->compressed || !batch->codecdata)
+			goto error;
+		memset(batch->codecdata, 0, batch->threads * sizeof(batch->codecdata[0]));
+		if (chd->header.compression != CHDCOMPRESSION_NONE)
+			for (i = 0; i < batch->threads; i++)
+			{
+				batch->codecdata[i] = init_zlib_stream(1);
+				if (!batch->codecdata[i])
+					goto error;
+			}
+	}
+	return batch;
+
+error:
+	free_batch(batch);
+	return NULL;
+}
+
+
+static void free_batch(hunk_batch *batch)
+{
+	int i;
+
+	if (batch->decoder)
+	{
+		for (i = 0; i < batch->threads; i++)
+			free_decoder(&batch->decoder[i]);
+		free(batch->decoder);
+	}
+	if (batch->codecdata)
+	{
+		for (i = 0; i < batch->threads; i++)
+			if (batch->codecdata[i])
+				free_zlib_stream(batch->codecdata[i]);
+		free(batch->codecdata);
+	}
+	if (batch->compressed)
+		free(batch->compressed);
+	if (batch->raw[1])
+		free(batch->raw[1]);
+	if (batch->raw[0])
+		free(batch->raw[0]);
+	free(batch);
+}
+
+
+/* update the MD5/SHA1 with the raw data of the hunks, up to the logical end */
+static void checksum_batch(chd_file *chd, const UINT8 *raw, UINT32 count, UINT64 sourceoffset, struct MD5Context *md5, struct sha1_ctx *sha)
+{
+	UINT64 bytestochecksum = (UINT64)count * chd->header.hunkbytes;
+
+	if (sourceoffset >= chd->header.logicalbytes)
+		return;
+	if (sourceoffset + bytestochecksum > chd->header.logicalbytes)
+		bytestochecksum = chd->header.logicalbytes - sourceoffset;
+
+	MD5Update(md5, raw, bytestochecksum);
+	sha1_update(sha, bytestochecksum, raw);
+}
+
+
+/* compress the hunks read in raw[0] and write them out in order */
+static int compress_batch(chd_file *chd, hunk_batch *batch, UINT32 hunknum, UINT32 count, UINT64 sourceoffset, struct MD5Context *md5, struct sha1_ctx *sha)
+{
+	UINT32 hunkbytes = chd->header.hunkbytes;
+	int i, err;
+
+	/* one thread checksums the batch while the others compress it */
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif
+		checksum_batch(chd, batch->raw[0], count, sourceoffset, md5, sha);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (i = 0; i < count; i++)
+		{
+			UINT8 *raw = batch->raw[0] + i * hunkbytes;
+			int thread = 0;
+
+#ifdef _OPENMP
+			thread = omp_get_thread_num();
+#endif
+			batch->crc[i] = fast_crc32(0, raw, hunkbytes);
+			batch->length[i] = compress_hunk(chd, batch->codecdata[thread], raw, batch->compressed + i * hunkbytes);
+		}
+	}
+
+	/* the duplicates depend on the previous hunks, so look for them while writing in order */
+	for (i = 0; i < count; i++)
+	{
+		err = write_compressed_hunk(chd, hunknum + i, batch->raw[0] + i * hunkbytes, batch->crc[i], batch->compressed + i * hunkbytes, batch->length[i]);
+		if (err != CHDERR_NONE)
+			return err;
+
+		/* update our CRC map */
+		if ((chd->map[hunknum + i].flags & MAP_ENTRY_FLAG_TYPE_MASK) != MAP_ENTRY_TYPE_SELF_HUNK &&
+			(chd->map[hunknum + i].flags & MAP_ENTRY_FLAG_TYPE_MASK) != MAP_ENTRY_TYPE_PARENT_HUNK)
+			add_to_crcmap(chd, hunknum + i);
+	}
+	return CHDERR_NONE;
+}
+
+
+/* decompress the hunks into raw[which], while checksumming the previous ones in the other buffer */
+static void decompress_batch(chd_file *chd, hunk_batch *batch, int which, UINT32 hunknum, UINT32 count,
+	UINT32 prevcount, UINT64 prevoffset, struct MD5Context *md5, struct sha1_ctx *sha)
+{
+	UINT32 hunkbytes = chd->header.hunkbytes;
+	int i;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif
+		if (prevcount)
+			checksum_batch(chd, batch->raw[which ^ 1], prevcount, prevoffset, md5, sha);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (i = 0; i < count; i++)
+		{
+			int thread = 0;
+
+#ifdef _OPENMP
+			thread = omp_get_thread_num();
+#endif
+			batch->err[i] = read_hunk_into_memory(chd, hunknum + i, batch->raw[which] + i * hunkbytes, &batch->decoder[thread]);
+		}
+	}
+}
+
+
+
 /*************************************
  *
  *  Multifile routines
@@ -2304,17 +3067,38 @@ static void multi_close(chd_interface_file *file)
 	(*cur_interface.close)(file);
 }
 
+/* the read-ahead thread and the verify workers read too, and the interface handles aren't thread safe */
 static UINT32 multi_read(chd_interface_file *file, UINT64 offset, UINT32 count, void *buffer)
 {
-	return (*cur_interface.read)(file, offset, count, buffer);
+	UINT32 result;
+
+#ifdef _OPENMP
+#pragma omp critical (chd_io)
+#endif
+	{
+		IO_LOCK();
+		result = (*cur_interface.read)(file, offset, count, buffer);
+		IO_UNLOCK();
+	}
+	return result;
 }
 
 static UINT32 multi_write(chd_interface_file *file, UINT64 offset, UINT32 count, const void *buffer)
 {
-	return (*cur_interface.write)(file, offset, count, buffer);
+	UINT32 result;
+
+	IO_LOCK();
+	result = (*cur_interface.write)(file, offset, count, buffer);
+	IO_UNLOCK();
+	return result;
 }
 
 static UINT64 multi_length(chd_interface_file *file)
 {
-	return (*cur_interface.length)(file);
+	UINT64 result;
+
+	IO_LOCK();
+	result = (*cur_interface.length)(file);
+	IO_UNLOCK();
+	return result;
 }
@@ -189,6 +189,7 @@ typedef struct _chd_interface chd_interface;
 
 void chd_set_interface(chd_interface *new_interface);
 void chd_save_interface(chd_interface *interface_save);
+void chd_set_cache_size(UINT32 hunks);
 
 int chd_create(const char *filename, UINT64 logicalbytes, UINT32 hunkbytes, UINT32 compression, chd_file *parent);
 chd_file *chd_open(const char *filename, int writeable, chd_file *parent);
@@ -199,6 +200,7 @@ UINT32 chd_get_metadata(chd_file *chd, UINT32 *metatag, UINT32 metaindex, void *
 int chd_set_metadata(chd_file *chd, UINT32 metatag, UINT32 metaindex, const void *inputbuf, UINT32 inputlen);
 
 UINT32 chd_read(chd_file *chd, UINT32 hunknum, UINT32 hunkcount, void *buffer);
+UINT32 chd_read_partial(chd_file *chd, UINT32 hunknum, UINT32 offset, UINT32 count, void *buffer);
 UINT32 chd_write(chd_file *chd, UINT32 hunknum, UINT32 hunkcount, const void *buffer);
 
 int chd_get_last_error(void);
@@ -28,9 +28,11 @@ COREOBJS = \
 	$(OBJ)/cpuintrf.o \
 	$(OBJ)/drawgfx.o \
 	$(OBJ)/driver.o \
+	$(OBJ)/fastcrc.o \
 	$(OBJ)/fileio.o \
 	$(OBJ)/harddisk.o \
 	$(OBJ)/hash.o \
+	$(OBJ)/hashcache.o \
 	$(OBJ)/hiscore.o \
 	$(OBJ)/info.o \
 	$(OBJ)/input.o \
@@ -42,6 +44,7 @@ COREOBJS = \
 	$(OBJ)/memory.o \
 	$(OBJ)/palette.o \
 	$(OBJ)/png.o \
+	$(OBJ)/romcache.o \
 	$(OBJ)/romload.o \
 	$(OBJ)/sha1.o \
 	$(OBJ)/sound.o \
@@ -803,6 +803,9 @@ int pdrawgfx_shadow_lowpri = 0;
 /* 32-bit version */
 //* AAT032503: added limited 32-bit shadow and highlight support
 INLINE UINT32 SHADOW32(UINT32 c) {
+	const UINT32 *rgb = palette_shadow_table_rgb32;
+	if (rgb) /* per channel tables, they stay in cache */
+		return(rgb[c>>19&0x1f] | rgb[32 + (c>>11&0x1f)] | rgb[64 + (c>>3&0x1f)]);
 	c = (c>>9&0x7c00) | (c>>6&0x03e0) | (c>>3&0x001f);
 	return(((UINT32*)palette_shadow_table)[c]); }
 
@@ -1078,6 +1081,90 @@ void copyscrollbitmap(mame_bitmap *dest,mame_bitmap *src,
 	copyscrollbitmap_remap(dest,src,rows,rowscroll,cols,colscroll,clip,transparency,transparent_color);
 }
 
+/*
+  Opaque row scroll, with an optional vertical scroll of the whole bitmap.
+  For every destination row the source row and the horizontal offset are
+  computed directly and the row is copied with at most two memcpy(), instead
+  of clipping and dispatching two copybitmap() for each group of rows.
+  The covered area is the same of the generic code: the source is drawn at
+  scroll and at scroll - srcwidth horizontally, and if vscroll is set at
+  scrolly and scrolly - srcheight vertically.
+*/
+static void copyscrollbitmap_rows_opaque(mame_bitmap *dest,mame_bitmap *src,
+		int rows,const int *rowscroll,int vscroll,int scrolly,const rectangle *clip)
+{
+	int srcwidth = src->width;
+	int srcheight = src->height;
+	int rowheight = srcheight / rows;
+	int bpp = (dest->depth + 7) / 8;
+	int min_x, max_x, min_y, max_y;
+	int y;
+
+	/* more rows than lines, nothing is drawn */
+	if (rowheight == 0)
+		return;
+
+	min_x = clip->min_x;
+	if (min_x < 0) min_x = 0;
+	max_x = clip->max_x;
+	if (max_x > dest->width-1) max_x = dest->width-1;
+
+	min_y = clip->min_y;
+	if (min_y < 0) min_y = 0;
+	max_y = clip->max_y;
+	if (max_y > dest->height-1) max_y = dest->height-1;
+
+	/* vertical coverage */
+	if (vscroll)
+	{
+		if (min_y < scrolly - srcheight) min_y = scrolly - srcheight;
+		if (max_y > scrolly + srcheight-1) max_y = scrolly + srcheight-1;
+	}
+	else
+	{
+		if (max_y > srcheight-1) max_y = srcheight-1;
+	}
+
+	for (y = min_y; y <= max_y; y++)
+	{
+		int srcy, row, scroll, x0, x1, split;
+		UINT8 *dd, *sd;
+
+		srcy = y - scrolly;
+		if (srcy < 0) srcy += srcheight;
+
+		row = srcy / rowheight;
+		if (row >= rows)
+			continue;
+
+		scroll = rowscroll[row];
+		if (scroll < 0) scroll = srcwidth - (-scroll) % srcwidth;
+		else scroll %= srcwidth;
+
+		/* horizontal coverage */
+		x0 = min_x;
+		if (x0 < scroll - srcwidth) x0 = scroll - srcwidth;
+		x1 = max_x;
+		if (x1 > scroll + srcwidth-1) x1 = scroll + srcwidth-1;
+		if (x0 > x1)
+			continue;
+
+		dd = (UINT8 *)dest->line[y];
+		sd = (UINT8 *)src->line[srcy];
+
+		/* left part comes from the end of the source row */
+		split = scroll;
+		if (split > x1 + 1) split = x1 + 1;
+		if (x0 < split)
+			memcpy(dd + x0 * bpp, sd + (x0 - scroll + srcwidth) * bpp, (split - x0) * bpp);
+
+		/* right part comes from the start of the source row */
+		if (x0 < scroll) x0 = scroll;
+		if (x0 <= x1)
+			memcpy(dd + x0 * bpp, sd + (x0 - scroll) * bpp, (x1 - x0 + 1) * bpp);
+	}
+}
+
 void copyscrollbitmap_remap(mame_bitmap *dest,mame_bitmap *src,
 		int rows,const int *rowscroll,int cols,const int *colscroll,
 		const rectangle *clip,int transparency,int transparent_color)
@@ -1115,7 +1202,20 @@ void copyscrollbitmap_remap(mame_bitmap *dest,mame_bitmap *src,
 	destwidth = dest->width;
 	destheight = dest->height;
 
-	if (rows == 0)
+	if (transparency == TRANSPARENCY_NONE_RAW && rows != 0 && (cols == 0 || (cols == 1 && rows > 1)))
+	{
+		/* opaque scrolling rows, copied directly row by row */
+		int scrolly = 0;
+
+		if (cols == 1)
+		{
+			if (colscroll[0] < 0) scrolly = srcheight - (-colscroll[0]) % srcheight;
+			else scrolly = colscroll[0] % srcheight;
+		}
+
+		copyscrollbitmap_rows_opaque(dest,src,rows,rowscroll,cols,scrolly,clip);
+	}
+	else if (rows == 0)
 	{
 		/* scrolling columns */
 		int col,colwidth;
@@ -5613,109 +5713,111 @@ DECLARE(copyrozbitmap_core,(mame_bitmap *bitmap,mame_bitmap *srcbitmap,
 	}
 	else
 	{
+		/* the rows are independent, and they can be drawn in parallel */
+		int rows = ey - sy + 1;
+		int row;
+
 		if (wraparound)
 		{
 			/* plot with wraparound */
-			while (sy <= ey)
+			ROZ_PARALLEL_FOR(rows)
+			for (row = 0; row < rows; row++)
 			{
-				x = sx;
-				cx = startx;
-				cy = starty;
-				dest = ((DATA_TYPE *)bitmap->line[sy]) + sx;
+				UINT32 rcx = startx + (UINT32)row * incyx;
+				UINT32 rcy = starty + (UINT32)row * incyy;
+				int rx = sx;
+				DATA_TYPE *rdest = ((DATA_TYPE *)bitmap->line[sy + row]) + sx;
+
 				if (priority)
 				{
-					UINT8 *pri = ((UINT8 *)priority_bitmap->line[sy]) + sx;
+					UINT8 *pri = ((UINT8 *)priority_bitmap->line[sy + row]) + sx;
 
-					while (x <= ex)
+					while (rx <= ex)
 					{
-						int c = ((DATA_TYPE *)srcbitmap->line[(cy >> 16) & ymask])[(cx >> 16) & xmask];
+						int c = ((DATA_TYPE *)srcbitmap->line[(rcy >> 16) & ymask])[(rcx >> 16) & xmask];
 
 						if (c != transparent_color)
 						{
-							*dest = c;
+							*rdest = c;
 							*pri |= priority;
 						}
 
-						cx += incxx;
-						cy += incxy;
-						x++;
-						dest++;
+						rcx += incxx;
+						rcy += incxy;
+						rx++;
+						rdest++;
 						pri++;
 					}
 				}
 				else
 				{
-					while (x <= ex)
+					while (rx <= ex)
 					{
-						int c = ((DATA_TYPE *)srcbitmap->line[(cy >> 16) & ymask])[(cx >> 16) & xmask];
+						int c = ((DATA_TYPE *)srcbitmap->line[(rcy >> 16) & ymask])[(rcx >> 16) & xmask];
 
 						if (c != transparent_color)
-							*dest = c;
+							*rdest = c;
 
-						cx += incxx;
-						cy += incxy;
-						x++;
-						dest++;
+						rcx += incxx;
+						rcy += incxy;
+						rx++;
+						rdest++;
 					}
 				}
-				startx += incyx;
-				starty += incyy;
-				sy++;
 			}
 		}
 		else
 		{
-			while (sy <= ey)
+			ROZ_PARALLEL_FOR(rows)
+			for (row = 0; row < rows; row++)
 			{
-				x = sx;
-				cx = startx;
-				cy = starty;
-				dest = ((DATA_TYPE *)bitmap->line[sy]) + sx;
+				UINT32 rcx = startx + (UINT32)row * incyx;
+				UINT32 rcy = starty + (UINT32)row * incyy;
+				int rx = sx;
+				DATA_TYPE *rdest = ((DATA_TYPE *)bitmap->line[sy + row]) + sx;
+
 				if (priority)
 				{
-					UINT8 *pri = ((UINT8 *)priority_bitmap->line[sy]) + sx;
+					UINT8 *pri = ((UINT8 *)priority_bitmap->line[sy + row]) + sx;
 
-					while (x <= ex)
+					while (rx <= ex)
 					{
-						if (cx < widthshifted && cy < heightshifted)
+						if (rcx < widthshifted && rcy < heightshifted)
 						{
-							int c = ((DATA_TYPE *)srcbitmap->line[cy >> 16])[cx >> 16];
+							int c = ((DATA_TYPE *)srcbitmap->line[rcy >> 16])[rcx >> 16];
 
 							if (c != transparent_color)
 							{
-								*dest = c;
+								*rdest = c;
 								*pri |= priority;
 							}
 						}
 
-						cx += incxx;
-						cy += incxy;
-						x++;
-						dest++;
+						rcx += incxx;
+						rcy += incxy;
+						rx++;
+						rdest++;
 						pri++;
 					}
 				}
 				else
 				{
-					while (x <= ex)
+					while (rx <= ex)
 					{
-						if (cx < widthshifted && cy < heightshifted)
+						if (rcx < widthshifted && rcy < heightshifted)
 						{
-							int c = ((DATA_TYPE *)srcbitmap->line[cy >> 16])[cx >> 16];
+							int c = ((DATA_TYPE *)srcbitmap->line[rcy >> 16])[rcx >> 16];
 
 							if (c != transparent_color)
-								*dest = c;
+								*rdest = c;
 						}
 
-						cx += incxx;
-						cy += incxy;
-						x++;
-						dest++;
+						rcx += incxx;
+						rcy += incxy;
+						rx++;
+						rdest++;
 					}
 				}
-				startx += incyx;
-				starty += incyy;
-				sy++;
 			}
 		}
 	}
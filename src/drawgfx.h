@@ -264,6 +264,17 @@ void copyrozbitmap(mame_bitmap *dest,mame_bitmap *src,
 		UINT32 startx,UINT32 starty,int incxx,int incxy,int incyx,int incyy,int wraparound,
 		const rectangle *clip,int transparency,int transparent_color,UINT32 priority);
 
+/* rows of the rotate/zoom loops are drawn in parallel with OpenMP, but only */
+/* if they are enough to pay the start of the threads, as some drivers draw */
+/* one scanline at time */
+#define ROZ_PARALLEL_MIN_ROWS	64
+#if defined(_OPENMP) && (defined(__i386__) || defined(__x86_64__)) /* on ARM OpenMP is slower */
+#define ROZ_PRAGMA(x) _Pragma(#x)
+#define ROZ_PARALLEL_FOR(rows) ROZ_PRAGMA(omp parallel for if((rows) > ROZ_PARALLEL_MIN_ROWS))
+#else
+#define ROZ_PARALLEL_FOR(rows)
+#endif
+
 void fillbitmap(mame_bitmap *dest,pen_t pen,const rectangle *clip);
 void drawgfxzoom( mame_bitmap *dest_bmp,const gfx_element *gfx,
 		unsigned int code,unsigned int color,int flipx,int flipy,int sx,int sy,
@@ -0,0 +1,191 @@
+/***************************************************************************
+
+    fastcrc.c
+
+    CRC-32 computation using the carry-less multiplication of the CPU
+    when available.
+
+    The data is folded 64 bytes at time with PCLMULQDQ and reduced with
+    the Barrett method, as described in "Fast CRC Computation for Generic
+    Polynomials Using PCLMULQDQ Instruction" by Intel. The tail, and
+    everything on other CPUs, is left to the zlib crc32().
+
+    Copyright (c) 1996-2006, Nicola Salmoria and the MAME Team.
+    Visit http://mamedev.org for licensing and usage restrictions.
+
+***************************************************************************/
+
+#include <zlib.h>
+#include "fastcrc.h"
+
+/* the code is selected at runtime, so it's built only by compilers able
+   to enable the instructions for a single function */
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__i386__) || defined(__x86_64__)) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define FASTCRC_CLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+
+
+/***************************************************************************
+    CONSTANTS
+***************************************************************************/
+
+/* shorter blocks aren't worth the setup of the folding */
+#define CLMUL_MIN_LENGTH		64
+
+
+
+#ifdef FASTCRC_CLMUL
+
+/***************************************************************************
+    GLOBALS
+***************************************************************************/
+
+/* -1 until checked at the first call */
+static int clmul_supported = -1;
+
+
+
+/***************************************************************************
+    IMPLEMENTATION
+***************************************************************************/
+
+/*-------------------------------------------------
+    clmul_detect - check the CPU support of
+    PCLMULQDQ and SSE4.1
+-------------------------------------------------*/
+
+static int clmul_detect(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+
+	return (ecx & bit_PCLMUL) != 0 && (ecx & bit_SSE4_1) != 0;
+}
+
+
+/*-------------------------------------------------
+    crc32_clmul - fold the data, the length must
+    be a multiple of 16 and at least 64; the crc
+    is used inverted, without the zlib pre and
+    post conditioning
+-------------------------------------------------*/
+
+__attribute__((target("pclmul,sse4.1")))
+static UINT32 crc32_clmul(UINT32 crc, const UINT8 *data, UINT32 length)
+{
+	/* the constants of the bit reflected domain, x^n mod P(x) */
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	data += 64;
+	length -= 64;
+
+	/* fold four blocks of 16 bytes in parallel */
+	x0 = k1k2;
+	while (length >= 64)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(data + 0x30)));
+
+		data += 64;
+		length -= 64;
+	}
+
+	/* fold the four blocks into one */
+	x0 = k3k4;
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* fold the remaining blocks of 16 bytes */
+	while (length >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)data)), x5);
+
+		data += 16;
+		length -= 16;
+	}
+
+	/* reduce from 128 to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+#endif
+
+
+/*-------------------------------------------------
+    fast_crc32 - compute the crc of a block,
+    continuing from a previous crc
+-------------------------------------------------*/
+
+UINT32 fast_crc32(UINT32 crc, const UINT8 *data, UINT32 length)
+{
+#ifdef FASTCRC_CLMUL
+	/* a benign race, all the threads store the same value */
+	if (clmul_supported < 0)
+		clmul_supported = clmul_detect();
+
+	if (clmul_supported && length >= CLMUL_MIN_LENGTH)
+	{
+		UINT32 folded = length & ~15;
+
+		crc = ~crc32_clmul(~crc, data, folded);
+		data += folded;
+		length -= folded;
+	}
+#endif
+
+	return crc32(crc, data, length);
+}
@@ -0,0 +1,27 @@
+/***************************************************************************
+
+    fastcrc.h
+
+    CRC-32 computation using the carry-less multiplication of the CPU
+    when available.
+
+    Copyright (c) 1996-2006, Nicola Salmoria and the MAME Team.
+    Visit http://mamedev.org for licensing and usage restrictions.
+
+***************************************************************************/
+
+#ifndef __FASTCRC_H__
+#define __FASTCRC_H__
+
+#include "mamecore.h"
+
+
+
+/***************************************************************************
+    FUNCTION PROTOTYPES
+***************************************************************************/
+
+/* same as the zlib crc32(), the CPU support is checked at the first call */
+UINT32 fast_crc32(UINT32 crc, const UINT8 *data, UINT32 length);
+
+#endif	/* __FASTCRC_H__ */
@@ -15,6 +15,7 @@
 #include "driver.h"
 #include "chd.h"
 #include "hash.h"
+#include "hashcache.h"
 #include "unzip.h"
 
 #ifdef MESS
@@ -49,6 +50,7 @@
 
 #define FILEFLAG_OPENREAD		0x0001
 #define FILEFLAG_OPENWRITE		0x0002
+#define FILEFLAG_DEFER			0x0010
 #define FILEFLAG_HASH			0x0100
 #define FILEFLAG_REVERSE_SEARCH	0x0200
 #define FILEFLAG_VERIFY_ONLY	0x0400
@@ -86,6 +88,14 @@ struct _mame_file
 	UINT8		type;
 	char		hash[HASH_BUF_SIZE];
 	int			back_char; /* Buffered char for unget. EOF for empty. */
+	UINT8		deferred;	/* inflate and hash still to do in mame_fcomplete */
+	UINT8 *		rawdata;	/* compressed data waiting to be inflated */
+	UINT32		rawlength;
+	UINT32		rawmethod;
+	UINT8		mapped;		/* data is a view of the file from osd_fmap */
+	unsigned	hashfunctions;
+	UINT8		hashknown;	/* checksums taken from the hash cache */
+	hashcache_entry *hashentry;	/* hash cache entry to update */
 };
 
 
@@ -106,7 +116,10 @@ int mess_ghost_images;
 
 static mame_file *generic_fopen(int pathtype, const char *gamename, const char *filename, const char *hash, UINT32 flags, osd_file_error *error);
 static const char *get_extension_for_filetype(int filetype);
-static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **p, UINT64 *size, char* hash);
+static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **p, UINT64 *size, char* hash, int compute, UINT8 *mapped);
+static int lookup_hash(mame_file *file, int pathtype, int pathindex, const char *archive, const char *member, unsigned functions);
+static void compute_hash(mame_file *file, unsigned functions);
+static void hash_inflated(void *param, const unsigned char *data, unsigned length);
 static chd_interface_file *chd_open_cb(const char *filename, const char *mode);
 static void chd_close_cb(chd_interface_file *file);
 static UINT32 chd_read_cb(chd_interface_file *file, UINT64 offset, UINT32 count, void *buffer);
@@ -149,6 +162,8 @@ void fileio_init(void)
 void fileio_exit(void)
 {
 	unzip_cache_clear();
+	unzip_inflater_clear();
+	hashcache_exit();
 }
 
 
@@ -201,6 +216,7 @@ mame_file *mame_fopen_error(const char *gamename, const char *filename, int file
 		case FILETYPE_CTRLR:
 		case FILETYPE_LANGUAGE:
 		case FILETYPE_HIGHSCORE_DB:
+		case FILETYPE_HASHCACHE:
 			return generic_fopen(filetype, NULL, filename, 0, openforwrite ? FILEFLAG_OPENWRITE : FILEFLAG_OPENREAD, error);
 
 		/* game-specific files that live in a single directory */
@@ -210,6 +226,7 @@ mame_file *mame_fopen_error(const char *gamename, const char *filename, int file
 		case FILETYPE_COMMENT:
 		case FILETYPE_INI:
 		case FILETYPE_HASH:		/* MESS-specific */
+		case FILETYPE_ROMCACHE:
 			return generic_fopen(filetype, NULL, gamename, 0, openforwrite ? FILEFLAG_OPENWRITE : FILEFLAG_OPENREAD, error);
 
 		/* generic multi-directory files */
@@ -326,6 +343,74 @@ mame_file *mame_fopen_rom(const char *gamename, const char *filename, const char
 }
 
 
+/*-------------------------------------------------
+    mame_fopen_rom_deferred - similar to
+    mame_fopen_rom, but only reads the raw data;
+    the inflate and the checksum are left to
+    mame_fcomplete
+-------------------------------------------------*/
+
+mame_file *mame_fopen_rom_deferred(const char *gamename, const char *filename, const char *exphash)
+{
+	return generic_fopen(FILETYPE_ROM, gamename, filename, exphash, FILEFLAG_OPENREAD | FILEFLAG_HASH | FILEFLAG_DEFER, NULL);
+}
+
+
+/*-------------------------------------------------
+    mame_fcomplete - finish a deferred open; this
+    touches only the file itself, so it can run
+    on several files at once from worker threads
+-------------------------------------------------*/
+
+int mame_fcomplete(mame_file *file)
+{
+	if (!file->deferred)
+		return 0;
+	file->deferred = 0;
+
+	/* expand the compressed data */
+	if (file->rawdata)
+	{
+		if (file->rawmethod == 0)
+			file->data = file->rawdata;
+		else
+		{
+			hash_collector *collector = NULL;
+
+			/* hash every piece while it's still in the cache from the inflate */
+			if (!file->hashknown)
+				collector = hash_collector_begin(file->hashfunctions);
+
+			file->data = malloc(file->length);
+			if (!file->data || inflate_zipped_data_stream(file->rawdata, file->rawlength, file->data, file->length, collector ? hash_inflated : NULL, collector) != 0)
+			{
+				/* the hash of a partial stream is useless */
+				if (collector)
+					hash_collector_abort(collector);
+				free(file->rawdata);
+				file->rawdata = NULL;
+				return -1;
+			}
+			free(file->rawdata);
+			file->rawdata = NULL;
+
+			if (collector)
+			{
+				hash_collector_end(collector, file->hash);
+				if (file->hashentry)
+					hashcache_set(file->hashentry, file->hash);
+				return 0;
+			}
+		}
+		file->rawdata = NULL;
+	}
+
+	if (!file->hashknown)
+		compute_hash(file, file->hashfunctions);
+	return 0;
+}
+
+
 /*-------------------------------------------------
     mame_fclose - closes a file
 -------------------------------------------------*/
@@ -346,8 +431,15 @@ void mame_fclose(mame_file *file)
 
 		case ZIPPED_FILE:
 		case RAM_FILE:
-			if (file->data)
-				free(file->data);
+			if (file->mapped)
+				osd_funmap(file->data ? file->data : file->rawdata, file->length);
+			else
+			{
+				if (file->data)
+					free(file->data);
+				if (file->rawdata)
+					free(file->rawdata);
+			}
 			break;
 	}
 
@@ -572,6 +664,25 @@ const char *mame_fhash(mame_file *file)
 }
 
 
+/*-------------------------------------------------
+    mame_fsource - returns the archive, or loose
+    file, a ROM was read from, with its size and
+    modification time when opened
+-------------------------------------------------*/
+
+int mame_fsource(mame_file *file, int *pathindex, const char **archive, UINT64 *size, UINT64 *mtime)
+{
+	if (!file->hashentry)
+		return -1;
+
+	*pathindex = file->hashentry->pathindex;
+	*archive = file->hashentry->archive;
+	*size = file->hashentry->size;
+	*mtime = file->hashentry->mtime;
+	return 0;
+}
+
+
 /*-------------------------------------------------
     mame_fgetc - read a character from a file
 -------------------------------------------------*/
@@ -967,6 +1078,10 @@ static const char *get_extension_for_filetype(int filetype)
 			extension = "cmt";
 			break;
 
+		case FILETYPE_ROMCACHE:		/* loaded ROM regions */
+			extension = "rom";
+			break;
+
 #ifdef MESS
 		case FILETYPE_HASH:
 			extension = "hsi";
@@ -1067,11 +1182,31 @@ static mame_file *generic_fopen(int pathtype, const char *gamename, const char *
 			/* if we need checksums, load it into RAM and compute it along the way */
 			if (flags & FILEFLAG_HASH)
 			{
-				if (checksum_file(pathtype, pathindex, name, &file.data, &file.length, file.hash) == 0)
+				file.hashknown = lookup_hash(&file, pathtype, pathindex, name, "", 0);
+
+				/* verifying needs only the length and the checksums */
+				if (file.hashknown && (flags & FILEFLAG_VERIFY_ONLY))
 				{
 					file.type = RAM_FILE;
+					file.length = file.hashentry->size;
 					break;
 				}
+
+				if (checksum_file(pathtype, pathindex, name, &file.data, &file.length, file.hash, !file.hashknown && !(flags & FILEFLAG_DEFER), &file.mapped) == 0)
+				{
+					file.type = RAM_FILE;
+					if (flags & FILEFLAG_DEFER)
+					{
+						file.deferred = 1;
+						file.hashfunctions = 0;
+					}
+					else if (!file.hashknown && file.hashentry)
+						hashcache_set(file.hashentry, file.hash);
+					break;
+				}
+				hash_data_clear(file.hash);
+				file.hashknown = 0;
+				file.hashentry = NULL;
 			}
 
 			/* otherwise, just open it straight */
@@ -1200,6 +1335,49 @@ static mame_file *generic_fopen(int pathtype, const char *gamename, const char *
 						crcs[2] = (UINT8)(crc >> 8);
 						crcs[3] = (UINT8)(crc >> 0);
 						hash_data_insert_binary_checksum(file.hash, HASH_CRC, crcs);
+
+						/* add the other checksums if they were computed when the file was loaded */
+						if (hash)
+						{
+							char cached[HASH_BUF_SIZE];
+							hashcache_entry *entry = hashcache_find(pathtype, pathindex, name, tempname);
+
+							if (entry && hashcache_get(entry, cached, hash_data_used_functions(hash)) && hash_data_is_equal(cached, file.hash, HASH_CRC) == 1)
+								hash_data_copy(file.hash, cached);
+						}
+						break;
+					}
+				}
+
+				/* deferred load case, only the compressed data is read here */
+				else if (flags & FILEFLAG_DEFER)
+				{
+					const char *member = tempname;
+					char crcn[9];
+					int mapped = 0;
+					int err;
+
+					err = load_zipped_file_raw(pathtype, pathindex, name, tempname, &file.rawdata, &file.rawlength, &ziplength, &file.rawmethod, &mapped);
+
+					/* load by CRC, as below */
+					if (err && hash)
+					{
+						if (hash_data_extract_printable_checksum(hash, HASH_CRC, crcn) != 0)
+						{
+							err = load_zipped_file_raw(pathtype, pathindex, name, crcn, &file.rawdata, &file.rawlength, &ziplength, &file.rawmethod, &mapped);
+							member = crcn;
+						}
+					}
+
+					if (err == 0)
+					{
+						VPRINTF(("Using (mame_fopen) zip file for %s\n", filename));
+						file.length = ziplength;
+						file.type = ZIPPED_FILE;
+						file.mapped = mapped;
+						file.deferred = 1;
+						file.hashfunctions = hash_data_used_functions(hash);
+						file.hashknown = lookup_hash(&file, pathtype, pathindex, name, member, file.hashfunctions);
 						break;
 					}
 				}
@@ -1207,6 +1385,8 @@ static mame_file *generic_fopen(int pathtype, const char *gamename, const char *
 				/* full load case */
 				else
 				{
+					const char *member = tempname;
+					char crcn[9];
 					int err;
 
 					/* Try loading the file */
@@ -1217,10 +1397,11 @@ static mame_file *generic_fopen(int pathtype, const char *gamename, const char *
                        of specifying the CRC as filename. */
 					if (err && hash)
 					{
-						char crcn[9];
-
 						if (hash_data_extract_printable_checksum(hash, HASH_CRC, crcn) != 0)
+						{
 							err = load_zipped_file(pathtype, pathindex, name, crcn, &file.data, &ziplength);
+							member = crcn;
+						}
 					}
 
 					if (err == 0)
@@ -1236,7 +1417,9 @@ static mame_file *generic_fopen(int pathtype, const char *gamename, const char *
                            functions for which we have an expected checksum to compare with. */
 						functions = hash_data_used_functions(hash);
 
-						hash_compute(file.hash, file.data, file.length, functions);
+						file.hashknown = lookup_hash(&file, pathtype, pathindex, name, member, functions);
+						if (!file.hashknown)
+							compute_hash(&file, functions);
 						break;
 					}
 				}
@@ -1270,7 +1453,7 @@ static mame_file *generic_fopen(int pathtype, const char *gamename, const char *
     checksum_file - load and checksum a file
 -------------------------------------------------*/
 
-static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **p, UINT64 *size, char *hash)
+static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **p, UINT64 *size, char *hash, int compute, UINT8 *mapped)
 {
 	UINT64 length;
 	UINT8 *data;
@@ -1297,27 +1480,34 @@ static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **
 		return -1;
 	}
 
-	/* allocate space for entire file */
-	data = malloc(length);
+	/* map the file, if possible, to avoid the copy */
+	data = (UINT8 *)osd_fmap(f, 0, length);
+	*mapped = (data != NULL);
+
 	if (!data)
 	{
-		osd_fclose(f);
-		return -1;
-	}
+		/* allocate space for entire file */
+		data = malloc(length);
+		if (!data)
+		{
+			osd_fclose(f);
+			return -1;
+		}
 
-	/* read entire file into memory */
-	if (osd_fseek(f, 0L, SEEK_SET) != 0)
-	{
-		free(data);
-		osd_fclose(f);
-		return -1;
-	}
+		/* read entire file into memory */
+		if (osd_fseek(f, 0L, SEEK_SET) != 0)
+		{
+			free(data);
+			osd_fclose(f);
+			return -1;
+		}
 
-	if (osd_fread(f, data, length) != length)
-	{
-		free(data);
-		osd_fclose(f);
-		return -1;
+		if (osd_fread(f, data, length) != length)
+		{
+			free(data);
+			osd_fclose(f);
+			return -1;
+		}
 	}
 
 	*size = length;
@@ -1326,11 +1516,17 @@ static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **
        checksum). Take also care of crconly: if the user asked, we will calculate
        only the CRC, but only if there is an expected CRC for this file. */
 	functions = hash_data_used_functions(hash);
-	hash_compute(hash, data, length, functions);
+	if (compute)
+		hash_compute(hash, data, length, functions);
 
 	/* if the caller wants the data, give it away, otherwise free it */
 	if (p)
 		*p = data;
+	else if (*mapped)
+	{
+		osd_funmap(data, length);
+		*mapped = 0;
+	}
 	else
 		free(data);
 
@@ -1340,6 +1536,45 @@ static int checksum_file(int pathtype, int pathindex, const char *file, UINT8 **
 }
 
 
+/*-------------------------------------------------
+    lookup_hash - take the checksums from the
+    hash cache if the file didn't change since
+    they were computed
+-------------------------------------------------*/
+
+static int lookup_hash(mame_file *file, int pathtype, int pathindex, const char *archive, const char *member, unsigned functions)
+{
+	file->hashentry = hashcache_find(pathtype, pathindex, archive, member);
+
+	return file->hashentry && hashcache_get(file->hashentry, file->hash, functions);
+}
+
+
+/*-------------------------------------------------
+    compute_hash - compute the checksums of a
+    loaded file and remember them
+-------------------------------------------------*/
+
+static void compute_hash(mame_file *file, unsigned functions)
+{
+	hash_compute(file->hash, file->data, file->length, functions);
+
+	if (file->hashentry)
+		hashcache_set(file->hashentry, file->hash);
+}
+
+
+/*-------------------------------------------------
+    hash_inflated - feed the checksums with a
+    piece of data just inflated
+-------------------------------------------------*/
+
+static void hash_inflated(void *param, const unsigned char *data, unsigned length)
+{
+	hash_collector_buffer((hash_collector *)param, data, length);
+}
+
+
 /*-------------------------------------------------
     chd_open_cb - interface for opening
     a hard disk image
@@ -41,6 +41,8 @@ enum
 	FILETYPE_COMMENT,
 	FILETYPE_DEBUGLOG,
 	FILETYPE_HASH,	/* MESS-specific */
+	FILETYPE_HASHCACHE,
+	FILETYPE_ROMCACHE,
 	FILETYPE_end 	/* dummy last entry */
 };
 
@@ -56,6 +58,8 @@ int mame_faccess(const char *filename, int filetype);
 mame_file *mame_fopen(const char *gamename, const char *filename, int filetype, int openforwrite);
 mame_file *mame_fopen_error(const char *gamename, const char *filename, int filetype, int openforwrite, osd_file_error *error);
 mame_file *mame_fopen_rom(const char *gamename, const char *filename, const char *exphash);
+mame_file *mame_fopen_rom_deferred(const char *gamename, const char *filename, const char *exphash);
+int mame_fcomplete(mame_file *file);
 UINT32 mame_fread(mame_file *file, void *buffer, UINT32 length);
 UINT32 mame_fwrite(mame_file *file, const void *buffer, UINT32 length);
 UINT32 mame_fread_swap(mame_file *file, void *buffer, UINT32 length);
@@ -76,6 +80,7 @@ void mame_fclose(mame_file *file);
 int mame_fchecksum(const char *gamename, const char *filename, unsigned int *length, char *hash);
 UINT64 mame_fsize(mame_file *file);
 const char *mame_fhash(mame_file *file);
+int mame_fsource(mame_file *file, int *pathindex, const char **archive, UINT64 *size, UINT64 *mtime);
 int mame_fgetc(mame_file *file);
 int mame_ungetc(int c, mame_file *file);
 char *mame_fgets(char *s, int n, mame_file *file);
@@ -22,8 +22,7 @@ struct _hard_disk_file
 	chd_file *			chd;				/* CHD file */
 	hard_disk_info 		info;				/* hard disk info */
 	UINT32				hunksectors;		/* sectors per hunk */
-	UINT32				cachehunk;			/* which hunk is cached */
-	UINT8 *				cache;				/* cache of the current hunk */
+	UINT8 *				cache;				/* hunk being written */
 };
 
 
@@ -68,9 +67,8 @@ hard_disk_file *hard_disk_open(chd_file *chd)
 	file->info.sectors = sectors;
 	file->info.sectorbytes = sectorbytes;
 	file->hunksectors = chd_get_header(chd)->hunkbytes / file->info.sectorbytes;
-	file->cachehunk = -1;
 
-	/* allocate a cache */
+	/* allocate a buffer for the writes; the reads go through the CHD hunk cache */
 	file->cache = malloc(chd_get_header(chd)->hunkbytes);
 	if (!file->cache)
 	{
@@ -150,16 +148,9 @@ UINT32 hard_disk_read(hard_disk_file *file, UINT32 lbasector, UINT32 numsectors,
 		return total;
 	}
 
-	/* if we haven't cached this hunk, read it now */
-	if (file->cachehunk != hunknum)
-	{
-		if (!chd_read(file->chd, hunknum, 1, file->cache))
-			return 0;
-		file->cachehunk = hunknum;
-	}
-
 	/* copy out the requested sector */
-	memcpy(buffer, &file->cache[sectoroffs * file->info.sectorbytes], file->info.sectorbytes);
+	if (!chd_read_partial(file->chd, hunknum, sectoroffs * file->info.sectorbytes, file->info.sectorbytes, buffer))
+		return 0;
 	return 1;
 }
 
@@ -190,13 +181,9 @@ UINT32 hard_disk_write(hard_disk_file *file, UINT32 lbasector, UINT32 numsectors
 		return total;
 	}
 
-	/* if we haven't cached this hunk, read it now */
-	if (file->cachehunk != hunknum)
-	{
-		if (!chd_read(file->chd, hunknum, 1, file->cache))
-			return 0;
-		file->cachehunk = hunknum;
-	}
+	/* read the hunk, it comes from the CHD hunk cache if recently used */
+	if (!chd_read(file->chd, hunknum, 1, file->cache))
+		return 0;
 
 	/* copy in the requested data */
 	memcpy(&file->cache[sectoroffs * file->info.sectorbytes], buffer, file->info.sectorbytes);
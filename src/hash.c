@@ -118,10 +118,10 @@
 
 #include <stddef.h>
 #include <ctype.h>
-#include <zlib.h>
 #include "hash.h"
 #include "md5.h"
 #include "sha1.h"
+#include "fastcrc.h"
 #include "mame.h"
 #include "romload.h"
 
@@ -135,6 +135,27 @@
 #define FALSE   0
 #endif
 
+/* Size of the pieces of data passed to all the functions in turn, small
+   enough to be still in the cache for the next function */
+#define HASH_CHUNK_SIZE	(64*1024)
+
+/* Per-call state of the hash functions, kept on the stack so that
+   hash_compute() can be used concurrently by the ROM loader */
+union _hash_context
+{
+	UINT32 crc;
+	struct sha1_ctx sha1;
+	struct MD5Context md5;
+};
+typedef union _hash_context hash_context;
+
+/* State of a checksum computed a piece at a time */
+struct _hash_collector
+{
+	unsigned int functions;
+	hash_context ctx[HASH_NUM_FUNCTIONS];
+};
+
 struct _hash_function_desc
 {
 	const char* name;           // human-readable name
@@ -142,24 +163,24 @@ struct _hash_function_desc
 	unsigned int size;          // checksum size in bytes
 
 	// Functions used to calculate the hash of a memory block
-	void (*calculate_begin)(void);
-	void (*calculate_buffer)(const void* mem, unsigned long len);
-	void (*calculate_end)(UINT8* bin_chksum);
+	void (*calculate_begin)(hash_context* ctx);
+	void (*calculate_buffer)(hash_context* ctx, const void* mem, unsigned long len);
+	void (*calculate_end)(hash_context* ctx, UINT8* bin_chksum);
 
 };
 typedef struct _hash_function_desc hash_function_desc;
 
-static void h_crc_begin(void);
-static void h_crc_buffer(const void* mem, unsigned long len);
-static void h_crc_end(UINT8* chksum);
+static void h_crc_begin(hash_context* ctx);
+static void h_crc_buffer(hash_context* ctx, const void* mem, unsigned long len);
+static void h_crc_end(hash_context* ctx, UINT8* chksum);
 
-static void h_sha1_begin(void);
-static void h_sha1_buffer(const void* mem, unsigned long len);
-static void h_sha1_end(UINT8* chksum);
+static void h_sha1_begin(hash_context* ctx);
+static void h_sha1_buffer(hash_context* ctx, const void* mem, unsigned long len);
+static void h_sha1_end(hash_context* ctx, UINT8* chksum);
 
-static void h_md5_begin(void);
-static void h_md5_buffer(const void* mem, unsigned long len);
-static void h_md5_end(UINT8* chksum);
+static void h_md5_begin(hash_context* ctx);
+static void h_md5_buffer(hash_context* ctx, const void* mem, unsigned long len);
+static void h_md5_end(hash_context* ctx, UINT8* chksum);
 
 static const hash_function_desc hash_descs[HASH_NUM_FUNCTIONS] =
 {
@@ -536,28 +557,36 @@ int hash_data_insert_binary_checksum(char* d, unsigned int function, const UINT8
 	}
 }
 
-void hash_compute(char* dst, const unsigned char* data, unsigned long length, unsigned int functions)
+static void hash_collector_init(hash_collector* hc, unsigned int functions)
 {
 	int i;
 
-	hash_data_clear(dst);
-
 	// Zero means use all the functions
 	if (functions == 0)
 		functions = ~functions;
 
+	hc->functions = functions;
+
+	for (i=0;i<HASH_NUM_FUNCTIONS;i++)
+		if (functions & (1 << i))
+			hash_get_function_desc(1 << i)->calculate_begin(&hc->ctx[i]);
+}
+
+static void hash_collector_done(hash_collector* hc, char* dst)
+{
+	int i;
+
+	hash_data_clear(dst);
+
 	for (i=0;i<HASH_NUM_FUNCTIONS;i++)
 	{
 		unsigned func = 1 << i;
 
-		if (functions & func)
+		if (hc->functions & func)
 		{
-			const hash_function_desc* desc = hash_get_function_desc(func);
 			UINT8 chksum[256];
 
-			desc->calculate_begin();
-			desc->calculate_buffer(data, length);
-			desc->calculate_end(chksum);
+			hash_get_function_desc(func)->calculate_end(&hc->ctx[i], chksum);
 
 			dst += hash_data_add_binary_checksum(dst, func, chksum);
 		}
@@ -566,6 +595,54 @@ void hash_compute(char* dst, const unsigned char* data, unsigned long length, un
 	*dst = '\0';
 }
 
+hash_collector* hash_collector_begin(unsigned int functions)
+{
+	hash_collector* hc = malloc(sizeof(hash_collector));
+	if (!hc)
+		return NULL;
+
+	hash_collector_init(hc, functions);
+
+	return hc;
+}
+
+void hash_collector_buffer(hash_collector* hc, const unsigned char* data, unsigned long length)
+{
+	unsigned long offset;
+	int i;
+
+	// A single pass on the data, reading it from the memory only once
+	for (offset=0;offset<length;offset+=HASH_CHUNK_SIZE)
+	{
+		unsigned long chunk = length - offset < HASH_CHUNK_SIZE ? length - offset : HASH_CHUNK_SIZE;
+
+		for (i=0;i<HASH_NUM_FUNCTIONS;i++)
+			if (hc->functions & (1 << i))
+				hash_get_function_desc(1 << i)->calculate_buffer(&hc->ctx[i], data + offset, chunk);
+	}
+}
+
+void hash_collector_end(hash_collector* hc, char* dst)
+{
+	hash_collector_done(hc, dst);
+
+	free(hc);
+}
+
+void hash_collector_abort(hash_collector* hc)
+{
+	free(hc);
+}
+
+void hash_compute(char* dst, const unsigned char* data, unsigned long length, unsigned int functions)
+{
+	hash_collector hc;
+
+	hash_collector_init(&hc, functions);
+	hash_collector_buffer(&hc, data, length);
+	hash_collector_done(&hc, dst);
+}
+
 void hash_data_print(const char* data, unsigned int functions, char* buffer)
 {
 	int i, j;
@@ -655,59 +732,53 @@ int hash_verify_string(const char *hash)
     Hash functions - Wrappers
  *********************************************************************/
 
-static UINT32 crc;
-
-static void h_crc_begin(void)
+static void h_crc_begin(hash_context* ctx)
 {
-	crc = 0;
+	ctx->crc = 0;
 }
 
-static void h_crc_buffer(const void* mem, unsigned long len)
+static void h_crc_buffer(hash_context* ctx, const void* mem, unsigned long len)
 {
-	crc = crc32(crc, (UINT8*)mem, len);
+	ctx->crc = fast_crc32(ctx->crc, (UINT8*)mem, len);
 }
 
-static void h_crc_end(UINT8* bin_chksum)
+static void h_crc_end(hash_context* ctx, UINT8* bin_chksum)
 {
-	bin_chksum[0] = (UINT8)(crc >> 24);
-	bin_chksum[1] = (UINT8)(crc >> 16);
-	bin_chksum[2] = (UINT8)(crc >> 8);
-	bin_chksum[3] = (UINT8)(crc >> 0);
+	bin_chksum[0] = (UINT8)(ctx->crc >> 24);
+	bin_chksum[1] = (UINT8)(ctx->crc >> 16);
+	bin_chksum[2] = (UINT8)(ctx->crc >> 8);
+	bin_chksum[3] = (UINT8)(ctx->crc >> 0);
 }
 
 
-static struct sha1_ctx sha1ctx;
-
-static void h_sha1_begin(void)
+static void h_sha1_begin(hash_context* ctx)
 {
-	sha1_init(&sha1ctx);
+	sha1_init(&ctx->sha1);
 }
 
-static void h_sha1_buffer(const void* mem, unsigned long len)
+static void h_sha1_buffer(hash_context* ctx, const void* mem, unsigned long len)
 {
-	sha1_update(&sha1ctx, len, (UINT8*)mem);
+	sha1_update(&ctx->sha1, len, (UINT8*)mem);
 }
 
-static void h_sha1_end(UINT8* bin_chksum)
+static void h_sha1_end(hash_context* ctx, UINT8* bin_chksum)
 {
-	sha1_final(&sha1ctx);
-	sha1_digest(&sha1ctx, 20, bin_chksum);
+	sha1_final(&ctx->sha1);
+	sha1_digest(&ctx->sha1, 20, bin_chksum);
 }
 
 
-static struct MD5Context md5_ctx;
-
-static void h_md5_begin(void)
+static void h_md5_begin(hash_context* ctx)
 {
-	MD5Init(&md5_ctx);
+	MD5Init(&ctx->md5);
 }
 
-static void h_md5_buffer(const void* mem, unsigned long len)
+static void h_md5_buffer(hash_context* ctx, const void* mem, unsigned long len)
 {
-	MD5Update(&md5_ctx, (md5byte*)mem, len);
+	MD5Update(&ctx->md5, (md5byte*)mem, len);
 }
 
-static void h_md5_end(UINT8* bin_chksum)
+static void h_md5_end(hash_context* ctx, UINT8* bin_chksum)
 {
-	MD5Final(bin_chksum, &md5_ctx);
+	MD5Final(bin_chksum, &ctx->md5);
 }
@@ -70,6 +70,15 @@ unsigned int hash_data_used_functions(const char* d);
 //  we want the checksum of.
 void hash_compute(char* dst, const unsigned char* data, unsigned long length, unsigned int functions);
 
+// Compute hash of data coming a piece at a time, like hash_compute(). The collector is freed
+//  by hash_collector_end(), which stores the result in 'dst', or by hash_collector_abort(),
+//  which discards it. It returns NULL if out of memory.
+typedef struct _hash_collector hash_collector;
+hash_collector* hash_collector_begin(unsigned int functions);
+void hash_collector_buffer(hash_collector* hc, const unsigned char* data, unsigned long length);
+void hash_collector_end(hash_collector* hc, char* dst);
+void hash_collector_abort(hash_collector* hc);
+
 // Verifies that a hash string is valid
 int hash_verify_string(const char *hash);
 
@@ -0,0 +1,321 @@
+/***************************************************************************
+
+    hashcache.c
+
+    Persistent cache of the checksums of the ROM files.
+
+    The checksums computed while loading a ROM are remembered together with
+    the size and the modification time of the file, or of the archive,
+    containing it. As long as these don't change the next load and the
+    audit can use the stored checksums instead of hashing the whole data
+    again.
+
+    Copyright (c) 1996-2006, Nicola Salmoria and the MAME Team.
+    Visit http://mamedev.org for licensing and usage restrictions.
+
+***************************************************************************/
+
+#include "osdepend.h"
+#include "driver.h"
+#include "hashcache.h"
+
+
+
+/***************************************************************************
+    CONSTANTS
+***************************************************************************/
+
+#define HASHCACHE_FILENAME		"romhash.dat"
+#define HASHCACHE_BUCKETS		4096
+
+
+
+/***************************************************************************
+    GLOBALS
+***************************************************************************/
+
+static hashcache_entry *hashcache_table[HASHCACHE_BUCKETS];
+static int hashcache_loaded;
+static int hashcache_changed;
+
+
+
+/***************************************************************************
+    IMPLEMENTATION
+***************************************************************************/
+
+/*-------------------------------------------------
+    hashcache_bucket - compute the bucket of a
+    file
+-------------------------------------------------*/
+
+static UINT32 hashcache_bucket(int pathindex, const char *archive, const char *member)
+{
+	UINT32 h = pathindex;
+
+	while (*archive)
+		h = h * 31 + (UINT8)*archive++;
+	while (*member)
+		h = h * 31 + (UINT8)*member++;
+
+	return h % HASHCACHE_BUCKETS;
+}
+
+
+/*-------------------------------------------------
+    hashcache_add - add a new empty entry
+-------------------------------------------------*/
+
+static hashcache_entry *hashcache_add(int pathtype, int pathindex, const char *archive, const char *member)
+{
+	hashcache_entry *entry;
+	UINT32 bucket;
+	size_t archivelen = strlen(archive) + 1;
+	size_t memberlen = strlen(member) + 1;
+
+	/* allocate the entry and the names in one block */
+	entry = malloc(sizeof(*entry) + archivelen + memberlen);
+	if (!entry)
+		return NULL;
+	memset(entry, 0, sizeof(*entry));
+
+	entry->pathtype = pathtype;
+	entry->pathindex = pathindex;
+	entry->archive = (char *)(entry + 1);
+	entry->member = entry->archive + archivelen;
+	memcpy(entry->archive, archive, archivelen);
+	memcpy(entry->member, member, memberlen);
+	hash_data_clear(entry->hash);
+
+	/* link it */
+	bucket = hashcache_bucket(pathindex, archive, member);
+	entry->next = hashcache_table[bucket];
+	hashcache_table[bucket] = entry;
+
+	return entry;
+}
+
+
+/*-------------------------------------------------
+    hashcache_load - read the cache file
+-------------------------------------------------*/
+
+static void hashcache_load(void)
+{
+	mame_file *file;
+	char line[1024];
+
+	hashcache_loaded = 1;
+
+	file = mame_fopen(NULL, HASHCACHE_FILENAME, FILETYPE_HASHCACHE, 0);
+	if (!file)
+		return;
+
+	/* each line is "type index size mtime<TAB>hash<TAB>archive<TAB>member" */
+	while (mame_fgets(line, sizeof(line), file) != NULL)
+	{
+		unsigned int pathtype, pathindex, sizehi, sizelo, mtimehi, mtimelo;
+		hashcache_entry *entry;
+		char *hash, *archive, *member, *end;
+
+		hash = strchr(line, '\t');
+		archive = hash ? strchr(hash + 1, '\t') : NULL;
+		member = archive ? strchr(archive + 1, '\t') : NULL;
+		if (!member)
+			continue;
+		*hash++ = 0;
+		*archive++ = 0;
+		*member++ = 0;
+
+		/* strip the end of line */
+		end = member + strlen(member);
+		while (end > member && (end[-1] == '\n' || end[-1] == '\r'))
+			*--end = 0;
+
+		if (sscanf(line, "%u %u %8x%8x %8x%8x", &pathtype, &pathindex, &sizehi, &sizelo, &mtimehi, &mtimelo) != 6)
+			continue;
+		if (!hash_verify_string(hash) || strlen(hash) >= HASH_BUF_SIZE)
+			continue;
+
+		entry = hashcache_add(pathtype, pathindex, archive, member);
+		if (!entry)
+			break;
+		entry->size = ((UINT64)sizehi << 32) | sizelo;
+		entry->mtime = ((UINT64)mtimehi << 32) | mtimelo;
+		strcpy(entry->hash, hash);
+	}
+
+	mame_fclose(file);
+}
+
+
+/*-------------------------------------------------
+    hashcache_save - write the cache file
+-------------------------------------------------*/
+
+static void hashcache_save(void)
+{
+	mame_file *file;
+	int i;
+
+	file = mame_fopen(NULL, HASHCACHE_FILENAME, FILETYPE_HASHCACHE, 1);
+	if (!file)
+	{
+		logerror("hashcache: unable to save %s\n", HASHCACHE_FILENAME);
+		return;
+	}
+
+	for (i = 0; i < HASHCACHE_BUCKETS; i++)
+	{
+		hashcache_entry *entry;
+
+		for (entry = hashcache_table[i]; entry; entry = entry->next)
+			if (entry->hash[0])
+				mame_fprintf(file, "%d %d %08X%08X %08X%08X\t%s\t%s\t%s\n",
+					entry->pathtype, entry->pathindex,
+					(UINT32)(entry->size >> 32), (UINT32)entry->size,
+					(UINT32)(entry->mtime >> 32), (UINT32)entry->mtime,
+					entry->hash, entry->archive, entry->member);
+	}
+
+	mame_fclose(file);
+}
+
+
+/*-------------------------------------------------
+    hashcache_exit - save the changes and free
+    the cache
+-------------------------------------------------*/
+
+void hashcache_exit(void)
+{
+	int i;
+
+	if (!hashcache_loaded)
+		return;
+
+	/* save only if something changed */
+	for (i = 0; i < HASHCACHE_BUCKETS && !hashcache_changed; i++)
+	{
+		hashcache_entry *entry;
+
+		for (entry = hashcache_table[i]; entry; entry = entry->next)
+			if (entry->dirty)
+			{
+				hashcache_changed = 1;
+				break;
+			}
+	}
+	if (hashcache_changed)
+		hashcache_save();
+
+	for (i = 0; i < HASHCACHE_BUCKETS; i++)
+		while (hashcache_table[i])
+		{
+			hashcache_entry *entry = hashcache_table[i];
+			hashcache_table[i] = entry->next;
+			free(entry);
+		}
+
+	hashcache_loaded = 0;
+	hashcache_changed = 0;
+}
+
+
+/*-------------------------------------------------
+    hashcache_find - get the entry of a file,
+    resetting it if the archive changed
+-------------------------------------------------*/
+
+hashcache_entry *hashcache_find(int pathtype, int pathindex, const char *archive, const char *member)
+{
+	hashcache_entry *entry;
+	UINT64 size, mtime;
+
+	if (!hashcache_loaded)
+		hashcache_load();
+
+	if (osd_get_path_stamp(pathtype, pathindex, archive, &size, &mtime) != 0)
+		return NULL;
+
+	for (entry = hashcache_table[hashcache_bucket(pathindex, archive, member)]; entry; entry = entry->next)
+		if (entry->pathtype == pathtype && entry->pathindex == pathindex && !strcmp(entry->archive, archive) && !strcmp(entry->member, member))
+			break;
+
+	if (!entry)
+	{
+		entry = hashcache_add(pathtype, pathindex, archive, member);
+		if (!entry)
+			return NULL;
+	}
+
+	/* forget the checksums of a changed file */
+	if (entry->size != size || entry->mtime != mtime)
+	{
+		entry->size = size;
+		entry->mtime = mtime;
+		if (entry->hash[0])
+		{
+			hash_data_clear(entry->hash);
+			hashcache_changed = 1;
+		}
+	}
+
+	return entry;
+}
+
+
+/*-------------------------------------------------
+    hashcache_get - copy the cached checksums if
+    all the requested functions are known
+-------------------------------------------------*/
+
+int hashcache_get(hashcache_entry *entry, char *hash, unsigned int functions)
+{
+	UINT8 checksum[256];
+	int i;
+
+	/* zero means all the functions */
+	if (functions == 0)
+		functions = (1 << HASH_NUM_FUNCTIONS) - 1;
+
+	if (!entry->hash[0] || (hash_data_used_functions(entry->hash) & functions) != functions)
+		return 0;
+
+	/* copy only the requested ones, like hash_compute() does */
+	hash_data_clear(hash);
+	for (i = 0; i < HASH_NUM_FUNCTIONS; i++)
+	{
+		unsigned int function = 1 << i;
+
+		if ((functions & function) && hash_data_extract_binary_checksum(entry->hash, function, checksum) != 0)
+			hash_data_insert_binary_checksum(hash, function, checksum);
+	}
+	return 1;
+}
+
+
+/*-------------------------------------------------
+    hashcache_set - add new checksums to an entry
+-------------------------------------------------*/
+
+void hashcache_set(hashcache_entry *entry, const char *hash)
+{
+	UINT8 checksum[256];
+	int i;
+
+	/* the same ROM may be loaded twice in a batch, sharing the entry */
+#ifdef _OPENMP
+#pragma omp critical(hashcache)
+#endif
+	for (i = 0; i < HASH_NUM_FUNCTIONS; i++)
+	{
+		unsigned int function = 1 << i;
+
+		if (hash_data_extract_binary_checksum(hash, function, checksum) != 0)
+		{
+			hash_data_insert_binary_checksum(entry->hash, function, checksum);
+			entry->dirty = 1;
+		}
+	}
+}
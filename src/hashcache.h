@@ -0,0 +1,57 @@
+/***************************************************************************
+
+    hashcache.h
+
+    Persistent cache of the checksums of the ROM files.
+
+    Copyright (c) 1996-2006, Nicola Salmoria and the MAME Team.
+    Visit http://mamedev.org for licensing and usage restrictions.
+
+***************************************************************************/
+
+#ifndef __HASHCACHE_H__
+#define __HASHCACHE_H__
+
+#include "mamecore.h"
+#include "hash.h"
+
+
+
+/***************************************************************************
+    TYPE DEFINITIONS
+***************************************************************************/
+
+typedef struct _hashcache_entry hashcache_entry;
+struct _hashcache_entry
+{
+	hashcache_entry *	next;					/* next in the hash bucket */
+	int					pathtype;				/* path type of the archive */
+	int					pathindex;				/* path index of the archive */
+	UINT64				size;					/* size of the archive when hashed */
+	UINT64				mtime;					/* modification time of the archive when hashed */
+	char *				archive;				/* archive, or loose file, name */
+	char *				member;					/* member of the archive, empty for a loose file */
+	char				hash[HASH_BUF_SIZE];	/* known checksums */
+	UINT8				dirty;					/* changed since loaded */
+};
+
+
+
+/***************************************************************************
+    FUNCTION PROTOTYPES
+***************************************************************************/
+
+void hashcache_exit(void);
+
+/* get the entry of a file, it's reset if the archive changed since the last time */
+hashcache_entry *hashcache_find(int pathtype, int pathindex, const char *archive, const char *member);
+
+/* copy the cached checksums if all the requested functions are known */
+int hashcache_get(hashcache_entry *entry, char *hash, unsigned int functions);
+
+/* add new checksums to an entry; it can be called at the same time from
+   different threads, also for the same entry, but not together with the
+   other functions */
+void hashcache_set(hashcache_entry *entry, const char *hash);
+
+#endif	/* __HASHCACHE_H__ */
@@ -269,6 +269,9 @@ int osd_get_path_count(int pathtype);
 /* Get information on the existence of a file */
 int osd_get_path_info(int pathtype, int pathindex, const char *filename);
 
+/* Get the size and the modification time of a file, return 0 on success */
+int osd_get_path_stamp(int pathtype, int pathindex, const char *filename, UINT64 *size, UINT64 *mtime);
+
 /* Create a directory if it doesn't already exist */
 int osd_create_directory(int pathtype, int pathindex, const char *dirname);
 
@@ -293,6 +296,13 @@ UINT32 osd_fwrite(osd_file *file, const void *buffer, UINT32 length);
 /* Close an open file */
 void osd_fclose(osd_file *file);
 
+/* Map in memory a read only view of part of a file, NULL if not possible;
+   the view remains valid also after the file is closed */
+const void *osd_fmap(osd_file *file, UINT64 offset, UINT32 length);
+
+/* Release a view returned by osd_fmap */
+void osd_funmap(const void *data, UINT32 length);
+
 
 
 /******************************************************************************
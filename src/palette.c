@@ -40,6 +40,10 @@ enum
 UINT32 direct_rgb_components[3];
 UINT16 *palette_shadow_table;
 
+/* per channel form of the current 32-bit shadow table, 32 red, 32 green and */
+/* 32 blue entries already shifted in place, NULL if the channels interact */
+UINT32 *palette_shadow_table_rgb32;
+
 
 
 /*-------------------------------------------------
@@ -256,6 +260,42 @@ int palette_start(void)
 #define MAX_SHADOW_PRESETS 4
 
 static UINT32 *shadow_table_base[MAX_SHADOW_PRESETS];
+static UINT32 shadow_table_rgb32[MAX_SHADOW_PRESETS][3*32];
+static UINT8 shadow_table_rgb32_valid[MAX_SHADOW_PRESETS];
+static int shadow_table_mode;
+
+
+/*-------------------------------------------------
+    internal_set_shadow_rgb32 - extract the per
+    channel tables of a 32-bit shadow preset
+
+    When every channel of the shadow only depends
+    on the same channel of the source, the 32768
+    entries table is the combination of three 32
+    entries tables which stay in the L1 cache.
+-------------------------------------------------*/
+
+static void internal_set_shadow_rgb32(int mode, int separable)
+{
+	UINT32 *table_ptr32 = shadow_table_base[mode];
+	UINT32 *rgb = shadow_table_rgb32[mode];
+	int i;
+
+	shadow_table_rgb32_valid[mode] = separable && colormode == DIRECT_32BIT;
+
+	if (shadow_table_rgb32_valid[mode])
+	{
+		for (i=0; i<32; i++)
+		{
+			rgb[i]      = table_ptr32[i<<10] & 0xf80000;
+			rgb[32 + i] = table_ptr32[i<<5]  & 0x00f800;
+			rgb[64 + i] = table_ptr32[i]     & 0x0000f8;
+		}
+	}
+
+	if (mode == shadow_table_mode)
+		palette_shadow_table_rgb32 = shadow_table_rgb32_valid[mode] ? shadow_table_rgb32[mode] : NULL;
+}
 
 
 static void internal_set_shadow_preset(int mode, double factor, int dr, int dg, int db, int noclip, int style, int init)
@@ -397,6 +437,9 @@ static void internal_set_shadow_preset(int mode, double factor, int dr, int dg,
 					}
 				} // end of highlight_methods
 			} // end of factor
+
+			// highlight method 1 spreads the overflow of a channel to the others
+			internal_set_shadow_rgb32(mode, factor <= 1.0 || highlight_method != 1);
 		} // end of colormode
 
 		#if VERBOSE
@@ -461,6 +504,8 @@ static void internal_set_shadow_preset(int mode, double factor, int dr, int dg,
 					((UINT16*)table_ptr32)[i] = (UINT16)(r | g | b);
 			}
 		}
+
+		internal_set_shadow_rgb32(mode, 1);
 	}
 #undef FP
 #undef FMAX
@@ -469,7 +514,12 @@ static void internal_set_shadow_preset(int mode, double factor, int dr, int dg,
 
 void palette_set_shadow_mode(int mode)
 {
-	if (mode >= 0 && mode < MAX_SHADOW_PRESETS) palette_shadow_table = (UINT16*)shadow_table_base[mode];
+	if (mode >= 0 && mode < MAX_SHADOW_PRESETS)
+	{
+		shadow_table_mode = mode;
+		palette_shadow_table = (UINT16*)shadow_table_base[mode];
+		palette_shadow_table_rgb32 = shadow_table_rgb32_valid[mode] ? shadow_table_rgb32[mode] : NULL;
+	}
 }
 
 
@@ -493,7 +543,13 @@ void palette_set_shadow_dRGB32(int mode, int dr, int dg, int db, int noclip)
 
 void palette_set_highlight_method(int method)
 {
-	highlight_method = method;
+	/* if it changed, update the entire palette; palette_set_color() skips */
+	/* the unchanged colors, so it doesn't recompute their highlight pens */
+	if (highlight_method != method)
+	{
+		highlight_method = method;
+		recompute_adjusted_palette(0);
+	}
 }
 
 
@@ -603,6 +659,9 @@ static int palette_alloc(void)
 		int cx2 = c << 1;
 
 		for (i=0; i<MAX_SHADOW_PRESETS; i++) shadow_table_base[i] = NULL;
+		for (i=0; i<MAX_SHADOW_PRESETS; i++) shadow_table_rgb32_valid[i] = 0;
+		shadow_table_mode = 0;
+		palette_shadow_table_rgb32 = NULL;
 
 		if (!(colormode & DIRECT_RGB))
 		{
@@ -684,8 +743,9 @@ int palette_init(void)
 		case PALETTIZED_16BIT:
 		{
 			/* refresh the palette to support shadows in static palette games */
+			/* note: palette_set_color() skips unchanged colors, so call the internal function */
 			for (i = 0; i < Machine->drv->total_colors; i++)
-				palette_set_color(i, RGB_RED(game_palette[i]), RGB_GREEN(game_palette[i]), RGB_BLUE(game_palette[i]));
+				internal_modify_pen(i, game_palette[i], pen_brightness[i]);
 
 			/* map the UI pens */
 			if (total_colors_with_ui <= 65534)
@@ -1012,6 +1072,8 @@ static void palette_reset(void)
 
 void palette_set_color(pen_t pen, UINT8 r, UINT8 g, UINT8 b)
 {
+	rgb_t color = MAKE_RGB(r, g, b);
+
 	/* make sure we're in range */
 	if (pen >= total_colors)
 	{
@@ -1019,8 +1081,14 @@ void palette_set_color(pen_t pen, UINT8 r, UINT8 g, UINT8 b)
 		return;
 	}
 
+	/* nothing to do if the color is unchanged, the adjusted, shadow and */
+	/* highlight pens are already up to date; games that rewrite the whole */
+	/* palette every frame mostly hit this case */
+	if (game_palette[pen] == color)
+		return;
+
 	/* set the pen value */
-	internal_modify_pen(pen, MAKE_RGB(r, g, b), pen_brightness[pen]);
+	internal_modify_pen(pen, color, pen_brightness[pen]);
 }
 
 /* handy wrapper for palette_set_color */
@@ -110,6 +110,7 @@
 
 extern UINT32 direct_rgb_components[3];
 extern UINT16 *palette_shadow_table;
+extern UINT32 *palette_shadow_table_rgb32;
 
 
 
@@ -0,0 +1,473 @@
+/***************************************************************************
+
+    romcache.c
+
+    Cache of the loaded ROM regions.
+
+    After a load without errors or warnings the memory regions of the
+    game, already byte swapped and inverted, are saved in a single file
+    together with a signature of the ROM definition and of the archives
+    and loose files they were read from. As long as the signature still
+    matches, the next launch of the game reads the regions back from that
+    file without searching, inflating and checking the ROMs again. With
+    the cache directory in a tmpfs, like /dev/shm, that is just a copy in
+    memory.
+
+    Copyright (c) 1996-2006, Nicola Salmoria and the MAME Team.
+    Visit http://mamedev.org for licensing and usage restrictions.
+
+***************************************************************************/
+
+#include "osdepend.h"
+#include "driver.h"
+#include "fastcrc.h"
+#include "romcache.h"
+
+
+
+/***************************************************************************
+    CONSTANTS
+***************************************************************************/
+
+#define ROMCACHE_MAGIC			"MAMEROMC"
+#define ROMCACHE_END			"ROMCEND\n"
+#define ROMCACHE_SIGNATURE_MAX	(1024 * 1024)
+
+
+
+/***************************************************************************
+    TYPE DEFINITIONS
+***************************************************************************/
+
+typedef struct _romcache_source romcache_source;
+struct _romcache_source
+{
+	romcache_source *	next;					/* next source */
+	int					pathindex;				/* path index of the archive */
+	UINT64				size;					/* size of the archive when opened */
+	UINT64				mtime;					/* modification time of the archive when opened */
+	char *				archive;				/* archive, or loose file, name */
+};
+
+
+typedef struct _romcache_string romcache_string;
+struct _romcache_string
+{
+	char *				text;					/* allocated text */
+	size_t				length;					/* length of the text */
+	size_t				size;					/* allocated size */
+};
+
+
+
+/***************************************************************************
+    GLOBALS
+***************************************************************************/
+
+static int romcache_enabled;
+static romcache_source *romcache_sources;
+static int romcache_unknown;
+
+
+
+/***************************************************************************
+    IMPLEMENTATION
+***************************************************************************/
+
+/*-------------------------------------------------
+    romcache_append - add a line to a string
+-------------------------------------------------*/
+
+static int romcache_append(romcache_string *s, const char *line)
+{
+	size_t len = strlen(line);
+
+	if (s->length + len + 1 > s->size)
+	{
+		size_t size = s->size ? s->size : 4096;
+		char *text;
+
+		while (size < s->length + len + 1)
+			size *= 2;
+		text = realloc(s->text, size);
+		if (!text)
+			return -1;
+		s->text = text;
+		s->size = size;
+	}
+
+	memcpy(s->text + s->length, line, len + 1);
+	s->length += len;
+	return 0;
+}
+
+
+/*-------------------------------------------------
+    romcache_has_disks - check if the game has
+    disk regions, that aren't cached
+-------------------------------------------------*/
+
+static int romcache_has_disks(const rom_entry *romp)
+{
+	const rom_entry *region;
+
+	for (region = romp; region; region = rom_next_region(region))
+		if (ROMREGION_ISDISKDATA(region))
+			return 1;
+	return 0;
+}
+
+
+/*-------------------------------------------------
+    romcache_stamp - add the size and the time of
+    a file that the search may find
+-------------------------------------------------*/
+
+static int romcache_stamp(romcache_string *s, int pathindex, const char *name)
+{
+	char line[1024];
+	UINT64 size, mtime;
+
+	if (osd_get_path_stamp(FILETYPE_ROM, pathindex, name, &size, &mtime) == 0)
+		sprintf(line, "%d %08X%08X %08X%08X\t%.500s\n", pathindex,
+			(UINT32)(size >> 32), (UINT32)size, (UINT32)(mtime >> 32), (UINT32)mtime, name);
+	else
+		sprintf(line, "%d -\t%.500s\n", pathindex, name);
+	return romcache_append(s, line);
+}
+
+
+/*-------------------------------------------------
+    romcache_header - compute the part of the
+    signature known before loading: the version,
+    the ROM definition and the set zips and loose
+    files that the search may find
+-------------------------------------------------*/
+
+static int romcache_header(romcache_string *s, const rom_entry *romp, int bios)
+{
+	const rom_entry *entry;
+	const game_driver *drv;
+	char line[1024];
+	UINT32 crc = 0;
+	int pathcount = osd_get_path_count(FILETYPE_ROM);
+	int pathindex;
+
+	/* everything that changes what is loaded where */
+	for (entry = romp; !ROMENTRY_ISEND(entry); entry++)
+	{
+		UINT32 fields[4];
+
+		fields[0] = ROM_GETOFFSET(entry);
+		fields[1] = ROM_GETLENGTH(entry);
+		fields[2] = ROM_GETFLAGS(entry);
+		fields[3] = ROMENTRY_ISFILE(entry) ? 0 : (ROMENTRY_GETTYPE(entry) << 24) ^ ROMREGION_GETTYPE(entry);
+		crc = fast_crc32(crc, (const UINT8 *)fields, sizeof(fields));
+
+		if (ROMENTRY_ISFILE(entry))
+		{
+			crc = fast_crc32(crc, (const UINT8 *)ROM_GETNAME(entry), strlen(ROM_GETNAME(entry)) + 1);
+			if (ROM_GETHASHDATA(entry))
+				crc = fast_crc32(crc, (const UINT8 *)ROM_GETHASHDATA(entry), strlen(ROM_GETHASHDATA(entry)) + 1);
+		}
+	}
+
+	sprintf(line, "%.200s\t%s\t%d\t%08X\n", build_version, Machine->gamedrv->name, bios, crc);
+	if (romcache_append(s, line) != 0)
+		return -1;
+
+	/* a zip, or a loose file in the set directory, added, removed or changed */
+	/* up the parent chain may change the ROMs found */
+	for (drv = Machine->gamedrv; drv; drv = driver_get_clone(drv))
+		if (drv->name && *drv->name)
+			for (pathindex = 0; pathindex < pathcount; pathindex++)
+			{
+				sprintf(line, "%.200s.zip", drv->name);
+				if (romcache_stamp(s, pathindex, line) != 0)
+					return -1;
+
+				for (entry = romp; !ROMENTRY_ISEND(entry); entry++)
+					if (ROMENTRY_ISFILE(entry))
+					{
+						sprintf(line, "%.200s/%.200s", drv->name, ROM_GETNAME(entry));
+						if (romcache_stamp(s, pathindex, line) != 0)
+							return -1;
+					}
+			}
+
+	return 0;
+}
+
+
+/*-------------------------------------------------
+    romcache_check_sources - check that the ROM
+    files read when the cache was saved didn't
+    change
+-------------------------------------------------*/
+
+static int romcache_check_sources(char *text)
+{
+	int pathcount = osd_get_path_count(FILETYPE_ROM);
+
+	/* each line is "index size mtime<TAB>archive" */
+	while (*text)
+	{
+		unsigned int sizehi, sizelo, mtimehi, mtimelo;
+		UINT64 size, mtime;
+		char *archive, *end;
+		int pathindex;
+
+		end = strchr(text, '\n');
+		if (!end)
+			return 0;
+		*end = 0;
+
+		archive = strchr(text, '\t');
+		if (!archive)
+			return 0;
+		archive++;
+
+		if (sscanf(text, "%d %8x%8x %8x%8x", &pathindex, &sizehi, &sizelo, &mtimehi, &mtimelo) != 5)
+			return 0;
+		if (pathindex < 0 || pathindex >= pathcount)
+			return 0;
+		if (osd_get_path_stamp(FILETYPE_ROM, pathindex, archive, &size, &mtime) != 0)
+			return 0;
+		if (size != (((UINT64)sizehi << 32) | sizelo) || mtime != (((UINT64)mtimehi << 32) | mtimelo))
+			return 0;
+
+		text = end + 1;
+	}
+
+	return 1;
+}
+
+
+/*-------------------------------------------------
+    romcache_set_enable - enable or disable the
+    cache
+-------------------------------------------------*/
+
+void romcache_set_enable(int enable)
+{
+	romcache_enabled = enable;
+}
+
+
+/*-------------------------------------------------
+    romcache_exit - forget the ROM files
+    remembered
+-------------------------------------------------*/
+
+void romcache_exit(void)
+{
+	while (romcache_sources)
+	{
+		romcache_source *source = romcache_sources;
+		romcache_sources = source->next;
+		free(source);
+	}
+
+	romcache_unknown = 0;
+}
+
+
+/*-------------------------------------------------
+    romcache_add_file - remember the archive of a
+    ROM file used by the load
+-------------------------------------------------*/
+
+void romcache_add_file(mame_file *file)
+{
+	romcache_source *source;
+	const char *archive;
+	UINT64 size, mtime;
+	int pathindex;
+
+	if (!romcache_enabled)
+		return;
+
+	/* without knowing where it came from the regions can't be cached */
+	if (mame_fsource(file, &pathindex, &archive, &size, &mtime) != 0)
+	{
+		romcache_unknown = 1;
+		return;
+	}
+
+	for (source = romcache_sources; source; source = source->next)
+		if (source->pathindex == pathindex && !strcmp(source->archive, archive))
+			return;
+
+	/* allocate the entry and the name in one block */
+	source = malloc(sizeof(*source) + strlen(archive) + 1);
+	if (!source)
+	{
+		romcache_unknown = 1;
+		return;
+	}
+
+	source->pathindex = pathindex;
+	source->size = size;
+	source->mtime = mtime;
+	source->archive = (char *)(source + 1);
+	strcpy(source->archive, archive);
+
+	source->next = romcache_sources;
+	romcache_sources = source;
+}
+
+
+/*-------------------------------------------------
+    romcache_load - allocate and fill the regions
+    from the cache
+-------------------------------------------------*/
+
+int romcache_load(const rom_entry *romp, int bios)
+{
+	romcache_string header = { NULL, 0, 0 };
+	const rom_entry *region;
+	char *signature = NULL;
+	mame_file *file;
+	char magic[8];
+	UINT32 length;
+	int allocated = 0;
+	int result = 0;
+
+	romcache_exit();
+
+	if (!romcache_enabled || romcache_has_disks(romp))
+		return 0;
+
+	file = mame_fopen(Machine->gamedrv->name, NULL, FILETYPE_ROMCACHE, 0);
+	if (!file)
+		return 0;
+
+	if (romcache_header(&header, romp, bios) != 0)
+		goto done;
+
+	/* the signature must start with the current header */
+	if (mame_fread(file, magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, ROMCACHE_MAGIC, sizeof(magic)) != 0)
+		goto done;
+	if (mame_fread(file, &length, sizeof(length)) != sizeof(length) || length < header.length || length > ROMCACHE_SIGNATURE_MAX)
+		goto done;
+	signature = malloc(length + 1);
+	if (!signature || mame_fread(file, signature, length) != length)
+		goto done;
+	signature[length] = 0;
+	if (memcmp(signature, header.text, header.length) != 0)
+		goto done;
+
+	/* followed by the files actually read */
+	if (!romcache_check_sources(signature + header.length))
+		goto done;
+
+	/* the regions follow in the same order of the ROM definition */
+	for (region = romp; region; region = rom_next_region(region))
+	{
+		int type = ROMREGION_GETTYPE(region);
+		UINT32 info[3];
+
+		if (mame_fread(file, info, sizeof(info)) != sizeof(info))
+			goto done;
+		if (info[0] != type || info[1] != ROMREGION_GETFLAGS(region) || info[2] != ROMREGION_GETLENGTH(region))
+			goto done;
+
+		if (new_memory_region(type, info[2], info[1]) != 0)
+			goto done;
+		allocated++;
+
+		if (mame_fread(file, memory_region(type), info[2]) != info[2])
+			goto done;
+	}
+
+	/* an interrupted save misses the end marker */
+	if (mame_fread(file, magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, ROMCACHE_END, sizeof(magic)) != 0)
+		goto done;
+
+	result = 1;
+
+done:
+	if (!result)
+		for (region = romp; allocated > 0; region = rom_next_region(region), allocated--)
+			free_memory_region(ROMREGION_GETTYPE(region));
+
+	logerror("romcache: %s %s\n", Machine->gamedrv->name, result ? "loaded from the cache" : "not in the cache");
+
+	free(signature);
+	free(header.text);
+	mame_fclose(file);
+	return result;
+}
+
+
+/*-------------------------------------------------
+    romcache_save - save the regions just loaded
+-------------------------------------------------*/
+
+void romcache_save(const rom_entry *romp, int bios)
+{
+	romcache_string signature = { NULL, 0, 0 };
+	romcache_source *source;
+	const rom_entry *region;
+	mame_file *file;
+	UINT32 length;
+	int error = 0;
+
+	if (!romcache_enabled || romcache_unknown || romcache_has_disks(romp))
+		return;
+
+	if (romcache_header(&signature, romp, bios) != 0)
+	{
+		free(signature.text);
+		return;
+	}
+
+	for (source = romcache_sources; source; source = source->next)
+	{
+		char line[1024];
+
+		sprintf(line, "%d %08X%08X %08X%08X\t%.900s\n", source->pathindex,
+			(UINT32)(source->size >> 32), (UINT32)source->size,
+			(UINT32)(source->mtime >> 32), (UINT32)source->mtime, source->archive);
+		if (romcache_append(&signature, line) != 0)
+		{
+			free(signature.text);
+			return;
+		}
+	}
+
+	file = mame_fopen(Machine->gamedrv->name, NULL, FILETYPE_ROMCACHE, 1);
+	if (!file)
+	{
+		logerror("romcache: unable to save %s\n", Machine->gamedrv->name);
+		free(signature.text);
+		return;
+	}
+
+	length = signature.length;
+	error |= mame_fwrite(file, ROMCACHE_MAGIC, 8) != 8;
+	error |= mame_fwrite(file, &length, sizeof(length)) != sizeof(length);
+	error |= mame_fwrite(file, signature.text, length) != length;
+
+	for (region = romp; region && !error; region = rom_next_region(region))
+	{
+		int type = ROMREGION_GETTYPE(region);
+		UINT32 info[3];
+
+		info[0] = type;
+		info[1] = ROMREGION_GETFLAGS(region);
+		info[2] = ROMREGION_GETLENGTH(region);
+		error |= mame_fwrite(file, info, sizeof(info)) != sizeof(info);
+		error |= mame_fwrite(file, memory_region(type), info[2]) != info[2];
+	}
+
+	/* written last, so an incomplete file is never used */
+	if (!error)
+		error |= mame_fwrite(file, ROMCACHE_END, 8) != 8;
+
+	if (error)
+		logerror("romcache: error saving %s\n", Machine->gamedrv->name);
+
+	mame_fclose(file);
+	free(signature.text);
+}
@@ -0,0 +1,40 @@
+/***************************************************************************
+
+    romcache.h
+
+    Cache of the loaded ROM regions.
+
+    Copyright (c) 1996-2006, Nicola Salmoria and the MAME Team.
+    Visit http://mamedev.org for licensing and usage restrictions.
+
+***************************************************************************/
+
+#ifndef __ROMCACHE_H__
+#define __ROMCACHE_H__
+
+#include "mamecore.h"
+#include "romload.h"
+
+
+
+/***************************************************************************
+    FUNCTION PROTOTYPES
+***************************************************************************/
+
+/* enable or disable the cache, it's disabled by default */
+void romcache_set_enable(int enable);
+
+/* allocate and fill the regions of the running game from the cache;
+   returns 1 if done, 0 if the ROMs have to be loaded */
+int romcache_load(const rom_entry *romp, int bios);
+
+/* remember a ROM file used by the load, the cache depends on it */
+void romcache_add_file(mame_file *file);
+
+/* save the regions just loaded without errors or warnings */
+void romcache_save(const rom_entry *romp, int bios);
+
+/* forget the ROM files remembered */
+void romcache_exit(void);
+
+#endif	/* __ROMCACHE_H__ */
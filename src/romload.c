@@ -17,6 +17,7 @@
 #include "harddisk.h"
 #include "artwork.h"
 #include "config.h"
+#include "romcache.h"
 #include <stdarg.h>
 #include <ctype.h>
 
@@ -39,6 +40,19 @@ int system_bios;
 
 static int total_rom_load_warnings;
 
+/* ROM files of a region opened ahead of the load */
+typedef struct _rom_preload rom_preload;
+struct _rom_preload
+{
+	const rom_entry *entry;				/* ROM entry of the file */
+	mame_file *		file;				/* opened file, NULL if missing */
+	UINT32			length;				/* bytes read from the file by the region */
+	int				failed;				/* the deferred inflate failed */
+};
+
+/* max bytes of the ROM files read ahead of their copy in the region */
+#define ROM_PRELOAD_MAX		(16 * 1024 * 1024)
+
 
 
 /***************************************************************************
@@ -461,32 +475,155 @@ static void region_post_process(rom_load_data *romdata, const rom_entry *regiond
 
 
 /*-------------------------------------------------
-    open_rom_file - open a ROM file, searching
-    up the parent and loading by checksum
+    find_rom_file - search a ROM file up the
+    parent chain
 -------------------------------------------------*/
 
-static int open_rom_file(rom_load_data *romdata, const rom_entry *romp)
+static mame_file *find_rom_file(const rom_entry *romp, int deferred)
 {
 	const game_driver *drv;
+	mame_file *file = NULL;
+
+	/* Attempt reading up the chain through the parents. It automatically also
+       attempts any kind of load by checksum supported by the archives. */
+	for (drv = Machine->gamedrv; !file && drv; drv = driver_get_clone(drv))
+		if (drv->name && *drv->name)
+		{
+			if (deferred)
+				file = mame_fopen_rom_deferred(drv->name, ROM_GETNAME(romp), ROM_GETHASHDATA(romp));
+			else
+				file = mame_fopen_rom(drv->name, ROM_GETNAME(romp), ROM_GETHASHDATA(romp));
+		}
+
+	/* the cached regions depend on where the file was found */
+	if (file)
+		romcache_add_file(file);
+
+	return file;
+}
+
+
+/*-------------------------------------------------
+    open_rom_file - open a ROM file, searching
+    up the parent and loading by checksum; the
+    inflate and the checksum are deferred
+-------------------------------------------------*/
 
+static int open_rom_file(rom_load_data *romdata, const rom_entry *romp)
+{
 	++romdata->romsloaded;
 
 	/* update status display */
+	romdata->file = NULL;
 	if (osd_display_loading_rom_message(ROM_GETNAME(romp), romdata))
        return 0;
 
-	/* Attempt reading up the chain through the parents. It automatically also
-       attempts any kind of load by checksum supported by the archives. */
-	romdata->file = NULL;
-	for (drv = Machine->gamedrv; !romdata->file && drv; drv = driver_get_clone(drv))
-		if (drv->name && *drv->name)
-			romdata->file = mame_fopen_rom(drv->name, ROM_GETNAME(romp), ROM_GETHASHDATA(romp));
+	romdata->file = find_rom_file(romp, 1);
 
 	/* return the result */
 	return (romdata->file != NULL);
 }
 
 
+/*-------------------------------------------------
+    preload_rom_files - list the ROM files of a
+    region, they are opened later in batches
+-------------------------------------------------*/
+
+static rom_preload *preload_rom_files(const rom_entry *romp, int *count)
+{
+	const rom_entry *entry, *next;
+	rom_preload *preload;
+	int total, i;
+
+	/* count the files we are going to load */
+	total = 0;
+	for (entry = romp; !ROMENTRY_ISREGIONEND(entry); entry++)
+		if (ROMENTRY_ISFILE(entry) && (!ROM_GETBIOSFLAGS(entry) || (ROM_GETBIOSFLAGS(entry) == (system_bios+1))))
+			total++;
+
+	preload = malloc((total + 1) * sizeof(preload[0]));
+	if (!preload)
+		return NULL;
+	*count = total;
+
+	i = 0;
+	for (entry = romp; !ROMENTRY_ISREGIONEND(entry); entry++)
+		if (ROMENTRY_ISFILE(entry) && (!ROM_GETBIOSFLAGS(entry) || (ROM_GETBIOSFLAGS(entry) == (system_bios+1))))
+		{
+			preload[i].entry = entry;
+			preload[i].file = NULL;
+			preload[i].length = ROM_GETLENGTH(entry);
+			for (next = entry + 1; ROMENTRY_ISCONTINUE(next); next++)
+				preload[i].length += ROM_GETLENGTH(next);
+			preload[i].failed = 0;
+			i++;
+		}
+
+	return preload;
+}
+
+
+/*-------------------------------------------------
+    open_rom_files - open the next files of the
+    list, up to ROM_PRELOAD_MAX bytes, then
+    inflate and hash them on all the available
+    processors; returns the index after the last
+    one opened
+-------------------------------------------------*/
+
+static int open_rom_files(rom_load_data *romdata, rom_preload *preload, int first, int count)
+{
+	UINT32 size;
+	int last, i;
+
+	/* always at least one file, also if bigger than the limit */
+	size = preload[first].length;
+	for (last = first + 1; last < count && size + preload[last].length <= ROM_PRELOAD_MAX; last++)
+		size += preload[last].length;
+
+	/* open them in order, the archive access isn't reentrant */
+	for (i = first; i < last; i++)
+	{
+		debugload("Opening ROM file: %s\n", ROM_GETNAME(preload[i].entry));
+		open_rom_file(romdata, preload[i].entry);
+		preload[i].file = romdata->file;
+		romdata->file = NULL;
+	}
+
+	/* then inflate and hash them at the same time */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for (i = first; i < last; i++)
+		if (preload[i].file && mame_fcomplete(preload[i].file) != 0)
+		{
+			mame_fclose(preload[i].file);
+			preload[i].file = NULL;
+			preload[i].failed = 1;
+		}
+
+	return last;
+}
+
+
+/*-------------------------------------------------
+    free_rom_files - close the preloaded files
+    not yet used and free the list
+-------------------------------------------------*/
+
+static void free_rom_files(rom_preload *preload, int first, int count)
+{
+	int i;
+
+	for (i = first; i < count; i++)
+		if (preload[i].file)
+			mame_fclose(preload[i].file);
+
+	free(preload);
+}
+
+
 /*-------------------------------------------------
     rom_fread - cheesy fread that fills with
     random data for a NULL file
@@ -709,6 +846,18 @@ static int copy_rom_data(rom_load_data *romdata, const rom_entry *romp)
 static int process_rom_entries(rom_load_data *romdata, const rom_entry *romp)
 {
 	UINT32 lastflags = 0;
+	rom_preload *preload;
+	int preloadcount = 0;
+	int preloadindex = 0;
+	int preloadopened = 0;
+
+	/* list the files of the region to open them ahead */
+	preload = preload_rom_files(romp, &preloadcount);
+	if (!preload)
+	{
+		printf("Error: unable to allocate memory for the ROM files\n");
+		return 0;
+	}
 
 	/* loop until we hit the end of this region */
 	while (!ROMENTRY_ISREGIONEND(romp))
@@ -749,9 +898,17 @@ static int process_rom_entries(rom_load_data *romdata, const rom_entry *romp)
 				const rom_entry *baserom = romp;
 				int explength = 0;
 
-				/* open the file */
-				debugload("Opening ROM file: %s\n", ROM_GETNAME(romp));
-				if (!open_rom_file(romdata, romp))
+				/* open, inflate and hash the next batch of files */
+				if (preloadindex >= preloadopened)
+					preloadopened = open_rom_files(romdata, preload, preloadindex, preloadcount);
+
+				/* take the preloaded file; if it couldn't be inflated go
+                   on with the normal search, as that would skip it */
+				romdata->file = preload[preloadindex].file;
+				if (preload[preloadindex].failed)
+					romdata->file = find_rom_file(romp, 0);
+				preload[preloadindex++].file = NULL;
+				if (!romdata->file)
 					handle_missing_file(romdata, romp);
 
 				/* loop until we run out of reloads */
@@ -812,6 +969,7 @@ static int process_rom_entries(rom_load_data *romdata, const rom_entry *romp)
 			romp++;	/* something else; skip */
 		}
 	}
+	free_rom_files(preload, preloadindex, preloadcount);
 	return 1;
 
 	/* error case */
@@ -819,6 +977,7 @@ fatalerror:
 	if (romdata->file)
 		mame_fclose(romdata->file);
 	romdata->file = NULL;
+	free_rom_files(preload, preloadindex, preloadcount);
 	return 0;
 }
 
@@ -953,6 +1112,15 @@ int rom_init(const rom_entry *romp)
 	/* determine the correct biosset to load based on options.bios string */
 	system_bios = determine_bios_rom(Machine->gamedrv->bios);
 
+	/* take the regions from the ROM cache if they didn't change */
+	if (romcache_load(romp, system_bios))
+	{
+		total_rom_load_warnings = 0;
+
+		add_exit_callback(rom_exit);
+		return 0;
+	}
+
 	/* loop until we hit the end */
 	for (region = romp, regnum = 0; region; region = rom_next_region(region), regnum++)
 	{
@@ -1020,6 +1188,11 @@ int rom_init(const rom_entry *romp)
 			region_post_process(&romdata, regionlist[regnum]);
 		}
 
+	/* keep a clean load for the next time */
+	if (!romdata.errors && !romdata.warnings)
+		romcache_save(romp, system_bios);
+	romcache_exit();
+
 	/* display the results and exit */
 	total_rom_load_warnings = romdata.warnings;
 
@@ -30,6 +30,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* The SHA extensions are selected at runtime, so they are used only with
+   compilers able to enable them for a single function */
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__i386__) || defined(__x86_64__)) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 unsigned int READ_UINT32(const UINT8* data)
 {
 	return ((UINT32)data[0] << 24) |
@@ -266,6 +274,243 @@ sha1_block(struct sha1_ctx *ctx, const UINT8 *block)
   sha1_transform(ctx->digest, data);
 }
 
+#ifdef SHA1_SHANI
+
+/* -1 until checked at the first use */
+static int sha1_shani_supported = -1;
+
+/* Check the CPU support of the SHA extensions, and of the SSSE3 and SSE4.1
+   instructions used with them */
+
+static int
+sha1_shani_detect(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid_max(0, 0) < 7)
+    return 0;
+
+  __cpuid(1, eax, ebx, ecx, edx);
+  if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+    return 0;
+
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & (1 << 29)) != 0; /* SHA */
+}
+
+/* The same transformation of sha1_transform() done by the SHA extensions,
+   on many blocks of big endian data at time. The state is kept as ABCD in
+   one register, and E in the top word of another */
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void
+sha1_transform_shani(UINT32 *state, const UINT8 *data, unsigned blocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+  __m128i abcd, abcd_save, e0, e0_save, e1;
+  __m128i msg0, msg1, msg2, msg3;
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+  e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+  while (blocks--)
+    {
+      abcd_save = abcd;
+      e0_save = e0;
+
+      /* Rounds 0-3 */
+      msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+      e0 = _mm_add_epi32(e0, msg0);
+      e1 = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+      /* Rounds 4-7 */
+      msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+      e1 = _mm_sha1nexte_epu32(e1, msg1);
+      e0 = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+      msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+      /* Rounds 8-11 */
+      msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+      e0 = _mm_sha1nexte_epu32(e0, msg2);
+      e1 = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+      msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+      msg0 = _mm_xor_si128(msg0, msg2);
+
+      /* Rounds 12-15 */
+      msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+      e1 = _mm_sha1nexte_epu32(e1, msg3);
+      e0 = abcd;
+      msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+      msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+      msg1 = _mm_xor_si128(msg1, msg3);
+
+      /* Rounds 16-19 */
+      e0 = _mm_sha1nexte_epu32(e0, msg0);
+      e1 = abcd;
+      msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+      msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+      msg2 = _mm_xor_si128(msg2, msg0);
+
+      /* Rounds 20-23 */
+      e1 = _mm_sha1nexte_epu32(e1, msg1);
+      e0 = abcd;
+      msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+      msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+      msg3 = _mm_xor_si128(msg3, msg1);
+
+      /* Rounds 24-27 */
+      e0 = _mm_sha1nexte_epu32(e0, msg2);
+      e1 = abcd;
+      msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+      msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+      msg0 = _mm_xor_si128(msg0, msg2);
+
+      /* Rounds 28-31 */
+      e1 = _mm_sha1nexte_epu32(e1, msg3);
+      e0 = abcd;
+      msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+      msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+      msg1 = _mm_xor_si128(msg1, msg3);
+
+      /* Rounds 32-35 */
+      e0 = _mm_sha1nexte_epu32(e0, msg0);
+      e1 = abcd;
+      msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+      msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+      msg2 = _mm_xor_si128(msg2, msg0);
+
+      /* Rounds 36-39 */
+      e1 = _mm_sha1nexte_epu32(e1, msg1);
+      e0 = abcd;
+      msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+      msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+      msg3 = _mm_xor_si128(msg3, msg1);
+
+      /* Rounds 40-43 */
+      e0 = _mm_sha1nexte_epu32(e0, msg2);
+      e1 = abcd;
+      msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+      msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+      msg0 = _mm_xor_si128(msg0, msg2);
+
+      /* Rounds 44-47 */
+      e1 = _mm_sha1nexte_epu32(e1, msg3);
+      e0 = abcd;
+      msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+      msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+      msg1 = _mm_xor_si128(msg1, msg3);
+
+      /* Rounds 48-51 */
+      e0 = _mm_sha1nexte_epu32(e0, msg0);
+      e1 = abcd;
+      msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+      msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+      msg2 = _mm_xor_si128(msg2, msg0);
+
+      /* Rounds 52-55 */
+      e1 = _mm_sha1nexte_epu32(e1, msg1);
+      e0 = abcd;
+      msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+      msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+      msg3 = _mm_xor_si128(msg3, msg1);
+
+      /* Rounds 56-59 */
+      e0 = _mm_sha1nexte_epu32(e0, msg2);
+      e1 = abcd;
+      msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+      msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+      msg0 = _mm_xor_si128(msg0, msg2);
+
+      /* Rounds 60-63 */
+      e1 = _mm_sha1nexte_epu32(e1, msg3);
+      e0 = abcd;
+      msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+      msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+      msg1 = _mm_xor_si128(msg1, msg3);
+
+      /* Rounds 64-67 */
+      e0 = _mm_sha1nexte_epu32(e0, msg0);
+      e1 = abcd;
+      msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+      msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+      msg2 = _mm_xor_si128(msg2, msg0);
+
+      /* Rounds 68-71 */
+      e1 = _mm_sha1nexte_epu32(e1, msg1);
+      e0 = abcd;
+      msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+      msg3 = _mm_xor_si128(msg3, msg1);
+
+      /* Rounds 72-75 */
+      e0 = _mm_sha1nexte_epu32(e0, msg2);
+      e1 = abcd;
+      msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+      /* Rounds 76-79 */
+      e1 = _mm_sha1nexte_epu32(e1, msg3);
+      e0 = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+      e0 = _mm_sha1nexte_epu32(e0, e0_save);
+      abcd = _mm_add_epi32(abcd, abcd_save);
+
+      data += SHA1_DATA_SIZE;
+    }
+
+  _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+/* Process whole blocks, with the SHA extensions if the CPU has them */
+
+static void
+sha1_blocks(struct sha1_ctx *ctx, const UINT8 *data, unsigned blocks)
+{
+#ifdef SHA1_SHANI
+  /* A benign race, all the threads store the same value */
+  if (sha1_shani_supported < 0)
+    sha1_shani_supported = sha1_shani_detect();
+
+  if (sha1_shani_supported)
+    {
+      /* Update block count */
+      ctx->count_low += blocks;
+      if (ctx->count_low < blocks)
+	++ctx->count_high;
+
+      sha1_transform_shani(ctx->digest, data, blocks);
+      return;
+    }
+#endif
+
+  while (blocks--)
+    {
+      sha1_block(ctx, data);
+      data += SHA1_DATA_SIZE;
+    }
+}
+
 void
 sha1_update(struct sha1_ctx *ctx,
 	    unsigned length, const UINT8 *buffer)
@@ -282,16 +527,18 @@ sha1_update(struct sha1_ctx *ctx,
       else
 	{
 	  memcpy(ctx->block + ctx->index, buffer, left);
-	  sha1_block(ctx, ctx->block);
+	  sha1_blocks(ctx, ctx->block, 1);
 	  buffer += left;
 	  length -= left;
 	}
     }
-  while (length >= SHA1_DATA_SIZE)
+  if (length >= SHA1_DATA_SIZE)
     {
-      sha1_block(ctx, buffer);
-      buffer += SHA1_DATA_SIZE;
-      length -= SHA1_DATA_SIZE;
+      unsigned blocks = length / SHA1_DATA_SIZE;
+
+      sha1_blocks(ctx, buffer, blocks);
+      buffer += blocks * SHA1_DATA_SIZE;
+      length -= blocks * SHA1_DATA_SIZE;
     }
   if ((ctx->index = length))     /* This assignment is intended */
     /* Buffer leftovers */
@@ -1701,7 +1701,7 @@ void tilemap_nb_draw( mame_bitmap *dest, UINT32 number, UINT32 scrollx, UINT32 s
 
 #endif // !DECLARE && !TRANSP
 
-#define ROZ_PLOT_PIXEL(INPUT_VAL)										\
+#define ROZ_PLOT_PIXEL_AT(dest,pri,clut,INPUT_VAL)						\
 	if (blit.draw_masked == (blitmask_t)pbt32)							\
 	{																	\
 		clut = &Machine->remapped_colortable[priority >> 16] ;			\
@@ -1753,6 +1753,8 @@ void tilemap_nb_draw( mame_bitmap *dest, UINT32 number, UINT32 scrollx, UINT32 s
 		*dest = INPUT_VAL ;												\
 	}
 
+#define ROZ_PLOT_PIXEL(INPUT_VAL) ROZ_PLOT_PIXEL_AT(dest,pri,clut,INPUT_VAL)
+
 #ifdef DECLARE
 
 DECLARE(copyroz_core,(mame_bitmap *bitmap,tilemap *tmap,
@@ -1892,60 +1894,64 @@ DECLARE(copyroz_core,(mame_bitmap *bitmap,tilemap *tmap,
 	}
 	else
 	{
+		/* the rows are independent, and they can be drawn in parallel */
+		int rows = ey - sy + 1;
+		int row;
+
 		if (wraparound)
 		{
 			/* plot with wraparound */
-			while (sy <= ey)
+			ROZ_PARALLEL_FOR(rows)
+			for (row = 0; row < rows; row++)
 			{
-				x = sx;
-				cx = startx;
-				cy = starty;
-				dest = ((DATA_TYPE *)bitmap->line[sy]) + sx;
-				pri = ((UINT8 *)priority_bitmap->line[sy]) + sx;
-				while (x <= ex)
+				UINT32 rcx = startx + (UINT32)row * incyx;
+				UINT32 rcy = starty + (UINT32)row * incyy;
+				int rx = sx;
+				DATA_TYPE *rdest = ((DATA_TYPE *)bitmap->line[sy + row]) + sx;
+				UINT8 *rpri = ((UINT8 *)priority_bitmap->line[sy + row]) + sx;
+				pen_t *rclut;
+
+				while (rx <= ex)
 				{
-					if( (((UINT8 *)transparency_bitmap->line[(cy>>16)&ymask])[(cx>>16)&xmask]&mask) == value )
+					if( (((UINT8 *)transparency_bitmap->line[(rcy>>16)&ymask])[(rcx>>16)&xmask]&mask) == value )
 					{
-						ROZ_PLOT_PIXEL(((((UINT16 *)srcbitmap->line[(cy >> 16) & ymask])[(cx >> 16) & xmask]+palette_offset))) ;
+						ROZ_PLOT_PIXEL_AT(rdest,rpri,rclut,((((UINT16 *)srcbitmap->line[(rcy >> 16) & ymask])[(rcx >> 16) & xmask]+palette_offset))) ;
 					}
-					cx += incxx;
-					cy += incxy;
-					x++;
-					dest++;
-					pri++;
+					rcx += incxx;
+					rcy += incxy;
+					rx++;
+					rdest++;
+					rpri++;
 				}
-				startx += incyx;
-				starty += incyy;
-				sy++;
 			}
 		}
 		else
 		{
-			while (sy <= ey)
+			ROZ_PARALLEL_FOR(rows)
+			for (row = 0; row < rows; row++)
 			{
-				x = sx;
-				cx = startx;
-				cy = starty;
-				dest = ((DATA_TYPE *)bitmap->line[sy]) + sx;
-				pri = ((UINT8 *)priority_bitmap->line[sy]) + sx;
-				while (x <= ex)
+				UINT32 rcx = startx + (UINT32)row * incyx;
+				UINT32 rcy = starty + (UINT32)row * incyy;
+				int rx = sx;
+				DATA_TYPE *rdest = ((DATA_TYPE *)bitmap->line[sy + row]) + sx;
+				UINT8 *rpri = ((UINT8 *)priority_bitmap->line[sy + row]) + sx;
+				pen_t *rclut;
+
+				while (rx <= ex)
 				{
-					if (cx < widthshifted && cy < heightshifted)
+					if (rcx < widthshifted && rcy < heightshifted)
 					{
-						if( (((UINT8 *)transparency_bitmap->line[cy>>16])[cx>>16]&mask)==value )
+						if( (((UINT8 *)transparency_bitmap->line[rcy>>16])[rcx>>16]&mask)==value )
 						{
-							ROZ_PLOT_PIXEL((((UINT16 *)srcbitmap->line[cy >> 16])[cx >> 16]+palette_offset)) ;
+							ROZ_PLOT_PIXEL_AT(rdest,rpri,rclut,(((UINT16 *)srcbitmap->line[rcy >> 16])[rcx >> 16]+palette_offset)) ;
 						}
 					}
-					cx += incxx;
-					cy += incxy;
-					x++;
-					dest++;
-					pri++;
+					rcx += incxx;
+					rcy += incxy;
+					rx++;
+					rdest++;
+					rpri++;
 				}
-				startx += incyx;
-				starty += incyy;
-				sy++;
 			}
 		}
 	}
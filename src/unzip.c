@@ -25,6 +25,21 @@ int	gUnzipQuiet = 0;		/* flag controls error messages */
 
 #define INFLATE_INPUT_BUFFER_MAX 16384
 
+/* Hashed index of the central directory, built when the zip is opened */
+struct _zip_index
+{
+	unsigned size; /* memory used by the index */
+	unsigned mask; /* number of buckets - 1 */
+	int* name_bucket; /* first entry with the same name hash, -1 if none */
+	int* crc_bucket; /* first entry with the same crc hash, -1 if none */
+	int* name_next; /* next entry with the same name hash */
+	int* crc_next; /* next entry with the same crc hash */
+	unsigned* pos; /* position of the entry in cent_dir */
+	UINT32* crc; /* crc of the entry */
+	unsigned* name; /* position of the entry name, without directory, in pool */
+	char* pool; /* entry names */
+};
+
 /* Print a error message */
 void errormsg(const char* extmsg, const char* usermsg, const char* zipname) {
 	/* Output to the user with no internal detail */
@@ -179,6 +194,101 @@ static int ecd_read(zip_file* zip) {
 #define ZIPXTRALN	0x1c
 #define ZIPNAME		0x1e
 
+/* Hash of a file name, ignoring case */
+static unsigned hash_filename(const char* file) {
+	unsigned h = 0;
+	while (*file)
+		h = h * 31 + toupper((UINT8)*file++);
+	return h;
+}
+
+/* Hash of a crc */
+static unsigned hash_crc(UINT32 crc) {
+	return crc ^ (crc >> 16);
+}
+
+/* Build the hashed index of the central directory
+   return:
+     !=0 success, index to free with free()
+     ==0 error
+*/
+static struct _zip_index* buildzipindex(zip_file* zip) {
+	struct _zip_index* index;
+	unsigned count, pool_size, buckets, size;
+	unsigned pos;
+	char* p;
+	int i;
+
+	/* count the entries and the space for the names */
+	count = 0;
+	pool_size = 0;
+	zip->cd_pos = 0;
+	while (readzip(zip)) {
+		const char* name = strrchr(zip->ent.name,'/');
+		name = name ? name + 1 : zip->ent.name;
+		pool_size += strlen(name) + 1;
+		++count;
+	}
+
+	buckets = 16;
+	while (buckets < count * 2)
+		buckets *= 2;
+
+	size = sizeof(struct _zip_index)
+		+ 2 * buckets * sizeof(int)
+		+ count * (2 * sizeof(int) + sizeof(unsigned) + sizeof(UINT32) + sizeof(unsigned))
+		+ pool_size;
+
+	index = (struct _zip_index*)malloc(size);
+	if (!index) {
+		zip->cd_pos = 0;
+		return 0;
+	}
+
+	index->size = size;
+	index->mask = buckets - 1;
+	index->name_bucket = (int*)(index + 1);
+	index->crc_bucket = index->name_bucket + buckets;
+	index->name_next = index->crc_bucket + buckets;
+	index->crc_next = index->name_next + count;
+	index->pos = (unsigned*)(index->crc_next + count);
+	index->crc = (UINT32*)(index->pos + count);
+	index->name = (unsigned*)(index->crc + count);
+	index->pool = (char*)(index->name + count);
+
+	/* store the entries */
+	p = index->pool;
+	count = 0;
+	zip->cd_pos = 0;
+	for(pos=zip->cd_pos;readzip(zip);pos=zip->cd_pos) {
+		const char* name = strrchr(zip->ent.name,'/');
+		name = name ? name + 1 : zip->ent.name;
+		index->pos[count] = pos;
+		index->crc[count] = zip->ent.crc32;
+		index->name[count] = p - index->pool;
+		strcpy(p, name);
+		p += strlen(name) + 1;
+		++count;
+	}
+	zip->cd_pos = 0;
+
+	/* link them backward, so every list is in directory order */
+	for(i=0;i<buckets;++i) {
+		index->name_bucket[i] = -1;
+		index->crc_bucket[i] = -1;
+	}
+	for(i=count-1;i>=0;--i) {
+		unsigned h = hash_filename(index->pool + index->name[i]) & index->mask;
+		index->name_next[i] = index->name_bucket[h];
+		index->name_bucket[h] = i;
+		h = hash_crc(index->crc[i]) & index->mask;
+		index->crc_next[i] = index->crc_bucket[h];
+		index->crc_bucket[h] = i;
+	}
+
+	return index;
+}
+
 /* Opens a zip stream for reading
    return:
      !=0 success, zip stream
@@ -193,7 +303,10 @@ zip_file* openzip(int pathtype, int pathindex, const char* zipfile) {
 		return 0;
 	}
 
-	/* open */
+	/* open, serialized because the OSD path composition isn't reentrant */
+#ifdef _OPENMP
+#pragma omp critical (osd_fopen)
+#endif
 	zip->fp = osd_fopen(pathtype, pathindex, zipfile, "rb", &error);
 	if (!zip->fp) {
 		errormsg ("Opening for reading", ERROR_FILESYSTEM, zipfile);
@@ -299,6 +412,9 @@ zip_file* openzip(int pathtype, int pathindex, const char* zipfile) {
 	zip->pathtype = pathtype;
 	zip->pathindex = pathindex;
 
+	/* index the directory, without it the entries are searched linearly */
+	zip->index = buildzipindex(zip);
+
 	return zip;
 }
 
@@ -359,6 +475,7 @@ zip_entry* readzip(zip_file* zip) {
 /* Closes a zip stream */
 void closezip(zip_file* zip) {
 	/* release all */
+	free(zip->index);
 	free(zip->ent.name);
 	free(zip->cd);
 	free(zip->ecd);
@@ -369,6 +486,107 @@ void closezip(zip_file* zip) {
 	free(zip);
 }
 
+/* Check if a name is a crc in the "%08x" format */
+static int is_crc_filename(const char* file, UINT32* crc) {
+	unsigned i;
+	for(i=0;i<8;++i)
+		if (!isdigit((UINT8)file[i]) && !(file[i] >= 'a' && file[i] <= 'f'))
+			return 0;
+	if (file[8] != 0)
+		return 0;
+	*crc = strtoul(file, 0, 16);
+	return 1;
+}
+
+static int equal_filename(const char* zipfile, const char* file);
+
+/* Find an entry by name, and if by_crc is set also by crc given as a "%08x" name
+   return:
+     !=0 success
+     ==0 not found
+*/
+static zip_entry* findzipentry(zip_file* zip, const char* filename, int by_crc) {
+	struct _zip_index* index = zip->index;
+	UINT32 crc;
+	int crc_name = by_crc && is_crc_filename(filename, &crc) && crc != 0;
+	int best;
+	int i;
+
+	/* without an index scan the whole directory */
+	if (!index) {
+		char crcbuf[9];
+		zip_entry* ent;
+
+		rewindzip(zip);
+		while ((ent = readzip(zip)) != 0) {
+			sprintf(crcbuf,"%08x",ent->crc32);
+			if (equal_filename(ent->name, filename) ||
+					(by_crc && ent->crc32 && !strcmp(crcbuf, filename)))
+				return ent;
+		}
+		return 0;
+	}
+
+	/* the first entry in the directory matching the name or the crc */
+	best = -1;
+	for(i=index->name_bucket[hash_filename(filename) & index->mask];i>=0;i=index->name_next[i]) {
+		if (equal_filename(index->pool + index->name[i], filename)) {
+			best = i;
+			break;
+		}
+	}
+	if (crc_name) {
+		for(i=index->crc_bucket[hash_crc(crc) & index->mask];i>=0;i=index->crc_next[i]) {
+			if (index->crc[i] == crc) {
+				if (best < 0 || i < best)
+					best = i;
+				break;
+			}
+		}
+	}
+
+	if (best < 0)
+		return 0;
+
+	zip->cd_pos = index->pos[best];
+	return readzip(zip);
+}
+
+zip_entry* findzip(zip_file* zip, const char* filename) {
+	return findzipentry(zip, filename, 1);
+}
+
+/* Find an entry by crc
+   return:
+     !=0 success
+     ==0 not found
+*/
+zip_entry* findzipcrc(zip_file* zip, UINT32 crc) {
+	struct _zip_index* index = zip->index;
+	int i;
+
+	/* without an index scan the whole directory */
+	if (!index) {
+		zip_entry* ent;
+
+		rewindzip(zip);
+		while ((ent = readzip(zip)) != 0) {
+			if (ent->crc32 == crc)
+				return ent;
+		}
+		return 0;
+	}
+
+	for(i=index->crc_bucket[hash_crc(crc) & index->mask];i>=0;i=index->crc_next[i]) {
+		if (index->crc[i] == crc) {
+			zip->cd_pos = index->pos[i];
+			return readzip(zip);
+		}
+	}
+
+	return 0;
+}
+
 /* Suspend access to a zip file (release file handler)
    in:
       zip opened zip
@@ -454,6 +672,110 @@ int seekcompresszip(zip_file* zip, zip_entry* ent) {
 	return 0;
 }
 
+/* -------------------------------------------------------------------------
+   Inflaters pool
+ ------------------------------------------------------------------------- */
+
+/* Size of the pieces of output passed to the inflate callback */
+#define INFLATE_OUTPUT_CHUNK 65536
+
+/* Inflate state with its input buffer, kept for reuse as resetting it
+   is much cheaper than allocating a new one for every file */
+struct _zip_inflater
+{
+	struct _zip_inflater* next; /* next free inflater */
+	z_stream stream; /* raw deflate stream, without zlib header */
+	unsigned char* in_buffer; /* INFLATE_INPUT_BUFFER_MAX+1 bytes, for the reads from file */
+};
+
+/* Free inflaters, one for each thread used at the same time at most */
+static struct _zip_inflater* inflater_pool = 0;
+
+/* Get an inflater ready for a new stream
+   return:
+     !=0 success
+     ==0 error
+*/
+static struct _zip_inflater* inflater_get(void) {
+	struct _zip_inflater* inflater;
+	int err;
+
+#ifdef _OPENMP
+#pragma omp critical (unzip_inflater)
+#endif
+	{
+		inflater = inflater_pool;
+		if (inflater)
+			inflater_pool = inflater->next;
+	}
+
+	if (inflater)
+		return inflater;
+
+	inflater = (struct _zip_inflater*)malloc(sizeof(struct _zip_inflater));
+	if (!inflater)
+		return 0;
+
+	inflater->in_buffer = (unsigned char*)malloc(INFLATE_INPUT_BUFFER_MAX+1);
+	if (!inflater->in_buffer) {
+		free(inflater);
+		return 0;
+	}
+
+	memset(&inflater->stream, 0, sizeof(inflater->stream));
+	inflater->stream.zalloc = 0;
+	inflater->stream.zfree = 0;
+	inflater->stream.opaque = 0;
+
+	err = inflateInit2(&inflater->stream, -MAX_WBITS);
+	/* windowBits is passed < 0 to tell that there is no zlib header.
+     * Note that in this case inflate *requires* an extra "dummy" byte
+     * after the compressed stream in order to complete decompression and
+     * return Z_STREAM_END.
+     */
+	if (err != Z_OK)
+	{
+		logerror("inflateInit error: %d\n", err);
+		free(inflater->in_buffer);
+		free(inflater);
+		return 0;
+	}
+
+	return inflater;
+}
+
+/* Return an inflater to the pool */
+static void inflater_put(struct _zip_inflater* inflater) {
+	int err = inflateReset(&inflater->stream);
+	if (err != Z_OK)
+	{
+		logerror("inflateReset error: %d\n", err);
+		inflateEnd(&inflater->stream);
+		free(inflater->in_buffer);
+		free(inflater);
+		return;
+	}
+
+#ifdef _OPENMP
+#pragma omp critical (unzip_inflater)
+#endif
+	{
+		inflater->next = inflater_pool;
+		inflater_pool = inflater;
+	}
+}
+
+/* Free all the inflaters kept for reuse */
+void unzip_inflater_clear(void) {
+	while (inflater_pool) {
+		struct _zip_inflater* inflater = inflater_pool;
+		inflater_pool = inflater->next;
+		inflateEnd(&inflater->stream);
+		free(inflater->in_buffer);
+		free(inflater);
+	}
+}
+
 /* Inflate a file
    in:
    in_file stream to inflate
@@ -468,79 +790,126 @@ int seekcompresszip(zip_file* zip, zip_entry* ent) {
 */
 static int inflate_file(osd_file* in_file, unsigned in_size, unsigned char* out_data, unsigned out_size)
 {
-    int err;
-	unsigned char* in_buffer;
-    z_stream d_stream; /* decompression stream */
-
-    d_stream.zalloc = 0;
-    d_stream.zfree = 0;
-    d_stream.opaque = 0;
-
-	d_stream.next_in  = 0;
-	d_stream.avail_in = 0;
-    d_stream.next_out = out_data;
-    d_stream.avail_out = out_size;
+	int err;
+	struct _zip_inflater* inflater;
+	z_stream* d_stream; /* decompression stream */
 
-    err = inflateInit2(&d_stream, -MAX_WBITS);
-	/* windowBits is passed < 0 to tell that there is no zlib header.
-     * Note that in this case inflate *requires* an extra "dummy" byte
-     * after the compressed stream in order to complete decompression and
-     * return Z_STREAM_END.
-     */
-    if (err != Z_OK)
-	{
-		logerror("inflateInit error: %d\n", err);
-        return -1;
-	}
-
-	in_buffer = (unsigned char*)malloc(INFLATE_INPUT_BUFFER_MAX+1);
-	if (!in_buffer)
+	inflater = inflater_get();
+	if (!inflater)
 		return -1;
 
-    for (;;)
+	d_stream = &inflater->stream;
+	d_stream->next_in  = 0;
+	d_stream->avail_in = 0;
+	d_stream->next_out = out_data;
+	d_stream->avail_out = out_size;
+
+	for (;;)
 	{
 		if (in_size <= 0)
 		{
 			logerror("inflate error: compressed size too small\n");
-			free (in_buffer);
+			inflater_put(inflater);
 			return -1;
 		}
-		d_stream.next_in  = in_buffer;
-		d_stream.avail_in = osd_fread (in_file, in_buffer, MIN(in_size, INFLATE_INPUT_BUFFER_MAX));
-		in_size -= d_stream.avail_in;
+		d_stream->next_in  = inflater->in_buffer;
+		d_stream->avail_in = osd_fread (in_file, inflater->in_buffer, MIN(in_size, INFLATE_INPUT_BUFFER_MAX));
+		in_size -= d_stream->avail_in;
 		if (in_size == 0)
-			d_stream.avail_in++; /* add dummy byte at end of compressed data */
+			d_stream->avail_in++; /* add dummy byte at end of compressed data */
 
-        err = inflate(&d_stream, Z_NO_FLUSH);
-        if (err == Z_STREAM_END)
+		err = inflate(d_stream, Z_NO_FLUSH);
+		if (err == Z_STREAM_END)
 			break;
 		if (err != Z_OK)
 		{
 			logerror("inflate error: %d\n", err);
-			free (in_buffer);
+			inflater_put(inflater);
 			return -1;
 		}
-    }
+	}
 
-    err = inflateEnd(&d_stream);
-	if (err != Z_OK)
+	if ((d_stream->avail_out > 0) || (in_size > 0))
 	{
-		logerror("inflateEnd error: %d\n", err);
-		free (in_buffer);
+		logerror("zip size mismatch. %i\n", in_size);
+		inflater_put(inflater);
 		return -1;
 	}
 
-	free (in_buffer);
+	inflater_put(inflater);
 
-	if ((d_stream.avail_out > 0) || (in_size > 0))
+	return 0;
+}
+
+/* Inflate a memory block
+   in:
+   in_data compressed data, followed by one spare byte
+   in_size size of the compressed data
+   out_size size of decompressed data
+   callback if not null, called in order with every piece of the output
+     just decompressed, while it's still in the cache
+   out:
+   out_data buffer for decompressed data
+   return:
+   ==0 ok
+   note:
+   it doesn't touch any file or global state, other than the inflaters
+   pool, so it can be called concurrently on different blocks
+*/
+int inflate_zipped_data_stream(unsigned char* in_data, unsigned in_size, unsigned char* out_data, unsigned out_size, inflate_callback callback, void* param)
+{
+	int err;
+	struct _zip_inflater* inflater;
+	z_stream* d_stream; /* decompression stream */
+
+	inflater = inflater_get();
+	if (!inflater)
+		return -1;
+
+	d_stream = &inflater->stream;
+	d_stream->next_in = in_data;
+	d_stream->avail_in = in_size + 1; /* add dummy byte at end of compressed data */
+	d_stream->next_out = out_data;
+
+	/* without a callback inflate all in one step */
+	do
 	{
-		logerror("zip size mismatch. %i\n", in_size);
+		unsigned char* chunk = d_stream->next_out;
+
+		d_stream->avail_out = out_size - (chunk - out_data);
+		if (callback && d_stream->avail_out > INFLATE_OUTPUT_CHUNK)
+			d_stream->avail_out = INFLATE_OUTPUT_CHUNK;
+
+		err = inflate(d_stream, Z_SYNC_FLUSH);
+		if (err != Z_OK && err != Z_STREAM_END)
+		{
+			logerror("inflate error: %d\n", err);
+			inflater_put(inflater);
+			return -1;
+		}
+
+		if (callback && d_stream->next_out != chunk)
+			callback(param, chunk, d_stream->next_out - chunk);
+	} while (err != Z_STREAM_END && d_stream->next_out != out_data + out_size);
+
+	if (err != Z_STREAM_END || d_stream->next_out != out_data + out_size)
+	{
+		logerror("zip size mismatch. %i\n", (int)(d_stream->next_out - out_data));
+		inflater_put(inflater);
 		return -1;
 	}
 
+	inflater_put(inflater);
+
 	return 0;
 }
 
+/* Inflate a memory block, see inflate_zipped_data_stream() */
+int inflate_zipped_data(unsigned char* in_data, unsigned in_size, unsigned char* out_data, unsigned out_size)
+{
+	return inflate_zipped_data_stream(in_data, in_size, out_data, out_size, 0, 0);
+}
+
 /* Read compressed data
    out:
     data compressed data read
@@ -561,14 +930,12 @@ int readcompresszip(zip_file* zip, zip_entry* ent, char* data) {
 	return 0;
 }
 
-/* Read UNcompressed data
-   out:
-    data UNcompressed data
+/* Check that the data of a zip entry can be decompressed
    return:
     ==0 success
     <0 error
 */
-int readuncompresszip(zip_file* zip, zip_entry* ent, char* data) {
+static int checkuncompresszip(zip_file* zip, zip_entry* ent) {
 	if (ent->compression_method == 0x0000) {
 		/* file is not compressed, simply stored */
 
@@ -578,7 +945,7 @@ int readuncompresszip(zip_file* zip, zip_entry* ent, char* data) {
 			return -3;
 		}
 
-		return readcompresszip(zip,ent,data);
+		return 0;
 	} else if (ent->compression_method == 0x0008) {
 		/* file is compressed using "Deflate" method */
 		if (ent->version_needed_to_extract > 0x14) {
@@ -596,6 +963,28 @@ int readuncompresszip(zip_file* zip, zip_entry* ent, char* data) {
 			return -2;
 		}
 
+		return 0;
+	} else {
+		errormsg("Compression method unsupported", ERROR_UNSUPPORTED, zip->zip);
+		return -2;
+	}
+}
+
+/* Read UNcompressed data
+   out:
+    data UNcompressed data
+   return:
+    ==0 success
+    <0 error
+*/
+int readuncompresszip(zip_file* zip, zip_entry* ent, char* data) {
+	int err = checkuncompresszip(zip,ent);
+	if (err!=0)
+		return err;
+
+	if (ent->compression_method == 0x0000) {
+		return readcompresszip(zip,ent,data);
+	} else {
 		/* read compressed data */
 		if (seekcompresszip(zip,ent)!=0) {
 			return -1;
@@ -609,9 +998,6 @@ int readuncompresszip(zip_file* zip, zip_entry* ent, char* data) {
 		}
 
 		return 0;
-	} else {
-		errormsg("Compression method unsupported", ERROR_UNSUPPORTED, zip->zip);
-		return -2;
 	}
 }
 
@@ -625,20 +1011,33 @@ int readuncompresszip(zip_file* zip, zip_entry* ent, char* data) {
 #ifdef ZIP_CACHE
 
 /* ZIP cache entries */
-#define ZIP_CACHE_MAX 5
+#define ZIP_CACHE_MAX 256
+
+/* Default number of ZIP kept open */
+#define ZIP_CACHE_DEFAULT 32
+
+/* Memory limit of the directories kept open */
+#define ZIP_CACHE_MEMORY (16*1024*1024)
 
 /* ZIP cache buffer LRU ( Last Recently Used )
      zip_cache_map[0] is the newer
-     zip_cache_map[ZIP_CACHE_MAX-1] is the older
+     zip_cache_map[zip_cache_size-1] is the older
 */
 static zip_file* zip_cache_map[ZIP_CACHE_MAX];
+static unsigned zip_cache_size = ZIP_CACHE_DEFAULT;
+
+/* Memory used by an open zip */
+static unsigned cache_memory(zip_file* zip) {
+	return sizeof(zip_file) + zip->size_of_cent_dir + zip->ecd_length + (zip->index ? zip->index->size : 0);
+}
 
 static zip_file* cache_openzip(int pathtype, int pathindex, const char* zipfile) {
 	zip_file* zip;
+	unsigned memory;
 	unsigned i;
 
 	/* search in the cache buffer */
-	for(i=0;i<ZIP_CACHE_MAX;++i) {
+	for(i=0;i<zip_cache_size;++i) {
 		if (zip_cache_map[i] && zip_cache_map[i]->pathtype == pathtype && zip_cache_map[i]->pathindex == pathindex && strcmp(zip_cache_map[i]->zip,zipfile)==0) {
 			/* found */
 			unsigned j;
@@ -674,16 +1073,24 @@ static zip_file* cache_openzip(int pathtype, int pathindex, const char* zipfile)
 	if (!zip)
 		return 0;
 
-	/* close the oldest entry */
-	if (zip_cache_map[ZIP_CACHE_MAX-1]) {
-		/* close last zip */
-		closezip(zip_cache_map[ZIP_CACHE_MAX-1]);
-		/* reset the entry */
-		zip_cache_map[ZIP_CACHE_MAX-1] = 0;
+	/* close the oldest entries, until there is space for the new one */
+	memory = cache_memory(zip);
+	for(i=0;i<zip_cache_size-1 && zip_cache_map[i];++i) {
+		if (memory + cache_memory(zip_cache_map[i]) > ZIP_CACHE_MEMORY)
+			break;
+		memory += cache_memory(zip_cache_map[i]);
+	}
+	for(;i<zip_cache_size;++i) {
+		if (zip_cache_map[i]) {
+			/* close last zip */
+			closezip(zip_cache_map[i]);
+			/* reset the entry */
+			zip_cache_map[i] = 0;
+		}
 	}
 
 	/* shift */
-	for(i=ZIP_CACHE_MAX-1;i>0;--i)
+	for(i=zip_cache_size-1;i>0;--i)
 		zip_cache_map[i] = zip_cache_map[i-1];
 
 	/* set the first entry */
@@ -733,6 +1140,27 @@ void unzip_cache_clear()
 	}
 }
 
+/* Set the number of zip kept open */
+void unzip_cache_set_size(unsigned count)
+{
+	unsigned i;
+
+	if (count < 1)
+		count = 1;
+	if (count > ZIP_CACHE_MAX)
+		count = ZIP_CACHE_MAX;
+
+	/* close the entries not anymore in the cache */
+	for(i=count;i<ZIP_CACHE_MAX;++i) {
+		if (zip_cache_map[i] != NULL) {
+			closezip(zip_cache_map[i]);
+			zip_cache_map[i] = 0;
+		}
+	}
+
+	zip_cache_size = count;
+}
+
 #define cache_suspendzip(a) suspendzip(a)
 
 #else
@@ -742,6 +1170,7 @@ void unzip_cache_clear()
 #define cache_suspendzip(a) closezip(a)
 
 #define unzip_cache_clear()
+#define unzip_cache_set_size(a)
 
 #endif
 
@@ -779,44 +1208,43 @@ int /* error */ load_zipped_file (int pathtype, int pathindex, const char* zipfi
 	if (!zip)
 		return -1;
 
-	while (readzip(zip)) {
-		/* NS981003: support for "load by CRC" */
-		char crc[9];
-
-		ent = &(zip->ent);
-
-		sprintf(crc,"%08x",ent->crc32);
-		if (equal_filename(ent->name, filename) ||
-				(ent->crc32 && !strcmp(crc, filename)))
-		{
-			*length = ent->uncompressed_size;
-			*buf = (unsigned char*)malloc( *length );
-			if (!*buf) {
-				if (!gUnzipQuiet)
-					printf("load_zipped_file(): Unable to allocate %d bytes of RAM\n",*length);
-				cache_closezip(zip);
-				return -1;
-			}
-
-			if (readuncompresszip(zip, ent, (char*)*buf)!=0) {
-				free(*buf);
-				cache_closezip(zip);
-				return -1;
-			}
+	/* NS981003: support for "load by CRC" */
+	ent = findzip(zip, filename);
+	if (ent)
+	{
+		*length = ent->uncompressed_size;
+		*buf = (unsigned char*)malloc( *length );
+		if (!*buf) {
+			if (!gUnzipQuiet)
+				printf("load_zipped_file(): Unable to allocate %d bytes of RAM\n",*length);
+			cache_closezip(zip);
+			return -1;
+		}
 
-			cache_suspendzip(zip);
-			return 0;
+		if (readuncompresszip(zip, ent, (char*)*buf)!=0) {
+			free(*buf);
+			cache_closezip(zip);
+			return -1;
 		}
+
+		cache_suspendzip(zip);
+		return 0;
 	}
 
 	cache_suspendzip(zip);
 	return -1;
 }
 
-/*  Pass the path to the zipfile and the name of the file within the zipfile.
-    sum will be set to the CRC-32 of that zipped file. */
-/*  The caller can preset sum to the expected checksum to enable "load by CRC" */
-int /* error */ checksum_zipped_file (int pathtype, int pathindex, const char *zipfile, const char *filename, unsigned int *length, unsigned int *sum) {
+/* Pass the path to the zipfile and the name of the file within the zipfile.
+   buf will be set to point to the raw data of that zipped file, followed by
+   one spare byte; compressed_length and length will be set to the size of
+   the raw and of the uncompressed data. If method is 8 the raw data must be
+   expanded with inflate_zipped_data(), otherwise it's already the file.
+   A stored file is mapped in memory if possible, in which case mapped is
+   set, there is no spare byte, and buf must be released with osd_funmap().
+   Only the file access is done here, the decompression can be done later
+   out of the zip cache, also from another thread. */
+int /* error */ load_zipped_file_raw (int pathtype, int pathindex, const char* zipfile, const char* filename, unsigned char** buf, unsigned int* compressed_length, unsigned int* length, unsigned int* method, int* mapped) {
 	zip_file* zip;
 	zip_entry* ent;
 
@@ -824,35 +1252,76 @@ int /* error */ checksum_zipped_file (int pathtype, int pathindex, const char *z
 	if (!zip)
 		return -1;
 
-	while (readzip(zip)) {
-		ent = &(zip->ent);
+	/* NS981003: support for "load by CRC" */
+	ent = findzip(zip, filename);
+	if (ent)
+	{
+		if (checkuncompresszip(zip, ent)!=0) {
+			cache_closezip(zip);
+			return -1;
+		}
 
-		if (equal_filename(ent->name, filename))
-		{
-			*length = ent->uncompressed_size;
-			*sum = ent->crc32;
-			cache_suspendzip(zip);
-			return 0;
+		*compressed_length = ent->compressed_size;
+		*length = ent->uncompressed_size;
+		*method = ent->compression_method;
+
+		/* a stored file is used directly from the archive */
+		if (*method == 0x0000 && seekcompresszip(zip, ent)==0) {
+			*buf = (unsigned char*)osd_fmap(zip->fp, osd_ftell(zip->fp), *compressed_length);
+			if (*buf) {
+				*mapped = 1;
+				cache_suspendzip(zip);
+				return 0;
+			}
 		}
+
+		*mapped = 0;
+		*buf = (unsigned char*)malloc( *compressed_length + 1 );
+		if (!*buf) {
+			if (!gUnzipQuiet)
+				printf("load_zipped_file_raw(): Unable to allocate %d bytes of RAM\n",*compressed_length + 1);
+			cache_closezip(zip);
+			return -1;
+		}
+		(*buf)[*compressed_length] = 0;
+
+		if (readcompresszip(zip, ent, (char*)*buf)!=0) {
+			free(*buf);
+			cache_closezip(zip);
+			return -1;
+		}
+
+		cache_suspendzip(zip);
+		return 0;
 	}
 
 	cache_suspendzip(zip);
+	return -1;
+}
+
+/*  Pass the path to the zipfile and the name of the file within the zipfile.
+    sum will be set to the CRC-32 of that zipped file. */
+/*  The caller can preset sum to the expected checksum to enable "load by CRC" */
+int /* error */ checksum_zipped_file (int pathtype, int pathindex, const char *zipfile, const char *filename, unsigned int *length, unsigned int *sum) {
+	zip_file* zip;
+	zip_entry* ent;
 
-	/* NS981003: support for "load by CRC" */
 	zip = cache_openzip(pathtype, pathindex, zipfile);
 	if (!zip)
 		return -1;
 
-	while (readzip(zip)) {
-		ent = &(zip->ent);
+	ent = findzipentry(zip, filename, 0);
 
-		if (*sum && ent->crc32 == *sum)
-		{
-			*length = ent->uncompressed_size;
-			*sum = ent->crc32;
-			cache_suspendzip(zip);
-			return 0;
-		}
+	/* NS981003: support for "load by CRC" */
+	if (!ent && *sum)
+		ent = findzipcrc(zip, *sum);
+
+	if (ent)
+	{
+		*length = ent->uncompressed_size;
+		*sum = ent->crc32;
+		cache_suspendzip(zip);
+		return 0;
 	}
 
 	cache_suspendzip(zip);
@@ -59,6 +59,8 @@ struct _zip_file
 
 	zip_entry ent; /* buffer for readzip */
 
+	struct _zip_index* index; /* lookup of the entries by name and by crc */
+
 	/* end_of_cent_dir */
 	UINT32	end_of_cent_dir_sig;
 	UINT16	number_of_this_disk;
@@ -91,6 +93,23 @@ void closezip(zip_file* zip);
 */
 zip_entry* readzip(zip_file* zip);
 
+/* Finds an entry of a zip stream by name, or by crc given as a "%08x" name
+   in:
+     zip opened zip
+     filename name of the entry, without directory and ignoring case
+   return:
+     !=0 success
+     ==0 not found
+*/
+zip_entry* findzip(zip_file* zip, const char* filename);
+
+/* Finds an entry of a zip stream by crc
+   return:
+     !=0 success
+     ==0 not found
+*/
+zip_entry* findzipcrc(zip_file* zip, UINT32 crc);
+
 /* Suspend access to a zip file (release file handler)
    in:
       zip opened zip
@@ -135,9 +154,19 @@ int readuncompresszip(zip_file* zip, zip_entry* ent, char* data);
 /* public functions */
 int /* error */ load_zipped_file (int pathtype, int pathindex, const char *zipfile, const char *filename,
 	unsigned char **buf, unsigned int *length);
+int /* error */ load_zipped_file_raw (int pathtype, int pathindex, const char *zipfile, const char *filename,
+	unsigned char **buf, unsigned int *compressed_length, unsigned int *length, unsigned int *method, int *mapped);
+/* called with every piece of data just decompressed by inflate_zipped_data_stream() */
+typedef void (*inflate_callback)(void *param, const unsigned char *data, unsigned length);
+
+int /* error */ inflate_zipped_data (unsigned char *in_data, unsigned in_size, unsigned char *out_data, unsigned out_size);
+int /* error */ inflate_zipped_data_stream (unsigned char *in_data, unsigned in_size, unsigned char *out_data, unsigned out_size,
+	inflate_callback callback, void *param);
 int /* error */ checksum_zipped_file (int pathtype, int pathindex, const char *zipfile, const char *filename, unsigned int *length, unsigned int *sum);
 
 void unzip_cache_clear(void);
+void unzip_inflater_clear(void);
+void unzip_cache_set_size(unsigned count);
 
 /* public globals */
 extern int	gUnzipQuiet;	/* flag controls error messages */
@@ -86,9 +86,12 @@ static int xmin, ymin, xmax, ymax; /* clipping area */
 static int vector_runs;	/* vector runs per refresh */
 
 static void (*vector_draw_aa_pixel)(int x, int y, rgb_t col, int dirty);
+static void (*vector_draw_aa_span)(int x, int y, int count, int vertical, rgb_t col);
 
 static void vector_draw_aa_pixel_15 (int x, int y, rgb_t col, int dirty);
 static void vector_draw_aa_pixel_32 (int x, int y, rgb_t col, int dirty);
+static void vector_draw_aa_span_15 (int x, int y, int count, int vertical, rgb_t col);
+static void vector_draw_aa_span_32 (int x, int y, int count, int vertical, rgb_t col);
 
 void vector_register_aux_renderer(int (*aux_renderer)(point *start, int num_points))
 {
@@ -208,9 +211,11 @@ VIDEO_START( vector )
 	{
 	case 15:
 		vector_draw_aa_pixel = vector_draw_aa_pixel_15;
+		vector_draw_aa_span = vector_draw_aa_span_15;
 		break;
 	case 32:
 		vector_draw_aa_pixel = vector_draw_aa_pixel_32;
+		vector_draw_aa_span = vector_draw_aa_span_32;
 		break;
 	default:
 		logerror ("Vector games have to use direct RGB modes!\n");
@@ -322,6 +327,152 @@ static void vector_draw_aa_pixel_32 (int x, int y, rgb_t col, int dirty)
 		vector_dirty_list[dirty_index++] = coords;
 }
 
+/*
+ * clips a run of pixels against the clipping area
+ *
+ * input:    x,y  start of the run, updated to the first visible pixel
+ *         count  number of pixels in the run
+ *      vertical  the run goes down along y instead of right along x
+ *
+ * returns the number of visible pixels, 0 if the run is fully clipped
+ */
+INLINE int vector_clip_span(int *x, int *y, int count, int vertical)
+{
+	int begin, end, min, max;
+
+	if (vertical)
+	{
+		if (*x < xmin || *x >= xmax)
+			return 0;
+		begin = *y;
+		min = ymin;
+		max = ymax;
+	}
+	else
+	{
+		if (*y < ymin || *y >= ymax)
+			return 0;
+		begin = *x;
+		min = xmin;
+		max = xmax;
+	}
+
+	end = begin + count;
+	if (begin < min)
+		begin = min;
+	if (end > max)
+		end = max;
+	if (begin >= end)
+		return 0;
+
+	if (vertical)
+		*y = begin;
+	else
+		*x = begin;
+
+	return end - begin;
+}
+
+/*
+ * draws a solid run of anti-aliased pixels with the same color
+ *
+ * This is the inner part of the beam, the clipping, color split and
+ * depth dispatch are done once for the whole run instead of per pixel.
+ */
+static void vector_draw_aa_span_15 (int x, int y, int count, int vertical, rgb_t col)
+{
+	vector_pixel_t coords, step;
+	UINT16 *dst;
+	int dst_step;
+	UINT32 r, g, b, v;
+
+	count = vector_clip_span(&x, &y, count, vertical);
+	if (!count)
+		return;
+
+	r = RGB_RED(col) >> 3;
+	g = RGB_GREEN(col) >> 3;
+	b = RGB_BLUE(col) >> 3;
+
+	dst = &((UINT16 *)vecbitmap->line[y])[x];
+	if (vertical)
+	{
+		dst_step = vecbitmap->rowpixels;
+		step = VECTOR_PIXEL(0,1);
+	}
+	else
+	{
+		dst_step = 1;
+		step = VECTOR_PIXEL(1,0);
+	}
+
+	coords = VECTOR_PIXEL(x,y);
+	while (count--)
+	{
+		v = *dst;
+		*dst = LIMIT5(b + (v & 0x1f))
+			| (LIMIT5(g + ((v >> 5) & 0x1f)) << 5)
+			| (LIMIT5(r + (v >> 10)) << 10);
+		dst += dst_step;
+
+		if (p_index<MAX_PIXELS)
+			pixel[p_index++] = coords;
+
+		/* Mark this pixel as dirty */
+		if (dirty_index<MAX_DIRTY_PIXELS)
+			vector_dirty_list[dirty_index++] = coords;
+
+		coords += step;
+	}
+}
+
+static void vector_draw_aa_span_32 (int x, int y, int count, int vertical, rgb_t col)
+{
+	vector_pixel_t coords, step;
+	UINT32 *dst;
+	int dst_step;
+	UINT32 r, g, b, v;
+
+	count = vector_clip_span(&x, &y, count, vertical);
+	if (!count)
+		return;
+
+	r = RGB_RED(col);
+	g = RGB_GREEN(col);
+	b = RGB_BLUE(col);
+
+	dst = &((UINT32 *)vecbitmap->line[y])[x];
+	if (vertical)
+	{
+		dst_step = vecbitmap->rowpixels;
+		step = VECTOR_PIXEL(0,1);
+	}
+	else
+	{
+		dst_step = 1;
+		step = VECTOR_PIXEL(1,0);
+	}
+
+	coords = VECTOR_PIXEL(x,y);
+	while (count--)
+	{
+		v = *dst;
+		*dst = LIMIT8(b + (v & 0xff))
+			| (LIMIT8(g + ((v >> 8) & 0xff)) << 8)
+			| (LIMIT8(r + (v >> 16)) << 16);
+		dst += dst_step;
+
+		if (p_index<MAX_PIXELS)
+			pixel[p_index++] = coords;
+
+		/* Mark this pixel as dirty */
+		if (dirty_index<MAX_DIRTY_PIXELS)
+			vector_dirty_list[dirty_index++] = coords;
+
+		coords += step;
+	}
+}
+
 
 /*
  * draws a line
@@ -395,8 +546,11 @@ void vector_draw_to(int x2, int y2, rgb_t col, int intensity, int dirty, rgb_t (
 				dx -= 0x10000 - (0xffff & yy1); /* take off amount plotted */
 				a1 = Tgamma[(dx >> 8) & 0xff];   /* calc remainder pixel */
 				dx >>= 16;                   /* adjust to pixel (solid) count */
-				while (dx--)                 /* plot rest of pixels */
-					vector_draw_aa_pixel(x1, dy++, col, dirty);
+				if (dx > 0)                  /* plot rest of pixels */
+				{
+					vector_draw_aa_span(x1, dy, dx, 1, col);
+					dy += dx;
+				}
 				vector_draw_aa_pixel(x1, dy, Tinten(a1,col), dirty);
 				if (x1 == xx) break;
 				x1 += sx;
@@ -423,8 +577,11 @@ void vector_draw_to(int x2, int y2, rgb_t col, int intensity, int dirty, rgb_t (
 				dy -= 0x10000 - (0xffff & x1); /* take off amount plotted */
 				a1 = Tgamma[(dy >> 8) & 0xff];   /* remainder pixel */
 				dy >>= 16;                   /* adjust to pixel (solid) count */
-				while (dy--)                 /* plot rest of pixels */
-					vector_draw_aa_pixel(dx++, yy1, col, dirty);
+				if (dy > 0)                  /* plot rest of pixels */
+				{
+					vector_draw_aa_span(dx, yy1, dy, 0, col);
+					dx += dy;
+				}
 				vector_draw_aa_pixel(dx, yy1, Tinten(a1, col), dirty);
 				if (yy1 == yy) break;
 				yy1 += sy;